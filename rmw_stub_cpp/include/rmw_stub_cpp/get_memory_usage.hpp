@@ -0,0 +1,29 @@
+#ifndef RMW_STUB_CPP__GET_MEMORY_USAGE_HPP_
+#define RMW_STUB_CPP__GET_MEMORY_USAGE_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace rmw_stub_cpp
+{
+
+// Memory held by the samples queued on a topic
+struct TopicMemoryUsage
+{
+  std::string topic_name;
+  size_t samples;
+  size_t bytes;
+};
+
+// Memory held by the samples of each topic in use, largest first
+std::vector<TopicMemoryUsage>
+get_topic_memory_usage();
+
+// Memory held by the samples of all the topics of the process
+TopicMemoryUsage
+get_process_memory_usage();
+
+}  // namespace rmw_stub_cpp
+
+#endif  // RMW_STUB_CPP__GET_MEMORY_USAGE_HPP_
@@ -0,0 +1,132 @@
+#ifndef RMW_STUB_CPP__MESSAGE_VIEW_HPP_
+#define RMW_STUB_CPP__MESSAGE_VIEW_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include "rmw/types.h"
+#include "rosidl_runtime_c/message_type_support_struct.h"
+
+namespace rmw_stub_cpp
+{
+
+class FieldView;
+
+// Read-only view of a serialized message. Nothing is deserialized: each
+// accessed field is located by walking the fields serialized before it,
+// without copying them, and only the requested values are read.
+class MessageView
+{
+public:
+  MessageView() = default;
+
+  // View a serialized message, which must outlive the view and its fields
+  MessageView(
+    const rmw_serialized_message_t * serialized_message,
+    const rosidl_message_type_support_t * type_support);
+
+  // False if the type has no C++ introspection type support,
+  // or if the view was returned for a missing or malformed field
+  bool is_valid() const
+  {
+    return members_ != nullptr;
+  }
+
+  FieldView get_field(const char * name) const;
+
+  FieldView operator[](const char * name) const;
+
+private:
+  friend class FieldView;
+  friend rmw_ret_t take_message_view(
+    const rmw_subscription_t *, MessageView *, bool *, rmw_message_info_t *);
+
+  MessageView(
+    std::shared_ptr<const void> owner, const uint8_t * payload, size_t size,
+    const void * members, size_t offset);
+
+  // Keeps a taken sample alive, null when viewing a serialized message
+  std::shared_ptr<const void> owner_;
+  // CDR payload, after the encapsulation header
+  const uint8_t * payload_{nullptr};
+  size_t size_{0};
+  // rosidl_typesupport_introspection_cpp::MessageMembers of this message
+  const void * members_{nullptr};
+  // Start of this message within the payload
+  size_t offset_{0};
+};
+
+// A field of a message view
+class FieldView
+{
+public:
+  FieldView() = default;
+
+  // False if the field doesn't exist or the message is malformed
+  bool is_valid() const
+  {
+    return member_ != nullptr;
+  }
+
+  // rosidl_typesupport_introspection_cpp::ROS_TYPE_*
+  uint8_t get_type_id() const;
+
+  bool is_array() const;
+
+  // Number of elements, 1 if the field is not an array
+  size_t size() const;
+
+  // Read an element of a primitive field. Returns false if T doesn't
+  // have the size of the field's type or the index is out of range.
+  template<typename T>
+  bool get_value(T & value, size_t index = 0) const
+  {
+    static_assert(std::is_arithmetic<T>::value, "primitive fields only");
+    return get_bytes(&value, sizeof(T), index);
+  }
+
+  bool get_string(std::string & value, size_t index = 0) const;
+
+  // Nested message, invalid if the field is not a message
+  MessageView get_message(size_t index = 0) const;
+
+  // Field of a nested message, for chaining: view["header"]["stamp"]["sec"]
+  FieldView operator[](const char * name) const
+  {
+    return get_message()[name];
+  }
+
+  // First element of a primitive array, read in place. Elements are aligned
+  // within the payload, not necessarily in memory: copy them out with memcpy.
+  const void * data() const;
+
+private:
+  friend class MessageView;
+
+  // Offset of an element within the payload, or false if there's none
+  bool locate(size_t index, size_t & offset) const;
+
+  bool get_bytes(void * value, size_t value_size, size_t index) const;
+
+  MessageView message_;
+  // rosidl_typesupport_introspection_cpp::MessageMember of this field
+  const void * member_{nullptr};
+  // Start of this field within the payload, before any length prefix
+  size_t offset_{0};
+};
+
+// Take the next sample of a subscription as a view, sharing it with the
+// other subscriptions instead of deserializing it into a message
+rmw_ret_t
+take_message_view(
+  const rmw_subscription_t * subscription,
+  MessageView * message_view,
+  bool * taken,
+  rmw_message_info_t * message_info);
+
+}  // namespace rmw_stub_cpp
+
+#endif  // RMW_STUB_CPP__MESSAGE_VIEW_HPP_
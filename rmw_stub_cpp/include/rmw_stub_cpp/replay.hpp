@@ -0,0 +1,30 @@
+#ifndef RMW_STUB_CPP__REPLAY_HPP_
+#define RMW_STUB_CPP__REPLAY_HPP_
+
+#include <string>
+#include <vector>
+
+#include "rmw/types.h"
+
+namespace rmw_stub_cpp
+{
+
+struct ReplayOptions
+{
+  // Speed relative to the recording: 1 replays at the recorded timing,
+  // 2 twice as fast, and 0 as fast as possible
+  double rate{1.0};
+
+  // Topics to replay, all the recorded ones if empty
+  std::vector<std::string> topics;
+};
+
+// Publish the samples recorded with RMW_STUB_RECORD_DIR in `directory` again
+// to the subscriptions of this process, and return once they all are.
+// Returns RMW_RET_ERROR if there's nothing to replay in `directory`.
+rmw_ret_t
+replay(const std::string & directory, const ReplayOptions & options = ReplayOptions());
+
+}  // namespace rmw_stub_cpp
+
+#endif  // RMW_STUB_CPP__REPLAY_HPP_
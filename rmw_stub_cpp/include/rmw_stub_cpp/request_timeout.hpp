@@ -0,0 +1,27 @@
+#ifndef RMW_STUB_CPP__REQUEST_TIMEOUT_HPP_
+#define RMW_STUB_CPP__REQUEST_TIMEOUT_HPP_
+
+#include <chrono>
+
+#include "rmw/types.h"
+
+namespace rmw_stub_cpp
+{
+
+// Give the requests sent by a client from now on a deadline, `timeout`
+// after they are sent (0, the default, for none). A request without a
+// response at its deadline gets a timeout response instead, and its
+// response is dropped if it comes later.
+rmw_ret_t
+set_request_timeout(const rmw_client_t * client, std::chrono::nanoseconds timeout);
+
+// Timeout responses trigger the client's new response callback and are
+// taken by rmw_take_response() as responses are, with the sequence number
+// of their request, but leave the response message untouched.
+// True if `request_header` was taken with a timeout response.
+bool
+is_timeout_response(const rmw_service_info_t * request_header);
+
+}  // namespace rmw_stub_cpp
+
+#endif  // RMW_STUB_CPP__REQUEST_TIMEOUT_HPP_
@@ -0,0 +1,30 @@
+#ifndef RMW_STUB_CPP__SERVICE_DISPATCH_HPP_
+#define RMW_STUB_CPP__SERVICE_DISPATCH_HPP_
+
+#include <string>
+
+namespace rmw_stub_cpp
+{
+
+// How the requests of a service are dispatched to its servers
+enum class ServiceDispatch
+{
+  // Every server gets every request (default)
+  BROADCAST,
+  // Each request goes to one server, in turn
+  ROUND_ROBIN,
+  // Each request goes to the server with the fewest requests not taken yet
+  LEAST_QUEUED,
+};
+
+// Set how the requests of a service are dispatched, for the servers
+// created before and after the call
+void
+set_service_dispatch(const std::string & service_name, ServiceDispatch dispatch);
+
+ServiceDispatch
+get_service_dispatch(const std::string & service_name);
+
+}  // namespace rmw_stub_cpp
+
+#endif  // RMW_STUB_CPP__SERVICE_DISPATCH_HPP_
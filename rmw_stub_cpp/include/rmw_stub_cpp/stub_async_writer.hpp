@@ -0,0 +1,328 @@
+#ifndef STUB_ASYNC_WRITER_HPP_
+#define STUB_ASYNC_WRITER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "rcutils/logging_macros.h"
+#include "rmw/types.h"
+
+#include "rmw_stub_cpp/stub_futex.hpp"
+#include "rmw_stub_cpp/stub_options.hpp"
+#include "rmw_stub_cpp/stub_sample.hpp"
+#include "rmw_stub_cpp/stub_spsc_queue.hpp"
+#include "rmw_stub_cpp/stub_topic.hpp"
+
+// Background thread publishing for asynchronous publishers.
+// Each publishing thread gets its own single producer queue, so publishing only
+// costs a push: serialization, recording, topic locks, waits for full
+// subscriptions and notifications all happen on the writer thread. Tasks from
+// a given thread run in order.
+// The writer never waits for full subscriptions, which would hold up the
+// tasks of every other thread: tasks return RMW_RET_TIMEOUT instead, and are
+// run again once a subscription takes a sample, until the publish timeout.
+class StubAsyncWriter
+{
+public:
+  static StubAsyncWriter & instance()
+  {
+    static StubAsyncWriter writer;
+    return writer;
+  }
+
+  // Queue a task publishing on `topic`. If the calling thread's queue is
+  // full, wait for the writer to make room, up to the publish timeout.
+  // The task must not wait for full subscriptions, see
+  // StubTopic::publish(), and may run several times until it doesn't
+  // return RMW_RET_TIMEOUT.
+  rmw_ret_t submit(std::shared_ptr<StubTopic> topic, std::function<rmw_ret_t()> task)
+  {
+    ThreadQueue & queue = get_thread_queue();
+    Job job{std::move(topic), std::move(task), {}};
+
+    if (!queue.jobs.push(job)) {
+      auto deadline = std::chrono::steady_clock::now() + StubOptions::get().publish_timeout;
+
+      while (true) {
+        uint32_t pop_count = queue.pop_futex.value();
+        if (queue.jobs.push(job)) {
+          break;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+          return RMW_RET_TIMEOUT;
+        }
+        queue.pop_futex.wait(pop_count, deadline - now);
+      }
+    }
+
+    queue.pushed++;
+    wake(queue);
+    return RMW_RET_OK;
+  }
+
+  // Queue a task which may run late, such as recording a sample, without
+  // ever waiting: returns false if the calling thread's queue is full.
+  // Rather than for each task, the writer is only woken once the queue is
+  // half full or kLazyWakePeriodMs after the thread last woke it, and
+  // otherwise runs the task with the next ones, within a second.
+  bool try_submit(std::shared_ptr<StubTopic> topic, std::function<rmw_ret_t()> task)
+  {
+    ThreadQueue & queue = get_thread_queue();
+    Job job{std::move(topic), std::move(task), {}};
+
+    if (!queue.jobs.push(job)) {
+      return false;
+    }
+    queue.pushed++;
+
+    if (queue.jobs.size() >= queue.jobs.capacity() / 2 ||
+      std::chrono::steady_clock::now() - queue.last_wake >=
+      std::chrono::milliseconds(static_cast<int>(kLazyWakePeriodMs)))
+    {
+      wake(queue);
+    }
+    return true;
+  }
+
+  // Wait for the tasks queued so far by every thread to have run, such as
+  // before destroying the publisher they use
+  void flush()
+  {
+    std::vector<std::pair<std::shared_ptr<ThreadQueue>, uint64_t>> pending;
+    {
+      std::lock_guard<std::mutex> lock(queues_mutex_);
+      for (auto & queue : queues_) {
+        pending.emplace_back(queue, queue->pushed.load());
+      }
+    }
+
+    // Run the tasks the writer wasn't woken for
+    work_futex_.wake_all();
+
+    for (auto & queue : pending) {
+      while (true) {
+        uint32_t done_count = done_futex_.value();
+        if (queue.first->done.load() >= queue.second) {
+          break;
+        }
+        done_futex_.wait(done_count, std::chrono::milliseconds(100));
+      }
+    }
+  }
+
+private:
+  // Longest time the writer sleeps while a task waits for a full subscription,
+  // for the publish timeout to expire
+  static constexpr int kRetryPeriodMs = 10;
+  // Longest time try_submit() leaves the writer sleeping
+  static constexpr int kLazyWakePeriodMs = 10;
+
+  struct Job
+  {
+    std::shared_ptr<StubTopic> topic;
+    std::function<rmw_ret_t()> task;
+    // Set when the task first returns RMW_RET_TIMEOUT
+    std::chrono::steady_clock::time_point deadline;
+  };
+
+  struct ThreadQueue
+  {
+    explicit ThreadQueue(size_t capacity)
+    : jobs(capacity)
+    {
+    }
+
+    StubSpscQueue<Job> jobs;
+    // Popped but waiting for a full subscription, holding up the next jobs.
+    // Only used by the writer.
+    Job blocked_job;
+    // Bumped by the writer when it pops jobs, for producers waiting for room
+    StubFutex pop_futex;
+    // Jobs pushed, and run, for flush()
+    std::atomic<uint64_t> pushed{0};
+    std::atomic<uint64_t> done{0};
+    // Set when the producing thread exits
+    std::atomic<bool> closed{false};
+    // When the producing thread last woke the writer, only used by it
+    std::chrono::steady_clock::time_point last_wake;
+  };
+
+  // Owned by each publishing thread, closes its queue when the thread exits
+  struct ThreadQueueHolder
+  {
+    ~ThreadQueueHolder()
+    {
+      if (queue) {
+        queue->closed = true;
+        StubAsyncWriter::instance().work_futex_.wake_all();
+      }
+    }
+
+    std::shared_ptr<ThreadQueue> queue;
+  };
+
+  StubAsyncWriter()
+  {
+    thread_ = std::thread(&StubAsyncWriter::run, this);
+  }
+
+  ~StubAsyncWriter()
+  {
+    stop_ = true;
+    work_futex_.wake_all();
+    thread_.join();
+  }
+
+  void wake(ThreadQueue & queue)
+  {
+    queue.last_wake = std::chrono::steady_clock::now();
+    work_futex_.wake_all();
+    // In case the writer waits for a full subscription
+    StubTopic::get_process_read_futex().wake_all();
+  }
+
+  ThreadQueue & get_thread_queue()
+  {
+    thread_local ThreadQueueHolder holder;
+
+    if (!holder.queue) {
+      holder.queue = std::make_shared<ThreadQueue>(StubOptions::get().async_queue_size);
+
+      std::lock_guard<std::mutex> lock(queues_mutex_);
+      queues_.push_back(holder.queue);
+      queues_version_++;
+    }
+
+    return *holder.queue;
+  }
+
+  void run()
+  {
+    StubOptions::get().set_thread_affinity();
+
+    std::vector<std::shared_ptr<ThreadQueue>> queues;
+    uint64_t queues_version = 0;
+
+    while (true) {
+      uint32_t work_count = work_futex_.value();
+      uint32_t read_count = StubTopic::get_process_read_futex().value();
+      bool stopping = stop_;
+
+      if (queues_version != queues_version_) {
+        std::lock_guard<std::mutex> lock(queues_mutex_);
+        queues = queues_;
+        queues_version = queues_version_;
+      }
+
+      bool idle = true;
+      bool blocked = false;
+      for (auto & queue : queues) {
+        idle &= !drain(*queue);
+        if (queue->blocked_job.task) {
+          blocked = true;
+        } else if (queue->closed && queue->jobs.empty()) {
+          remove_queue(queue);
+        }
+      }
+
+      if (idle && blocked) {
+        // Until a subscription takes a sample or leaves, or a job is pushed
+        StubTopic::get_process_read_futex().wait(
+          read_count, std::chrono::milliseconds(static_cast<int>(kRetryPeriodMs)));
+      } else if (idle) {
+        if (stopping) {
+          return;
+        }
+        work_futex_.wait(work_count, std::chrono::seconds(1));
+      }
+    }
+  }
+
+  // Deliver the jobs of a queue until one waits for a full subscription.
+  // Returns false if none was run to completion.
+  bool drain(ThreadQueue & queue)
+  {
+    bool done = false;
+
+    if (queue.blocked_job.task) {
+      if (!run_job(queue, queue.blocked_job)) {
+        return false;
+      }
+      done = true;
+    }
+
+    Job job;
+    while (queue.jobs.pop(job)) {
+      queue.pop_futex.wake_all();
+
+      if (!run_job(queue, job)) {
+        queue.blocked_job = std::move(job);
+        return done;
+      }
+      done = true;
+    }
+
+    return done;
+  }
+
+  // Returns false if the job must run again, once a subscription made room
+  bool run_job(ThreadQueue & queue, Job & job)
+  {
+    rmw_ret_t ret = job.task();
+    if (RMW_RET_TIMEOUT == ret) {
+      auto now = std::chrono::steady_clock::now();
+      if (job.deadline == std::chrono::steady_clock::time_point()) {
+        job.deadline = now + StubOptions::get().publish_timeout;
+      }
+      if (now < job.deadline) {
+        return false;
+      }
+    }
+
+    if (RMW_RET_OK != ret) {
+      RCUTILS_LOG_WARN_NAMED(
+        "rmw_stub_cpp", "asynchronous publish on '%s' dropped a sample: %s",
+        job.topic->get_topic_name().c_str(),
+        RMW_RET_TIMEOUT == ret ? "timed out" : "process memory budget exceeded");
+    }
+    job.topic.reset();
+    job.task = nullptr;
+    job.deadline = std::chrono::steady_clock::time_point();
+    queue.done++;
+    done_futex_.wake_all();
+    return true;
+  }
+
+  void remove_queue(const std::shared_ptr<ThreadQueue> & queue)
+  {
+    std::lock_guard<std::mutex> lock(queues_mutex_);
+
+    for (auto it = queues_.begin(); it != queues_.end(); ++it) {
+      if (*it == queue) {
+        queues_.erase(it);
+        queues_version_++;
+        return;
+      }
+    }
+  }
+
+  std::mutex queues_mutex_;
+  std::vector<std::shared_ptr<ThreadQueue>> queues_;
+  std::atomic<uint64_t> queues_version_{0};
+
+  // Bumped by producers after each push
+  StubFutex work_futex_;
+  // Bumped after each job run, for flush()
+  StubFutex done_futex_;
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+
+#endif  // STUB_ASYNC_WRITER_HPP_
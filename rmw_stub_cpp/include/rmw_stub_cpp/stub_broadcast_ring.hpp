@@ -0,0 +1,208 @@
+#ifndef STUB_BROADCAST_RING_HPP_
+#define STUB_BROADCAST_RING_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+#include "rmw_stub_cpp/stub_sample.hpp"
+
+// Single ring shared by all the subscriptions of a topic.
+// Every sample is written once, whatever the number of readers: each reader
+// only keeps its own cursor (the sequence number of the next sample to read).
+// A slot drops its sample as soon as the last pending reader went past it.
+// Readers lagging more than their limits are resynced to the newest samples,
+// which gives them KEEP_LAST semantics.
+// Slots are stored in fixed size segments, allocated while the backlog of the
+// slowest reader grows and released as soon as it went past them, so a large
+// KEEP_ALL limit only costs memory when samples are actually queued.
+// The ring is not thread safe, the owning topic serializes access to it.
+class StubBroadcastRing
+{
+public:
+  StubBroadcastRing() = default;
+
+  uint64_t get_write_sequence() const
+  {
+    return write_sequence_;
+  }
+
+  // Keep at most `capacity` samples and `byte_capacity` bytes, overwriting
+  // the oldest samples beyond that: the limits of the most demanding reader,
+  // set again each time a reader comes or goes. Samples over lowered limits
+  // are dropped by the next push.
+  void set_capacity(size_t capacity, size_t byte_capacity)
+  {
+    capacity_ = capacity;
+    byte_capacity_ = byte_capacity;
+  }
+
+  // Write a sample to be read by `reader_count` readers, overwriting
+  // the oldest ones if the ring is full. A sample larger than the byte
+  // capacity still goes through an empty ring.
+  void push(std::shared_ptr<const StubSample> sample, size_t reader_count)
+  {
+    while (oldest_sequence_ < write_sequence_ &&
+      (write_sequence_ - oldest_sequence_ >= capacity_ ||
+      written_bytes_ - get_slot(oldest_sequence_).bytes_before + sample->size() >
+      byte_capacity_))
+    {
+      Slot & oldest = get_slot(oldest_sequence_);
+      oldest.sample.reset();
+      oldest.pending_readers = 0;
+      oldest_sequence_++;
+      // Readers may have gone past the following samples already
+      while (oldest_sequence_ < write_sequence_ &&
+        get_slot(oldest_sequence_).pending_readers == 0)
+      {
+        oldest_sequence_++;
+      }
+      release_segments();
+    }
+
+    if (write_sequence_ - first_segment_sequence_ == segments_.size() * kSegmentSlots) {
+      segments_.push_back(spare_segment_ ? std::move(spare_segment_) : new_segment());
+    }
+
+    Slot & slot = get_slot(write_sequence_);
+    slot.bytes_before = written_bytes_;
+    written_bytes_ += sample->size();
+    slot.sample = std::move(sample);
+    slot.pending_readers = reader_count;
+    write_sequence_++;
+  }
+
+  // Read the sample at `cursor` and advance it. If the reader has more than
+  // `max_samples` samples or `max_bytes` bytes to read, it first skips the
+  // oldest ones. Returns nullptr if there is nothing new to read.
+  std::shared_ptr<const StubSample> take(
+    uint64_t & cursor, size_t max_samples, size_t max_bytes)
+  {
+    uint64_t first_sequence = std::max(cursor, oldest_sequence_);
+    if (write_sequence_ - first_sequence > max_samples) {
+      first_sequence = write_sequence_ - max_samples;
+    }
+    while (write_sequence_ - first_sequence > 1 &&
+      written_bytes_ - get_slot(first_sequence).bytes_before > max_bytes)
+    {
+      first_sequence++;
+    }
+
+    for (uint64_t sequence = cursor; sequence < first_sequence; sequence++) {
+      release_slot(sequence);
+    }
+    cursor = first_sequence;
+
+    if (cursor == write_sequence_) {
+      return nullptr;
+    }
+
+    std::shared_ptr<const StubSample> sample = get_slot(cursor).sample;
+    release_slot(cursor);
+    cursor++;
+
+    return sample;
+  }
+
+  // Give up all the samples still unread by a reader which is leaving
+  void release(uint64_t cursor)
+  {
+    for (uint64_t sequence = cursor; sequence < write_sequence_; sequence++) {
+      release_slot(sequence);
+    }
+  }
+
+  size_t get_unread_samples(uint64_t cursor) const
+  {
+    return write_sequence_ - std::max(cursor, oldest_sequence_);
+  }
+
+  size_t get_unread_bytes(uint64_t cursor) const
+  {
+    uint64_t sequence = std::max(cursor, oldest_sequence_);
+    if (sequence == write_sequence_) {
+      return 0;
+    }
+    return written_bytes_ - get_slot(sequence).bytes_before;
+  }
+
+private:
+  static constexpr size_t kSegmentSlots = 64;
+
+  struct Slot
+  {
+    std::shared_ptr<const StubSample> sample;
+    size_t pending_readers{0};
+    // Bytes written to the ring before this sample
+    uint64_t bytes_before{0};
+  };
+
+  struct Segment
+  {
+    Slot slots[kSegmentSlots];
+  };
+
+  static std::unique_ptr<Segment> new_segment()
+  {
+    return std::unique_ptr<Segment>(new Segment());
+  }
+
+  Slot & get_slot(uint64_t sequence)
+  {
+    uint64_t index = sequence - first_segment_sequence_;
+    return segments_[index / kSegmentSlots]->slots[index % kSegmentSlots];
+  }
+
+  const Slot & get_slot(uint64_t sequence) const
+  {
+    uint64_t index = sequence - first_segment_sequence_;
+    return segments_[index / kSegmentSlots]->slots[index % kSegmentSlots];
+  }
+
+  void release_slot(uint64_t sequence)
+  {
+    // Already overwritten because the ring was full
+    if (sequence < oldest_sequence_) {
+      return;
+    }
+
+    Slot & slot = get_slot(sequence);
+    if (slot.pending_readers == 0 || --slot.pending_readers > 0) {
+      return;
+    }
+    slot.sample.reset();
+
+    // The slowest reader may have moved on
+    while (oldest_sequence_ < write_sequence_ && get_slot(oldest_sequence_).pending_readers == 0) {
+      oldest_sequence_++;
+    }
+    release_segments();
+  }
+
+  // Recycle the segments holding only samples older than the oldest one
+  void release_segments()
+  {
+    while (first_segment_sequence_ + kSegmentSlots <= oldest_sequence_) {
+      spare_segment_ = std::move(segments_.front());
+      segments_.pop_front();
+      first_segment_sequence_ += kSegmentSlots;
+    }
+  }
+
+  std::deque<std::unique_ptr<Segment>> segments_;
+  // Kept to avoid reallocating a segment each time the ring wraps
+  std::unique_ptr<Segment> spare_segment_;
+  size_t capacity_{0};
+  size_t byte_capacity_{0};
+  // Sequence number of the first slot of the first segment
+  uint64_t first_segment_sequence_{0};
+  // Sequence number of the next sample to be written
+  uint64_t write_sequence_{0};
+  // Sequence number of the oldest sample still in the ring
+  uint64_t oldest_sequence_{0};
+  // Bytes written to the ring since its creation
+  uint64_t written_bytes_{0};
+};
+
+#endif  // STUB_BROADCAST_RING_HPP_
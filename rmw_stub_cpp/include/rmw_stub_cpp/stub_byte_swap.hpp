@@ -0,0 +1,142 @@
+#ifndef STUB_BYTE_SWAP_HPP_
+#define STUB_BYTE_SWAP_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define STUB_BYTE_SWAP_X86
+#include <immintrin.h>
+#endif
+
+// In place byte swapping of arrays of primitives, to read CDR written with
+// the other byte order. Large arrays are swapped 16 or 32 bytes at a time
+// with SSSE3 or AVX2 shuffles when the CPU has them.
+class StubByteSwap
+{
+public:
+  static void swap(void * data, size_t count, size_t element_size)
+  {
+    auto bytes = static_cast<uint8_t *>(data);
+
+#if defined(STUB_BYTE_SWAP_X86)
+    if (element_size == 2 || element_size == 4 || element_size == 8) {
+      static const Kernel kernel = select_kernel();
+      size_t swapped = kernel(bytes, count * element_size, element_size);
+      bytes += swapped;
+      count -= swapped / element_size;
+    }
+#endif
+
+    swap_scalar(bytes, count, element_size);
+  }
+
+  // Reference implementation, also used for the tails of the vector kernels
+  static void swap_scalar(uint8_t * bytes, size_t count, size_t element_size)
+  {
+    switch (element_size) {
+      case 1:
+        break;
+#if defined(__GNUC__) || defined(__clang__)
+      case 2:
+        swap_elements<uint16_t>(bytes, count, [](uint16_t v) {return __builtin_bswap16(v);});
+        break;
+      case 4:
+        swap_elements<uint32_t>(bytes, count, [](uint32_t v) {return __builtin_bswap32(v);});
+        break;
+      case 8:
+        swap_elements<uint64_t>(bytes, count, [](uint64_t v) {return __builtin_bswap64(v);});
+        break;
+#endif
+      default:
+        for (size_t i = 0; i < count; i++) {
+          std::reverse(bytes + i * element_size, bytes + (i + 1) * element_size);
+        }
+        break;
+    }
+  }
+
+private:
+  template<typename T, typename Swap>
+  static void swap_elements(uint8_t * bytes, size_t count, Swap swap_value)
+  {
+    for (size_t i = 0; i < count; i++) {
+      T value;
+      memcpy(&value, bytes + i * sizeof(T), sizeof(T));
+      value = swap_value(value);
+      memcpy(bytes + i * sizeof(T), &value, sizeof(T));
+    }
+  }
+
+#if defined(STUB_BYTE_SWAP_X86)
+  // Swap whole vectors of `size` bytes, and return how many bytes were swapped
+  using Kernel = size_t (*)(uint8_t * bytes, size_t size, size_t element_size);
+
+  static Kernel select_kernel()
+  {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return swap_avx2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+      return swap_ssse3;
+    }
+    return swap_none;
+  }
+
+  static size_t swap_none(uint8_t *, size_t, size_t)
+  {
+    return 0;
+  }
+
+  // Byte indices reversing each element of 2, 4 or 8 bytes of a 16 bytes lane
+  static const uint8_t * get_shuffle_mask(size_t element_size)
+  {
+    alignas(16) static const uint8_t masks[3][16] = {
+      {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+      {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+      {7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8},
+    };
+    return masks[element_size == 2 ? 0 : (element_size == 4 ? 1 : 2)];
+  }
+
+  __attribute__((target("ssse3")))
+  static size_t swap_ssse3(uint8_t * bytes, size_t size, size_t element_size)
+  {
+    const __m128i mask =
+      _mm_load_si128(reinterpret_cast<const __m128i *>(get_shuffle_mask(element_size)));
+
+    size_t offset = 0;
+    for (; offset + 16 <= size; offset += 16) {
+      auto p = reinterpret_cast<__m128i *>(bytes + offset);
+      _mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p), mask));
+    }
+    return offset;
+  }
+
+  __attribute__((target("avx2")))
+  static size_t swap_avx2(uint8_t * bytes, size_t size, size_t element_size)
+  {
+    // vpshufb shuffles within each 128 bits lane: repeat the mask in both
+    const __m128i lane_mask =
+      _mm_load_si128(reinterpret_cast<const __m128i *>(get_shuffle_mask(element_size)));
+    const __m256i mask = _mm256_broadcastsi128_si256(lane_mask);
+
+    size_t offset = 0;
+    for (; offset + 32 <= size; offset += 32) {
+      auto p = reinterpret_cast<__m256i *>(bytes + offset);
+      _mm256_storeu_si256(p, _mm256_shuffle_epi8(_mm256_loadu_si256(p), mask));
+    }
+    if (offset + 16 <= size) {
+      auto p = reinterpret_cast<__m128i *>(bytes + offset);
+      _mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p), lane_mask));
+      offset += 16;
+    }
+    return offset;
+  }
+#endif
+};
+
+#endif  // STUB_BYTE_SWAP_HPP_
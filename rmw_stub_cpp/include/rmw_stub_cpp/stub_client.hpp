@@ -1,19 +1,197 @@
 #ifndef STUB_CLIENT_HPP_
 #define STUB_CLIENT_HPP_
 
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <utility>
+
+#include "rmw/event_callback_type.h"
+#include "rosidl_typesupport_introspection_cpp/service_introspection.hpp"
+
+#include "rmw_stub_cpp/stub_service_message.hpp"
+
 class StubClient
 {
 public:
-  StubClient() = default;
+  using ServiceMembers = rosidl_typesupport_introspection_cpp::ServiceMembers;
+
+  StubClient(const char * service_name, const ServiceMembers * members)
+  : service_name_(service_name), members_(members)
+  {
+    static std::atomic<uint64_t> id{0};
+    client_id_ = id++;
+  }
+
+  const std::string & get_service_name() const
+  {
+    return service_name_;
+  }
+
+  // Null if the type has no C++ introspection type support
+  const ServiceMembers * get_members() const
+  {
+    return members_;
+  }
+
+  uint64_t get_client_id() const
+  {
+    return client_id_;
+  }
+
+  // Identify the next request of this client, to route the responses back
+  rmw_request_id_t create_request_id()
+  {
+    rmw_request_id_t request_id;
+    memset(request_id.writer_guid, 0, sizeof(request_id.writer_guid));
+    memcpy(request_id.writer_guid, &client_id_, sizeof(client_id_));
+    request_id.sequence_number = ++sequence_number_;
+    return request_id;
+  }
+
+  // Deadline of the requests sent from now on, relative to when they are
+  // sent. 0 for no deadline.
+  void set_request_timeout(std::chrono::nanoseconds timeout)
+  {
+    request_timeout_ = timeout.count();
+  }
+
+  std::chrono::nanoseconds get_request_timeout() const
+  {
+    return std::chrono::nanoseconds(request_timeout_.load());
+  }
+
+  // Wait for the response of a request with a deadline
+  void add_pending_request(int64_t sequence_number)
+  {
+    std::lock_guard<std::mutex> lock(responses_mutex_);
+    pending_requests_.insert(sequence_number);
+  }
+
+  // Called when the deadline of a request expires. If the request didn't
+  // get its response yet, it gets a timeout response instead, without a
+  // message, and its response will be dropped if it arrives later.
+  void expire_request(int64_t sequence_number)
+  {
+    {
+      std::lock_guard<std::mutex> lock(responses_mutex_);
+      if (pending_requests_.erase(sequence_number) == 0) {
+        return;
+      }
+
+      // Sent by no server
+      StubServiceMessage timeout;
+      memset(timeout.request_id.writer_guid, 0, sizeof(timeout.request_id.writer_guid));
+      memcpy(timeout.request_id.writer_guid, &client_id_, sizeof(client_id_));
+      timeout.request_id.writer_guid[kTimeoutMarker] = 1;
+      timeout.request_id.sequence_number = sequence_number;
+      timeout.source_timestamp = 0;
+      responses_.push_back(std::move(timeout));
+
+      expired_requests_.insert(sequence_number);
+      if (expired_requests_.size() > kMaxExpiredRequests) {
+        expired_requests_.erase(expired_requests_.begin());
+      }
+    }
+    notify();
+  }
+
+  // True for the request id of a timeout response
+  static bool is_timeout(const rmw_request_id_t & request_id)
+  {
+    return request_id.writer_guid[kTimeoutMarker] != 0;
+  }
+
+  // Called by the registry for each response sent to this client
+  void push_response(StubServiceMessage response)
+  {
+    {
+      std::lock_guard<std::mutex> lock(responses_mutex_);
+
+      int64_t sequence_number = response.request_id.sequence_number;
+      if (expired_requests_.erase(sequence_number) > 0) {
+        // Too late, the request was reported as timed out
+        return;
+      }
+      pending_requests_.erase(sequence_number);
+
+      responses_.push_back(std::move(response));
+    }
+    notify();
+  }
+
+  bool take_response(StubServiceMessage & response)
+  {
+    std::lock_guard<std::mutex> lock(responses_mutex_);
+    if (responses_.empty()) {
+      return false;
+    }
+    response = std::move(responses_.front());
+    responses_.pop_front();
+    return true;
+  }
+
+  void
+  notify()
+  {
+    std::unique_lock<std::mutex> lock_mutex(listener_callback_mutex_);
+
+    if(listener_callback_) {
+      listener_callback_(user_data_, 1);
+    } else {
+      unread_count_++;
+    }
+  }
 
   void
   set_callback(
     rmw_event_callback_t callback,
     const void * user_data)
   {
-    (void)user_data;
-    (void)callback;
+    std::unique_lock<std::mutex> lock_mutex(listener_callback_mutex_);
+
+    user_data_ = user_data;
+    listener_callback_ = callback;
+
+    if(callback) {
+      // Push events arrived before setting the executor's callback
+      if (unread_count_) {
+        callback(user_data, unread_count_);
+      }
+      // Reset unread count
+      unread_count_ = 0;
+    }
   }
+
+private:
+  // Timed out requests remembered to drop their late responses
+  static constexpr size_t kMaxExpiredRequests = 4096;
+  // Byte of the writer guid set in timeout responses, after the client id
+  static constexpr size_t kTimeoutMarker = sizeof(uint64_t);
+
+  const std::string service_name_;
+  const ServiceMembers * members_;
+  uint64_t client_id_;
+  std::atomic<int64_t> sequence_number_{0};
+
+  std::mutex responses_mutex_;
+  std::deque<StubServiceMessage> responses_;
+
+  // Request deadlines
+  std::atomic<int64_t> request_timeout_{0};
+  std::unordered_set<int64_t> pending_requests_;
+  std::set<int64_t> expired_requests_;
+
+  // Events executor
+  rmw_event_callback_t listener_callback_{nullptr};
+  const void * user_data_{nullptr};
+  std::mutex listener_callback_mutex_;
+  uint64_t unread_count_ = 0;
 };
 
 #endif  // STUB_CLIENT_HPP_
@@ -0,0 +1,91 @@
+#ifndef STUB_FUTEX_HPP_
+#define STUB_FUTEX_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#ifdef __linux__
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+// Counter that threads can sleep on until it's bumped by another thread.
+// On Linux waiting and waking are futex syscalls, and waking is free
+// when nobody is waiting.
+class StubFutex
+{
+public:
+  StubFutex() = default;
+
+  uint32_t value() const
+  {
+    return word_.load();
+  }
+
+  // Sleep while the counter is still `expected`, for at most `timeout`.
+  // Returns false if the timeout elapsed, callers must check their
+  // condition again in any case as wake ups can be spurious.
+  bool wait(uint32_t expected, std::chrono::nanoseconds timeout)
+  {
+    if (timeout.count() <= 0) {
+      return false;
+    }
+
+    waiters_++;
+#ifdef __linux__
+    static_assert(sizeof(word_) == sizeof(uint32_t), "futex word must be 32 bits");
+    struct timespec relative_timeout;
+    relative_timeout.tv_sec = timeout.count() / 1000000000;
+    relative_timeout.tv_nsec = timeout.count() % 1000000000;
+    long ret = syscall(
+      SYS_futex, reinterpret_cast<uint32_t *>(&word_), FUTEX_WAIT_PRIVATE,
+      expected, &relative_timeout, nullptr, 0);
+    bool timed_out = (ret == -1 && errno == ETIMEDOUT);
+#else
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool timed_out = !cv_.wait_for(
+      lock, timeout, [this, expected]() {return word_.load() != expected;});
+#endif
+    waiters_--;
+
+    return !timed_out;
+  }
+
+  // Bump the counter and wake up all the waiting threads
+  void wake_all()
+  {
+    word_++;
+
+    if (waiters_.load() == 0) {
+      return;
+    }
+#ifdef __linux__
+    syscall(
+      SYS_futex, reinterpret_cast<uint32_t *>(&word_), FUTEX_WAKE_PRIVATE,
+      INT_MAX, nullptr, nullptr, 0);
+#else
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+    }
+    cv_.notify_all();
+#endif
+  }
+
+private:
+  std::atomic<uint32_t> word_{0};
+  std::atomic<uint32_t> waiters_{0};
+#ifndef __linux__
+  std::mutex mutex_;
+  std::condition_variable cv_;
+#endif
+};
+
+#endif  // STUB_FUTEX_HPP_
@@ -0,0 +1,40 @@
+#ifndef STUB_GID_HPP_
+#define STUB_GID_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+
+#include "rmw/types.h"
+
+// Id of this process: a hash of the boot id in the upper 32 bits, random
+// lower ones. Processes with the same upper bits run on the same host, and
+// not the pid: containers of a host share the boot id, and often the pid.
+inline uint64_t get_process_id()
+{
+  static const uint64_t process_id = []() {
+      std::string boot_id;
+      std::ifstream file("/proc/sys/kernel/random/boot_id");
+      std::getline(file, boot_id);
+      uint32_t hash = 0x811c9dc5;
+      for (char c : boot_id) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 0x01000193;
+      }
+      std::random_device random;
+      return (static_cast<uint64_t>(hash) << 32) | static_cast<uint32_t>(random());
+    }();
+  return process_id;
+}
+
+// GID of a publisher: its id in its process, then the id of its process
+inline void fill_gid(uint64_t process_id, uint64_t publisher_id, rmw_gid_t * gid)
+{
+  static_assert(2 * sizeof(uint64_t) <= sizeof(gid->data), "GIDs are too small");
+  memset(gid->data, 0, sizeof(gid->data));
+  memcpy(gid->data, &publisher_id, sizeof(publisher_id));
+  memcpy(gid->data + sizeof(publisher_id), &process_id, sizeof(process_id));
+}
+
+#endif  // STUB_GID_HPP_
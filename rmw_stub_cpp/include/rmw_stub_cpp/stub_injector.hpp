@@ -0,0 +1,238 @@
+#ifndef STUB_INJECTOR_HPP_
+#define STUB_INJECTOR_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "rcutils/logging_macros.h"
+
+#include "rmw_stub_cpp/stub_options.hpp"
+
+// Degradation of a topic: delay, loss and reordering of its samples,
+// drawn from a random generator seeded per topic so that runs (in virtual
+// time especially) are reproducible.
+class StubInjection
+{
+public:
+  enum class Distribution
+  {
+    // delay + [-jitter, jitter]
+    UNIFORM,
+    // delay + normal of standard deviation jitter
+    NORMAL,
+    // delay + exponential of mean jitter
+    EXPONENTIAL,
+  };
+
+  std::chrono::nanoseconds delay{0};
+  std::chrono::nanoseconds jitter{0};
+  Distribution distribution{Distribution::UNIFORM};
+  // Probability of losing a sample
+  double drop{0.0};
+  // Probability of holding a sample back by reorder_delay, so that the
+  // following ones overtake it
+  double reorder{0.0};
+  std::chrono::nanoseconds reorder_delay{std::chrono::milliseconds(1)};
+
+  void seed(uint64_t seed)
+  {
+    generator_.seed(seed);
+  }
+
+  // Returns false if the sample is dropped, or the delay to deliver it after
+  bool get_delay(std::chrono::nanoseconds & sample_delay)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::uniform_real_distribution<double> probability(0.0, 1.0);
+    if (drop > 0 && probability(generator_) < drop) {
+      return false;
+    }
+
+    double nanoseconds = static_cast<double>(delay.count());
+    const double spread = static_cast<double>(jitter.count());
+    if (spread > 0) {
+      switch (distribution) {
+        case Distribution::NORMAL:
+          nanoseconds += std::normal_distribution<double>(0.0, spread)(generator_);
+          break;
+        case Distribution::EXPONENTIAL:
+          nanoseconds += std::exponential_distribution<double>(1.0 / spread)(generator_);
+          break;
+        default:
+          nanoseconds += std::uniform_real_distribution<double>(-spread, spread)(generator_);
+          break;
+      }
+    }
+    if (reorder > 0 && probability(generator_) < reorder) {
+      nanoseconds += static_cast<double>(reorder_delay.count());
+    }
+
+    sample_delay = std::chrono::nanoseconds(static_cast<int64_t>(std::max(nanoseconds, 0.0)));
+    return true;
+  }
+
+private:
+  std::mutex mutex_;
+  std::mt19937_64 generator_;
+};
+
+// The injections of the topics, read from RMW_STUB_INJECT:
+// "<topic>:<key>=<value>,...;<topic>:..." where <topic> is a topic name or
+// "*" for the other topics, and the keys are:
+// - delay_us, jitter_us: delay of the samples, and its spread
+// - distribution: uniform (default), normal or exponential, of the jitter
+// - drop: probability of losing a sample, between 0 and 1
+// - reorder: probability of delaying a sample by reorder_delay_us more
+// - reorder_delay_us: 1000 by default
+// The inject setting of the configuration file sections matching a topic
+// takes precedence. Each topic gets its own injection, "*" being a template
+// of them, and its generator is seeded with RMW_STUB_INJECT_SEED and its name.
+class StubInjector
+{
+public:
+  static StubInjector & instance()
+  {
+    static StubInjector injector;
+    return injector;
+  }
+
+  // Null if the samples of this topic are delivered untouched
+  StubInjection * get_injection(const std::string & topic_name)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // The inject setting of the configuration file sections matching the
+    // topic replaces its RMW_STUB_INJECT entry, on its first lookup, and
+    // the "*" entry only applies to the topics with neither
+    if (configured_topics_.insert(topic_name).second) {
+      std::string settings = StubOptions::get().get_topic_options(topic_name).inject;
+      if (!settings.empty()) {
+        auto injection = std::make_unique<StubInjection>();
+        if (parse_injection(settings, *injection)) {
+          add_injection(topic_name, std::move(injection));
+        } else {
+          RCUTILS_LOG_WARN_NAMED(
+            "rmw_stub_cpp", "ignoring invalid inject setting '%s' of '%s'",
+            settings.c_str(), topic_name.c_str());
+        }
+      }
+      if (!default_settings_.empty() && !injections_.count(topic_name)) {
+        auto injection = std::make_unique<StubInjection>();
+        parse_injection(default_settings_, *injection);
+        add_injection(topic_name, std::move(injection));
+      }
+    }
+
+    auto it = injections_.find(topic_name);
+    return it != injections_.end() ? it->second.get() : nullptr;
+  }
+
+  // Parse "key=value,..." into an injection, returns false on invalid input
+  static bool parse_injection(const std::string & settings, StubInjection & injection)
+  {
+    size_t begin = 0;
+    while (begin < settings.size()) {
+      size_t end = std::min(settings.find(',', begin), settings.size());
+      std::string setting = settings.substr(begin, end - begin);
+      begin = end + 1;
+
+      size_t equal = setting.find('=');
+      if (equal == std::string::npos) {
+        return false;
+      }
+      std::string key = setting.substr(0, equal);
+      std::string value = setting.substr(equal + 1);
+
+      if (key == "distribution") {
+        if (value == "uniform") {
+          injection.distribution = StubInjection::Distribution::UNIFORM;
+        } else if (value == "normal") {
+          injection.distribution = StubInjection::Distribution::NORMAL;
+        } else if (value == "exponential") {
+          injection.distribution = StubInjection::Distribution::EXPONENTIAL;
+        } else {
+          return false;
+        }
+        continue;
+      }
+
+      char * number_end = nullptr;
+      double number = std::strtod(value.c_str(), &number_end);
+      if (value.empty() || *number_end != '\0' || number < 0) {
+        return false;
+      }
+      auto microseconds = std::chrono::nanoseconds(static_cast<int64_t>(number * 1000));
+      if (key == "delay_us") {
+        injection.delay = microseconds;
+      } else if (key == "jitter_us") {
+        injection.jitter = microseconds;
+      } else if (key == "drop" && number <= 1) {
+        injection.drop = number;
+      } else if (key == "reorder" && number <= 1) {
+        injection.reorder = number;
+      } else if (key == "reorder_delay_us") {
+        injection.reorder_delay = microseconds;
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  StubInjector()
+  {
+    const StubOptions & options = StubOptions::get();
+    const std::string & inject = options.inject;
+
+    size_t begin = 0;
+    while (begin < inject.size()) {
+      size_t end = std::min(inject.find(';', begin), inject.size());
+      std::string entry = inject.substr(begin, end - begin);
+      begin = end + 1;
+
+      size_t colon = entry.rfind(':', entry.find('='));
+      auto injection = std::make_unique<StubInjection>();
+      if (colon == std::string::npos || colon == 0 ||
+        !parse_injection(entry.substr(colon + 1), *injection))
+      {
+        RCUTILS_LOG_WARN_NAMED(
+          "rmw_stub_cpp", "RMW_STUB_INJECT: ignoring invalid entry '%s'", entry.c_str());
+        continue;
+      }
+
+      const std::string topic_name = entry.substr(0, colon);
+      if (topic_name == "*") {
+        default_settings_ = entry.substr(colon + 1);
+      } else {
+        add_injection(topic_name, std::move(injection));
+      }
+    }
+  }
+
+  void add_injection(const std::string & topic_name, std::unique_ptr<StubInjection> injection)
+  {
+    injection->seed(StubOptions::get().inject_seed ^ std::hash<std::string>()(topic_name));
+    injections_[topic_name] = std::move(injection);
+  }
+
+  std::mutex mutex_;
+  // Injections are never removed
+  std::unordered_map<std::string, std::unique_ptr<StubInjection>> injections_;
+  // Of the "*" entry, empty if none
+  std::string default_settings_;
+  // Topics whose configuration file sections were looked up
+  std::unordered_set<std::string> configured_topics_;
+};
+
+#endif  // STUB_INJECTOR_HPP_
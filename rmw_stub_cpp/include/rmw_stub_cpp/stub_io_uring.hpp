@@ -0,0 +1,223 @@
+#ifndef STUB_IO_URING_HPP_
+#define STUB_IO_URING_HPP_
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+// Multishot receives and provided buffer rings need Linux 6.0 headers
+#if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+#define STUB_HAS_IO_URING 1
+#else
+#define STUB_HAS_IO_URING 0
+#endif
+
+#if STUB_HAS_IO_URING
+
+// An io_uring, used through the raw system calls rather than liburing.
+// Only one thread uses it: submission entries are queued with get_sqe(),
+// submitted with enter() or once the queue is full, and their completions
+// peeked with get_cqe() then marked seen. A ring of buffers can be provided
+// to the kernel for the receives, which pick one per completion.
+class StubIoUring
+{
+public:
+  StubIoUring() = default;
+  StubIoUring(const StubIoUring &) = delete;
+  StubIoUring & operator=(const StubIoUring &) = delete;
+
+  ~StubIoUring()
+  {
+    if (buffer_ring_) {
+      ::munmap(buffer_ring_, buffer_ring_size_);
+    }
+    if (sqes_) {
+      ::munmap(sqes_, sqes_size_);
+    }
+    if (ring_) {
+      ::munmap(ring_, ring_size_);
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  // Returns false, with errno set, if the kernel doesn't support io_uring
+  bool create(unsigned int entries)
+  {
+    io_uring_params params = {};
+    fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd_ < 0) {
+      return false;
+    }
+    // Completions are never dropped, and both rings share one mapping
+    if (!(params.features & IORING_FEAT_NODROP) || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+      errno = ENOSYS;
+      return false;
+    }
+
+    ring_size_ = std::max(
+      params.sq_off.array + params.sq_entries * sizeof(uint32_t),
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    void * ring = ::mmap(
+      nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+      IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+      return false;
+    }
+    ring_ = static_cast<uint8_t *>(ring);
+
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void * sqes = ::mmap(
+      nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+      IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      return false;
+    }
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+    sq_head_ = reinterpret_cast<uint32_t *>(ring_ + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<uint32_t *>(ring_ + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<uint32_t *>(ring_ + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<uint32_t *>(ring_ + params.sq_off.array);
+    sq_entries_ = params.sq_entries;
+    cq_head_ = reinterpret_cast<uint32_t *>(ring_ + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<uint32_t *>(ring_ + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<uint32_t *>(ring_ + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(ring_ + params.cq_off.cqes);
+    sq_local_tail_ = *sq_tail_;
+    return true;
+  }
+
+  // Provide `count` buffers of `size` bytes, a power of 2 of them, to the
+  // receives selecting a buffer from group `group`
+  bool provide_buffers(uint16_t group, uint8_t * buffers, size_t size, uint16_t count)
+  {
+    buffer_ring_size_ = count * sizeof(io_uring_buf);
+    void * ring = ::mmap(
+      nullptr, buffer_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+      return false;
+    }
+    buffer_ring_ = static_cast<io_uring_buf_ring *>(ring);
+    buffers_ = buffers;
+    buffer_size_ = size;
+    buffer_mask_ = static_cast<uint16_t>(count - 1);
+
+    io_uring_buf_reg registration = {};
+    registration.ring_addr = reinterpret_cast<uint64_t>(buffer_ring_);
+    registration.ring_entries = count;
+    registration.bgid = group;
+    if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PBUF_RING, &registration, 1)) {
+      return false;
+    }
+    for (uint16_t id = 0; id < count; id++) {
+      recycle_buffer(id);
+    }
+    return true;
+  }
+
+  uint8_t * get_buffer(uint16_t id) const
+  {
+    return buffers_ + id * buffer_size_;
+  }
+
+  // Give a buffer back to the kernel once its data is consumed
+  void recycle_buffer(uint16_t id)
+  {
+    // Not buffer_ring_->bufs, which C++ offsets by the flexible array's padding
+    io_uring_buf & buffer =
+      reinterpret_cast<io_uring_buf *>(buffer_ring_)[buffer_tail_ & buffer_mask_];
+    buffer.addr = reinterpret_cast<uint64_t>(get_buffer(id));
+    buffer.len = static_cast<uint32_t>(buffer_size_);
+    buffer.bid = id;
+    __atomic_store_n(&buffer_ring_->tail, ++buffer_tail_, __ATOMIC_RELEASE);
+  }
+
+  // Submits the entries queued first if the submission queue is full
+  io_uring_sqe * get_sqe()
+  {
+    if (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+      enter(0);
+    }
+    const uint32_t index = sq_local_tail_ & sq_mask_;
+    io_uring_sqe * sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    sq_local_tail_++;
+    return sqe;
+  }
+
+  // Submit the entries queued, and wait for `wait` completions
+  int enter(unsigned int wait)
+  {
+    const uint32_t to_submit = sq_local_tail_ - *sq_tail_;
+    __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+    if (to_submit == 0 && wait == 0) {
+      return 0;
+    }
+    int result;
+    do {
+      result = static_cast<int>(::syscall(
+        __NR_io_uring_enter, fd_, to_submit, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0,
+        nullptr, 0));
+    } while (result < 0 && errno == EINTR);
+    return result;
+  }
+
+  // Null if no completion is available
+  const io_uring_cqe * get_cqe() const
+  {
+    const uint32_t head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+      return nullptr;
+    }
+    return &cqes_[head & cq_mask_];
+  }
+
+  void cqe_seen()
+  {
+    __atomic_store_n(cq_head_, *cq_head_ + 1, __ATOMIC_RELEASE);
+  }
+
+private:
+  int fd_{-1};
+  uint8_t * ring_{nullptr};
+  size_t ring_size_{0};
+  io_uring_sqe * sqes_{nullptr};
+  size_t sqes_size_{0};
+
+  uint32_t * sq_head_;
+  uint32_t * sq_tail_;
+  uint32_t sq_mask_;
+  uint32_t * sq_array_;
+  uint32_t sq_entries_;
+  // Entries queued up to it, submitted on enter()
+  uint32_t sq_local_tail_;
+  uint32_t * cq_head_;
+  uint32_t * cq_tail_;
+  uint32_t cq_mask_;
+  io_uring_cqe * cqes_;
+
+  io_uring_buf_ring * buffer_ring_{nullptr};
+  size_t buffer_ring_size_{0};
+  uint8_t * buffers_{nullptr};
+  size_t buffer_size_{0};
+  uint16_t buffer_mask_{0};
+  uint16_t buffer_tail_{0};
+};
+
+#endif  // STUB_HAS_IO_URING
+
+#endif  // STUB_IO_URING_HPP_
@@ -0,0 +1,55 @@
+#ifndef STUB_MAILBOX_HPP_
+#define STUB_MAILBOX_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "rmw_stub_cpp/stub_sample.hpp"
+
+// Triple buffer holding only the latest sample, for KEEP_LAST depth 1 readers.
+// The writer fills its back buffer and swaps it with the middle one, the reader
+// swaps its front buffer with the middle one when it's marked as fresh.
+// Neither side ever waits for the other, and a buffer is never accessed
+// by both at the same time.
+// Writers must be serialized by the caller, and there must be a single reader.
+class StubLatestValueMailbox
+{
+public:
+  StubLatestValueMailbox() = default;
+
+  // Replace the latest sample, dropping the previous one if it wasn't read.
+  // Returns true if there was none to read, i.e. the reader needs notifying.
+  bool write(std::shared_ptr<const StubSample> sample)
+  {
+    buffers_[back_] = std::move(sample);
+    const uint8_t middle = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel);
+    back_ = middle & kIndexMask;
+    return !(middle & kFresh);
+  }
+
+  // Returns the latest sample if it wasn't taken yet, nullptr otherwise
+  std::shared_ptr<const StubSample> take()
+  {
+    if (!(middle_.load(std::memory_order_acquire) & kFresh)) {
+      return nullptr;
+    }
+
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+    return std::move(buffers_[front_]);
+  }
+
+private:
+  static constexpr uint8_t kIndexMask = 0x3;
+  static constexpr uint8_t kFresh = 0x4;
+
+  std::shared_ptr<const StubSample> buffers_[3];
+  // Index of the middle buffer, with kFresh set if it holds an unread sample
+  std::atomic<uint8_t> middle_{0};
+  // Owned by the writer
+  uint8_t back_{1};
+  // Owned by the reader
+  uint8_t front_{2};
+};
+
+#endif  // STUB_MAILBOX_HPP_
@@ -0,0 +1,177 @@
+#ifndef STUB_MAPPED_FILE_HPP_
+#define STUB_MAPPED_FILE_HPP_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A file mapped in memory, either written: created with a capacity which can
+// be grown, and truncated to the bytes actually written when closed;
+// or read: mapped whole and read only.
+class StubMappedFile
+{
+public:
+  StubMappedFile() = default;
+
+  ~StubMappedFile()
+  {
+    close();
+  }
+
+  StubMappedFile(const StubMappedFile &) = delete;
+  StubMappedFile & operator=(const StubMappedFile &) = delete;
+
+  // Create a file to write, with room for `capacity` bytes. Fails with
+  // EEXIST rather than overwriting an existing file.
+  bool create(const std::string & path, size_t capacity)
+  {
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+      return false;
+    }
+    if (::ftruncate(fd_, static_cast<off_t>(capacity)) != 0) {
+      close();
+      return false;
+    }
+
+    void * data = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+      close();
+      return false;
+    }
+    data_ = static_cast<uint8_t *>(data);
+    capacity_ = capacity;
+    writable_ = true;
+    return true;
+  }
+
+  bool open(const std::string & path)
+  {
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+      return false;
+    }
+    struct stat status;
+    if (::fstat(fd_, &status) != 0) {
+      close();
+      return false;
+    }
+    capacity_ = static_cast<size_t>(status.st_size);
+    size_ = capacity_;
+    if (capacity_ == 0) {
+      return true;
+    }
+
+    void * data = ::mmap(nullptr, capacity_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+      close();
+      return false;
+    }
+    data_ = static_cast<uint8_t *>(data);
+    return true;
+  }
+
+  bool is_open() const
+  {
+    return fd_ >= 0;
+  }
+
+  uint8_t * data()
+  {
+    return data_;
+  }
+
+  const uint8_t * data() const
+  {
+    return data_;
+  }
+
+  // Bytes written, or the whole file when read
+  size_t size() const
+  {
+    return size_;
+  }
+
+  size_t get_capacity() const
+  {
+    return capacity_;
+  }
+
+  // Room for `size` more bytes at data() + size(), moved by grow() only
+  uint8_t * append(size_t size)
+  {
+    if (size_ + size > capacity_ && !grow(size_ + size)) {
+      return nullptr;
+    }
+    uint8_t * data = data_ + size_;
+    size_ += size;
+    return data;
+  }
+
+  // Advise the kernel about how a range is going to be read
+  void advise(size_t offset, size_t size, int advice) const
+  {
+    const size_t page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    size_t begin = offset / page_size * page_size;
+    if (data_ && begin < capacity_) {
+      ::madvise(data_ + begin, std::min(offset + size, capacity_) - begin, advice);
+    }
+  }
+
+  // Written files are truncated to their size
+  void close()
+  {
+    if (data_) {
+      ::munmap(data_, capacity_);
+      data_ = nullptr;
+    }
+    if (fd_ >= 0) {
+      if (writable_) {
+        (void)::ftruncate(fd_, static_cast<off_t>(size_));
+      }
+      ::close(fd_);
+      fd_ = -1;
+    }
+    size_ = 0;
+    capacity_ = 0;
+    writable_ = false;
+  }
+
+private:
+  // Double the capacity until `size` bytes fit
+  bool grow(size_t size)
+  {
+    if (!writable_) {
+      return false;
+    }
+    size_t capacity = capacity_ > 0 ? capacity_ : 4096;
+    while (capacity < size) {
+      capacity *= 2;
+    }
+    if (::ftruncate(fd_, static_cast<off_t>(capacity)) != 0) {
+      return false;
+    }
+
+    void * data = ::mremap(data_, capacity_, capacity, MREMAP_MAYMOVE);
+    if (data == MAP_FAILED) {
+      return false;
+    }
+    data_ = static_cast<uint8_t *>(data);
+    capacity_ = capacity;
+    return true;
+  }
+
+  int fd_{-1};
+  uint8_t * data_{nullptr};
+  size_t size_{0};
+  size_t capacity_{0};
+  bool writable_{false};
+};
+
+#endif  // STUB_MAPPED_FILE_HPP_
@@ -0,0 +1,67 @@
+#ifndef STUB_MEMORY_ACCOUNT_HPP_
+#define STUB_MEMORY_ACCOUNT_HPP_
+
+#include <atomic>
+#include <cstddef>
+
+// Memory held by the samples of a topic. Every sample is charged to the
+// account of its topic for as long as it's alive, and to the process total.
+class StubMemoryAccount
+{
+public:
+  StubMemoryAccount() = default;
+
+  void charge(size_t bytes)
+  {
+    bytes_ += bytes;
+    samples_++;
+    process_bytes() += bytes;
+    process_samples()++;
+  }
+
+  void refund(size_t bytes)
+  {
+    bytes_ -= bytes;
+    samples_--;
+    process_bytes() -= bytes;
+    process_samples()--;
+  }
+
+  size_t get_bytes() const
+  {
+    return bytes_;
+  }
+
+  size_t get_samples() const
+  {
+    return samples_;
+  }
+
+  static size_t get_process_bytes()
+  {
+    return process_bytes();
+  }
+
+  static size_t get_process_samples()
+  {
+    return process_samples();
+  }
+
+private:
+  static std::atomic<size_t> & process_bytes()
+  {
+    static std::atomic<size_t> bytes{0};
+    return bytes;
+  }
+
+  static std::atomic<size_t> & process_samples()
+  {
+    static std::atomic<size_t> samples{0};
+    return samples;
+  }
+
+  std::atomic<size_t> bytes_{0};
+  std::atomic<size_t> samples_{0};
+};
+
+#endif  // STUB_MEMORY_ACCOUNT_HPP_
@@ -0,0 +1,186 @@
+#ifndef STUB_MESSAGE_COPY_HPP_
+#define STUB_MESSAGE_COPY_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rosidl_runtime_cpp/message_initialization.hpp"
+#include "rosidl_typesupport_introspection_cpp/field_types.hpp"
+#include "rosidl_typesupport_introspection_cpp/message_introspection.hpp"
+
+#include "rmw_stub_cpp/stub_type_support.hpp"
+
+// Typed copies of C++ messages driven by their introspection type support,
+// to hand messages over within the process without serializing them
+class StubMessageCopy
+{
+public:
+  using MessageMembers = rosidl_typesupport_introspection_cpp::MessageMembers;
+  using MessageMember = rosidl_typesupport_introspection_cpp::MessageMember;
+
+  // Allocate a copy of a message, destroyed with the last reference to it
+  static std::shared_ptr<void> clone(const MessageMembers * members, const void * message)
+  {
+    void * copy = ::operator new(members->size_of_);
+    members->init_function(copy, rosidl_runtime_cpp::MessageInitialization::SKIP);
+
+    std::shared_ptr<void> clone(
+      copy,
+      [members](void * message) {
+        members->fini_function(message);
+        ::operator delete(message);
+      });
+    copy_message(members, message, copy);
+    return clone;
+  }
+
+  static void copy_message(
+    const MessageMembers * members, const void * source, void * destination)
+  {
+    for (uint32_t i = 0; i < members->member_count_; i++) {
+      const MessageMember & member = members->members_[i];
+      copy_member(
+        member,
+        static_cast<const uint8_t *>(source) + member.offset_,
+        static_cast<uint8_t *>(destination) + member.offset_);
+    }
+  }
+
+  // Like copy_message(), but steals the strings and unbounded sequences
+  // of primitives of the source rather than copying them
+  static void move_message(const MessageMembers * members, void * source, void * destination)
+  {
+    namespace ts = rosidl_typesupport_introspection_cpp;
+
+    for (uint32_t i = 0; i < members->member_count_; i++) {
+      const MessageMember & member = members->members_[i];
+      void * from = static_cast<uint8_t *>(source) + member.offset_;
+      void * to = static_cast<uint8_t *>(destination) + member.offset_;
+
+      if (!member.is_array_ && member.type_id_ == ts::ROS_TYPE_STRING) {
+        static_cast<std::string *>(to)->swap(*static_cast<std::string *>(from));
+      } else if (!member.is_array_ && member.type_id_ == ts::ROS_TYPE_MESSAGE) {
+        move_message(StubTypeSupport::get_nested_members(member), from, to);
+      } else if (!(member.is_array_ && member.array_size_ == 0 && swap_vector(member, from, to))) {
+        copy_member(member, from, to);
+      }
+    }
+  }
+
+private:
+  static void copy_member(const MessageMember & member, const void * source, void * destination)
+  {
+    namespace ts = rosidl_typesupport_introspection_cpp;
+
+    if (!member.is_array_) {
+      copy_element(member, source, destination);
+      return;
+    }
+
+    size_t count = member.array_size_;
+    if (StubTypeSupport::is_sequence(member)) {
+      count = member.size_function(source);
+      member.resize_function(destination, count);
+    }
+    if (count == 0) {
+      return;
+    }
+
+    size_t primitive_size = StubTypeSupport::get_primitive_size(member.type_id_);
+    if (member.type_id_ == ts::ROS_TYPE_BOOLEAN) {
+      // std::vector<bool> is not contiguous
+      for (size_t index = 0; index < count; index++) {
+        bool value;
+        member.fetch_function(source, index, &value);
+        member.assign_function(destination, index, &value);
+      }
+    } else if (primitive_size > 0) {
+      memcpy(
+        member.get_function(destination, 0), member.get_const_function(source, 0),
+        count * primitive_size);
+    } else {
+      for (size_t index = 0; index < count; index++) {
+        copy_element(
+          member, member.get_const_function(source, index), member.get_function(destination, index));
+      }
+    }
+  }
+
+  static void copy_element(const MessageMember & member, const void * source, void * destination)
+  {
+    namespace ts = rosidl_typesupport_introspection_cpp;
+
+    switch (member.type_id_) {
+      case ts::ROS_TYPE_STRING:
+        *static_cast<std::string *>(destination) = *static_cast<const std::string *>(source);
+        break;
+      case ts::ROS_TYPE_WSTRING:
+        *static_cast<std::u16string *>(destination) = *static_cast<const std::u16string *>(source);
+        break;
+      case ts::ROS_TYPE_MESSAGE:
+        copy_message(StubTypeSupport::get_nested_members(member), source, destination);
+        break;
+      default:
+        memcpy(destination, source, StubTypeSupport::get_primitive_size(member.type_id_));
+        break;
+    }
+  }
+
+  // Swap the std::vector of an unbounded sequence of primitives,
+  // or return false for other element types
+  static bool swap_vector(const MessageMember & member, void * source, void * destination)
+  {
+    namespace ts = rosidl_typesupport_introspection_cpp;
+
+    switch (member.type_id_) {
+      case ts::ROS_TYPE_FLOAT:
+        return swap_vector<float>(source, destination);
+      case ts::ROS_TYPE_DOUBLE:
+        return swap_vector<double>(source, destination);
+      case ts::ROS_TYPE_LONG_DOUBLE:
+        return swap_vector<long double>(source, destination);
+      case ts::ROS_TYPE_CHAR:
+        return swap_vector<unsigned char>(source, destination);
+      case ts::ROS_TYPE_WCHAR:
+        return swap_vector<char16_t>(source, destination);
+      case ts::ROS_TYPE_BOOLEAN:
+        return swap_vector<bool>(source, destination);
+      case ts::ROS_TYPE_OCTET:
+        return swap_vector<unsigned char>(source, destination);
+      case ts::ROS_TYPE_UINT8:
+        return swap_vector<uint8_t>(source, destination);
+      case ts::ROS_TYPE_INT8:
+        return swap_vector<int8_t>(source, destination);
+      case ts::ROS_TYPE_UINT16:
+        return swap_vector<uint16_t>(source, destination);
+      case ts::ROS_TYPE_INT16:
+        return swap_vector<int16_t>(source, destination);
+      case ts::ROS_TYPE_UINT32:
+        return swap_vector<uint32_t>(source, destination);
+      case ts::ROS_TYPE_INT32:
+        return swap_vector<int32_t>(source, destination);
+      case ts::ROS_TYPE_UINT64:
+        return swap_vector<uint64_t>(source, destination);
+      case ts::ROS_TYPE_INT64:
+        return swap_vector<int64_t>(source, destination);
+      case ts::ROS_TYPE_STRING:
+        return swap_vector<std::string>(source, destination);
+      default:
+        return false;
+    }
+  }
+
+  template<typename T>
+  static bool swap_vector(void * source, void * destination)
+  {
+    static_cast<std::vector<T> *>(destination)->swap(*static_cast<std::vector<T> *>(source));
+    return true;
+  }
+};
+
+#endif  // STUB_MESSAGE_COPY_HPP_
@@ -1,16 +1,28 @@
 #ifndef STUB_NODE_HPP_
 #define STUB_NODE_HPP_
 
+#include "rmw/types.h"
+
+#include "rmw_stub_cpp/stub_guard_condition.hpp"
+#include "rmw_stub_cpp/stub_service_registry.hpp"
+
 class StubNode
 {
 public:
-  StubNode()
+  explicit StubNode(const char * implementation_identifier)
   {
     graph_guard_condition = new rmw_guard_condition_t;
+    graph_guard_condition->implementation_identifier = implementation_identifier;
+    graph_guard_condition->data = &graph_guard_condition_impl_;
+    graph_guard_condition->context = nullptr;
+
+    // Triggered when services become available or unavailable
+    StubServiceRegistry::instance().add_graph_guard_condition(&graph_guard_condition_impl_);
   }
 
   ~StubNode()
   {
+    StubServiceRegistry::instance().remove_graph_guard_condition(&graph_guard_condition_impl_);
     delete graph_guard_condition;
   }
 
@@ -21,6 +33,7 @@ public:
 
 private:
     rmw_guard_condition_t * graph_guard_condition{nullptr};
+    StubGuardCondition graph_guard_condition_impl_;
 };
 
 #endif  // STUB_NODE_HPP_
@@ -0,0 +1,493 @@
+#ifndef STUB_OPTIONS_HPP_
+#define STUB_OPTIONS_HPP_
+
+#include <fnmatch.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rcutils/get_env.h"
+#include "rcutils/logging_macros.h"
+
+// Settings of the endpoints of a topic: the process wide ones, overridden by
+// the sections of the configuration file matching the topic name
+struct StubTopicOptions
+{
+  enum class Transport
+  {
+    // Samples only go to the subscriptions of the process
+    INTRA,
+    // Samples are handed off to the subscriptions of the process, and also
+    // sent over UDP to the udp_peers having subscriptions to the topic,
+    // see stub_udp_transport.hpp
+    AUTO,
+  };
+
+  enum class Queue
+  {
+    // The latest value mailbox for KEEP_LAST depth 1 subscriptions, the
+    // topic's ring for the others
+    AUTO,
+    // The ring for every subscription
+    RING,
+    // The mailbox for every KEEP_LAST subscription whatever its depth,
+    // keeping only the newest sample
+    MAILBOX,
+  };
+
+  // transport: intra, or auto (also accepted as udp)
+  Transport transport{Transport::AUTO};
+  // queue: auto, ring or mailbox
+  Queue queue{Queue::AUTO};
+  // keep_all_max_samples, keep_all_max_bytes
+  size_t keep_all_max_samples{0};
+  size_t keep_all_max_bytes{0};
+  // async_publish
+  bool async_publish{false};
+  // record: whether the samples are recorded, if recording is enabled
+  bool record{false};
+  // inject: injection settings of stub_injector.hpp, "delay_us=100,drop=0.1"
+  std::string inject;
+};
+
+// Process wide settings, read once, from lowest to highest precedence:
+// defaults, the [global] section of the configuration file named by
+// RMW_STUB_CONFIG, and the environment.
+// Each setting has a key in the file, and an environment variable named
+// RMW_STUB_ followed by the key in upper case.
+// The configuration file also has [topic <glob>] sections of StubTopicOptions
+// settings, applied in order to the topics matching the glob. The background
+// threads serve every topic, so their cpu_affinity is only process wide. E.g.
+//   [global]
+//   async_publish = 1
+//   [topic /camera/*]
+//   keep_all_max_bytes = 100000000
+//   record = 0
+class StubOptions
+{
+public:
+  static const StubOptions & get()
+  {
+    static StubOptions options;
+    return options;
+  }
+
+  // publish_timeout_ms: longest time a reliable publisher waits
+  // for a full RELIABLE + KEEP_ALL subscription before giving up
+  std::chrono::milliseconds publish_timeout{100};
+
+  // keep_all_max_samples: samples queued for a KEEP_ALL subscription
+  size_t keep_all_max_samples{1000};
+
+  // keep_all_max_bytes: bytes queued for a KEEP_ALL subscription
+  size_t keep_all_max_bytes{std::numeric_limits<size_t>::max()};
+
+  // max_process_samples and max_process_bytes: samples and bytes held
+  // by all the topics of the process, beyond which publishing fails
+  size_t max_process_samples{std::numeric_limits<size_t>::max()};
+  size_t max_process_bytes{std::numeric_limits<size_t>::max()};
+
+  // async_publish: publishers only queue their samples,
+  // which are delivered by a background writer thread
+  bool async_publish{false};
+
+  // async_queue_size: samples queued by each publishing thread
+  size_t async_queue_size{1024};
+
+  // parallel_copy_threshold: size in bytes from which serialized
+  // arrays are copied by the serialization workers, 0 to never do it
+  size_t parallel_copy_threshold{1024 * 1024};
+
+  // serialization_threads: workers helping with large copies
+  size_t serialization_threads{3};
+
+  // record_dir: directory where published samples are recorded, which
+  // must not hold a recording already; recording is disabled if empty
+  std::string record_directory;
+
+  // record_topics: comma separated names of the topics to record,
+  // all of them if empty
+  std::vector<std::string> record_topics;
+
+  // record_segment_size: size in bytes of the recording segment files
+  size_t record_segment_size{64 * 1024 * 1024};
+
+  // virtual_time: run on a virtual clock advanced explicitly,
+  // delivering everything in a reproducible order, see stub_scheduler.hpp
+  bool virtual_time{false};
+
+  // inject: delay, loss and reordering of the samples of some
+  // topics, see stub_injector.hpp
+  std::string inject;
+
+  // inject_seed: seed of the injections' random generators
+  uint64_t inject_seed{0};
+
+  // cpu_affinity: CPUs the background threads run on, as "0,2-3",
+  // any of them if empty
+  std::vector<int> cpu_affinity;
+
+  // udp_port: port of 127.0.0.1 exchanging samples with the udp_peers
+  uint16_t udp_port{7400};
+
+  // udp_peers: comma separated "address:port" of the other processes,
+  // without which every topic is intra
+  std::vector<std::string> udp_peers;
+
+  // udp_datagram_size: largest datagram sent, beyond which samples are
+  // fragmented
+  size_t udp_datagram_size{1472};
+
+  // udp_queue_size: samples waiting to be sent over UDP, beyond which the
+  // oldest one is dropped
+  size_t udp_queue_size{1024};
+
+  // udp_max_sample_size: largest sample received over UDP, so that a
+  // datagram can't make the process allocate any size
+  size_t udp_max_sample_size{64 * 1024 * 1024};
+
+  // udp_heartbeat_period_ms: period of the heartbeats of the reliable UDP
+  // publishers, from which the peers find out the samples they missed
+  std::chrono::milliseconds udp_heartbeat_period{100};
+
+  // udp_io_uring: run the UDP transport's I/O on io_uring rather than epoll,
+  // when the kernel supports it
+  bool udp_io_uring{true};
+
+  // udp_drop: probability of not sending a datagram, to test the recovery
+  // of the reliable UDP topics
+  double udp_drop{0.0};
+
+  // memfd_threshold: size in bytes from which the samples sent to the
+  // other processes of the host are written into a memfd, handed to them
+  // through a unix socket rather than sent over UDP, 0 to disable
+  size_t memfd_threshold{1024 * 1024};
+
+  StubTopicOptions get_topic_options(const std::string & topic_name) const
+  {
+    StubTopicOptions options;
+    options.keep_all_max_samples = keep_all_max_samples;
+    options.keep_all_max_bytes = keep_all_max_bytes;
+    options.async_publish = async_publish;
+    options.record = record_topics.empty() ||
+      std::find(record_topics.begin(), record_topics.end(), topic_name) != record_topics.end();
+
+    for (const TopicSection & section : topic_sections_) {
+      if (fnmatch(section.glob.c_str(), topic_name.c_str(), 0) != 0) {
+        continue;
+      }
+      for (const auto & setting : section.settings) {
+        set_topic_option(options, setting.first, setting.second);
+      }
+    }
+    if (udp_peers.empty()) {
+      options.transport = StubTopicOptions::Transport::INTRA;
+    }
+    return options;
+  }
+
+  // Called by the background threads when they start
+  void set_thread_affinity() const
+  {
+    if (cpu_affinity.empty()) {
+      return;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu : cpu_affinity) {
+      CPU_SET(cpu, &cpus);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  }
+
+private:
+  // Settings of a [topic <glob>] section
+  struct TopicSection
+  {
+    std::string glob;
+    std::vector<std::pair<std::string, std::string>> settings;
+  };
+
+  StubOptions()
+  {
+    static const char * const keys[] = {
+      "publish_timeout_ms", "keep_all_max_samples", "keep_all_max_bytes", "max_process_samples",
+      "max_process_bytes", "async_publish", "async_queue_size", "parallel_copy_threshold",
+      "serialization_threads", "record_dir", "record_topics", "record_segment_size",
+      "virtual_time", "inject", "inject_seed", "cpu_affinity", "udp_port", "udp_peers",
+      "udp_datagram_size", "udp_queue_size", "udp_max_sample_size", "udp_heartbeat_period_ms",
+      "udp_io_uring",
+      "udp_drop", "memfd_threshold",
+    };
+
+    const char * config_path = nullptr;
+    if (rcutils_get_env("RMW_STUB_CONFIG", &config_path) == nullptr && config_path &&
+      *config_path != '\0')
+    {
+      read_config(config_path);
+    }
+
+    for (const char * key : keys) {
+      std::string name = "RMW_STUB_" + std::string(key);
+      std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+
+      const char * value = nullptr;
+      if (rcutils_get_env(name.c_str(), &value) == nullptr && value && *value != '\0' &&
+        !set_option(key, value))
+      {
+        RCUTILS_LOG_WARN_NAMED("rmw_stub_cpp", "ignoring invalid %s=%s", name.c_str(), value);
+      }
+    }
+  }
+
+  void read_config(const std::string & path)
+  {
+    std::ifstream file(path);
+    if (!file) {
+      RCUTILS_LOG_ERROR_NAMED("rmw_stub_cpp", "can't read RMW_STUB_CONFIG '%s'", path.c_str());
+      return;
+    }
+
+    // Before the first section, settings are global
+    bool global = true;
+    std::string line;
+    for (size_t line_number = 1; std::getline(file, line); line_number++) {
+      line = trim(line);
+      if (line.empty() || line[0] == '#' || line[0] == ';') {
+        continue;
+      }
+
+      if (line.front() == '[' && line.back() == ']') {
+        std::string section = trim(line.substr(1, line.size() - 2));
+        global = section == "global";
+        if (!global && section.compare(0, 6, "topic ") == 0) {
+          topic_sections_.push_back({trim(section.substr(6)), {}});
+        } else if (!global) {
+          RCUTILS_LOG_WARN_NAMED(
+            "rmw_stub_cpp", "%s:%zu: unknown section [%s]", path.c_str(), line_number,
+            section.c_str());
+          // Ignore its settings
+          topic_sections_.push_back({"", {}});
+        }
+        continue;
+      }
+
+      size_t equal = line.find('=');
+      if (equal == std::string::npos) {
+        RCUTILS_LOG_WARN_NAMED(
+          "rmw_stub_cpp", "%s:%zu: ignoring '%s', not a key = value setting", path.c_str(),
+          line_number, line.c_str());
+        continue;
+      }
+      std::string key = trim(line.substr(0, equal));
+      std::string value = trim(line.substr(equal + 1));
+
+      bool valid;
+      if (global) {
+        valid = set_option(key, value);
+      } else {
+        StubTopicOptions topic_options;
+        valid = set_topic_option(topic_options, key, value);
+        if (valid) {
+          topic_sections_.back().settings.emplace_back(key, value);
+        }
+      }
+      if (!valid) {
+        RCUTILS_LOG_WARN_NAMED(
+          "rmw_stub_cpp", "%s:%zu: ignoring invalid setting '%s'", path.c_str(), line_number,
+          line.c_str());
+      }
+    }
+  }
+
+  // Returns false for an unknown key or an invalid value
+  bool set_option(const std::string & key, const std::string & value)
+  {
+    uint64_t number = 0;
+    const bool is_number = parse_number(value, number);
+
+    if (key == "publish_timeout_ms" && is_number) {
+      publish_timeout = std::chrono::milliseconds(number);
+    } else if (key == "keep_all_max_samples" && is_number && number > 0) {
+      keep_all_max_samples = number;
+    } else if (key == "keep_all_max_bytes" && is_number && number > 0) {
+      keep_all_max_bytes = number;
+    } else if (key == "max_process_samples" && is_number && number > 0) {
+      max_process_samples = number;
+    } else if (key == "max_process_bytes" && is_number && number > 0) {
+      max_process_bytes = number;
+    } else if (key == "async_publish") {
+      return parse_bool(value, async_publish);
+    } else if (key == "async_queue_size" && is_number && number > 0) {
+      async_queue_size = number;
+    } else if (key == "parallel_copy_threshold" && is_number) {
+      parallel_copy_threshold = number > 0 ? number : std::numeric_limits<size_t>::max();
+    } else if (key == "serialization_threads" && is_number) {
+      serialization_threads = number;
+    } else if (key == "record_dir") {
+      record_directory = value;
+    } else if (key == "record_topics") {
+      record_topics = split(value, ',');
+    } else if (key == "record_segment_size" && is_number && number > 0) {
+      record_segment_size = number;
+    } else if (key == "virtual_time") {
+      return parse_bool(value, virtual_time);
+    } else if (key == "inject") {
+      inject = value;
+    } else if (key == "inject_seed" && is_number) {
+      inject_seed = number;
+    } else if (key == "cpu_affinity") {
+      return parse_cpus(value, cpu_affinity);
+    } else if (key == "udp_port" && is_number && number <= 65535) {
+      udp_port = static_cast<uint16_t>(number);
+    } else if (key == "udp_peers") {
+      udp_peers = split(value, ',');
+    } else if (key == "udp_datagram_size" && is_number && number > 0) {
+      udp_datagram_size = number;
+    } else if (key == "udp_queue_size" && is_number && number > 0) {
+      udp_queue_size = number;
+    } else if (key == "udp_max_sample_size" && is_number && number > 0) {
+      udp_max_sample_size = number;
+    } else if (key == "udp_heartbeat_period_ms" && is_number && number > 0) {
+      udp_heartbeat_period = std::chrono::milliseconds(number);
+    } else if (key == "udp_io_uring") {
+      return parse_bool(value, udp_io_uring);
+    } else if (key == "udp_drop") {
+      char * end = nullptr;
+      double probability = std::strtod(value.c_str(), &end);
+      if (value.empty() || *end != '\0' || probability < 0 || probability > 1) {
+        return false;
+      }
+      udp_drop = probability;
+    } else if (key == "memfd_threshold" && is_number) {
+      memfd_threshold = number;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  static bool set_topic_option(
+    StubTopicOptions & options, const std::string & key, const std::string & value)
+  {
+    uint64_t number = 0;
+    const bool is_number = parse_number(value, number);
+
+    if (key == "transport") {
+      if (value == "intra") {
+        options.transport = StubTopicOptions::Transport::INTRA;
+      } else if (value == "auto" || value == "udp") {
+        options.transport = StubTopicOptions::Transport::AUTO;
+      } else {
+        return false;
+      }
+    } else if (key == "queue") {
+      if (value == "auto") {
+        options.queue = StubTopicOptions::Queue::AUTO;
+      } else if (value == "ring") {
+        options.queue = StubTopicOptions::Queue::RING;
+      } else if (value == "mailbox") {
+        options.queue = StubTopicOptions::Queue::MAILBOX;
+      } else {
+        return false;
+      }
+    } else if (key == "keep_all_max_samples" && is_number && number > 0) {
+      options.keep_all_max_samples = number;
+    } else if (key == "keep_all_max_bytes" && is_number && number > 0) {
+      options.keep_all_max_bytes = number;
+    } else if (key == "async_publish") {
+      return parse_bool(value, options.async_publish);
+    } else if (key == "record") {
+      return parse_bool(value, options.record);
+    } else if (key == "inject") {
+      options.inject = value;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  // Decimal digits only: strtoull() would take "-1" for the largest number
+  static bool parse_number(const std::string & value, uint64_t & number)
+  {
+    if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0]))) {
+      return false;
+    }
+    char * end = nullptr;
+    errno = 0;
+    number = std::strtoull(value.c_str(), &end, 10);
+    return *end == '\0' && errno != ERANGE;
+  }
+
+  static bool parse_bool(const std::string & value, bool & flag)
+  {
+    if (value == "1" || value == "true") {
+      flag = true;
+    } else if (value == "0" || value == "false") {
+      flag = false;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  // "0,2-3" into {0, 2, 3}
+  static bool parse_cpus(const std::string & value, std::vector<int> & cpus)
+  {
+    std::vector<int> parsed;
+    for (const std::string & range : split(value, ',')) {
+      uint64_t first = 0;
+      uint64_t last = 0;
+      size_t dash = range.find('-');
+      if (!parse_number(range.substr(0, dash), first) ||
+        !parse_number(dash != std::string::npos ? range.substr(dash + 1) : range, last) ||
+        first > last || last >= CPU_SETSIZE)
+      {
+        return false;
+      }
+      for (uint64_t cpu = first; cpu <= last; cpu++) {
+        parsed.push_back(static_cast<int>(cpu));
+      }
+    }
+    cpus = std::move(parsed);
+    return true;
+  }
+
+  static std::vector<std::string> split(const std::string & value, char separator)
+  {
+    std::vector<std::string> parts;
+    size_t begin = 0;
+    while (begin <= value.size()) {
+      size_t end = std::min(value.find(separator, begin), value.size());
+      if (end > begin) {
+        parts.push_back(trim(value.substr(begin, end - begin)));
+      }
+      begin = end + 1;
+    }
+    return parts;
+  }
+
+  static std::string trim(const std::string & value)
+  {
+    size_t begin = value.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) {
+      return "";
+    }
+    return value.substr(begin, value.find_last_not_of(" \t\r") - begin + 1);
+  }
+
+  std::vector<TopicSection> topic_sections_;
+};
+
+#endif  // STUB_OPTIONS_HPP_
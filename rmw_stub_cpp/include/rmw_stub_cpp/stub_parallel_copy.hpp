@@ -0,0 +1,204 @@
+#ifndef STUB_PARALLEL_COPY_HPP_
+#define STUB_PARALLEL_COPY_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "rmw_stub_cpp/stub_futex.hpp"
+#include "rmw_stub_cpp/stub_options.hpp"
+
+// Small pool of threads splitting a loop with the calling thread
+class StubWorkerPool
+{
+public:
+  static StubWorkerPool & instance()
+  {
+    static StubWorkerPool pool(StubOptions::get().serialization_threads);
+    return pool;
+  }
+
+  size_t get_thread_count() const
+  {
+    return threads_.size();
+  }
+
+  // Run fn(0) .. fn(count - 1) on the workers and the calling thread,
+  // and return once they are all done. If the pool is already busy with
+  // another caller, everything runs on the calling thread.
+  void parallel_for(size_t count, const std::function<void(size_t)> & fn)
+  {
+    std::unique_lock<std::mutex> caller_lock(caller_mutex_, std::try_to_lock);
+    if (!caller_lock.owns_lock() || threads_.empty() || count < 2) {
+      for (size_t i = 0; i < count; i++) {
+        fn(i);
+      }
+      return;
+    }
+
+    auto job = std::make_shared<Job>(fn, count);
+    {
+      std::lock_guard<std::mutex> lock(job_mutex_);
+      job_ = job;
+    }
+    job_futex_.wake_all();
+
+    run_job(*job);
+    while (job->done < count) {
+      uint32_t done_count = job->done_futex.value();
+      if (job->done < count) {
+        job->done_futex.wait(done_count, std::chrono::seconds(1));
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(job_mutex_);
+    job_.reset();
+  }
+
+private:
+  struct Job
+  {
+    Job(const std::function<void(size_t)> & fn, size_t count)
+    : fn(fn), count(count)
+    {
+    }
+
+    const std::function<void(size_t)> & fn;
+    const size_t count;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    StubFutex done_futex;
+  };
+
+  explicit StubWorkerPool(size_t thread_count)
+  {
+    for (size_t i = 0; i < thread_count; i++) {
+      threads_.emplace_back(&StubWorkerPool::run, this);
+    }
+  }
+
+  ~StubWorkerPool()
+  {
+    stop_ = true;
+    job_futex_.wake_all();
+    for (auto & thread : threads_) {
+      thread.join();
+    }
+  }
+
+  static void run_job(Job & job)
+  {
+    size_t i;
+    while ((i = job.next++) < job.count) {
+      job.fn(i);
+      if (++job.done == job.count) {
+        job.done_futex.wake_all();
+      }
+    }
+  }
+
+  void run()
+  {
+    StubOptions::get().set_thread_affinity();
+
+    while (!stop_) {
+      uint32_t job_count = job_futex_.value();
+
+      std::shared_ptr<Job> job;
+      {
+        std::lock_guard<std::mutex> lock(job_mutex_);
+        job = job_;
+      }
+
+      if (job) {
+        run_job(*job);
+      }
+      job_futex_.wait(job_count, std::chrono::seconds(1));
+    }
+  }
+
+  std::mutex caller_mutex_;
+  std::mutex job_mutex_;
+  std::shared_ptr<Job> job_;
+  // Bumped each time a new job is posted
+  StubFutex job_futex_;
+  std::atomic<bool> stop_{false};
+  std::vector<std::thread> threads_;
+};
+
+// Copies of large serialized payloads. Above the parallel copy threshold, the
+// copy is split across the worker pool and uses non-temporal stores, so that
+// the destination (only read later, by the subscriptions) doesn't evict the
+// publisher's working set from its cache.
+class StubParallelCopy
+{
+public:
+  static void copy(void * destination, const void * source, size_t size)
+  {
+    const size_t threshold = StubOptions::get().parallel_copy_threshold;
+    if (size < threshold) {
+      memcpy(destination, source, size);
+      return;
+    }
+
+    StubWorkerPool & pool = StubWorkerPool::instance();
+    size_t chunk_count = pool.get_thread_count() + 1;
+    // Cache line aligned chunks, so workers don't share destination lines,
+    // of at least one line even for a tiny threshold
+    size_t chunk_size = ((size / chunk_count) + kCacheLineSize - 1) & ~(kCacheLineSize - 1);
+    chunk_size = std::max(chunk_size, static_cast<size_t>(kCacheLineSize));
+    chunk_count = (size + chunk_size - 1) / chunk_size;
+
+    auto dst = static_cast<uint8_t *>(destination);
+    auto src = static_cast<const uint8_t *>(source);
+    pool.parallel_for(
+      chunk_count,
+      [dst, src, size, chunk_size](size_t chunk) {
+        size_t offset = chunk * chunk_size;
+        stream_copy(dst + offset, src + offset, std::min(chunk_size, size - offset));
+      });
+  }
+
+private:
+  static constexpr size_t kCacheLineSize = 64;
+
+  static void stream_copy(uint8_t * destination, const uint8_t * source, size_t size)
+  {
+#if defined(__SSE2__)
+    // Non-temporal stores need a 16 bytes aligned destination
+    size_t head = (16 - (reinterpret_cast<uintptr_t>(destination) & 15)) & 15;
+    head = std::min(head, size);
+    memcpy(destination, source, head);
+    destination += head;
+    source += head;
+    size -= head;
+
+    for (; size >= 64; size -= 64, source += 64, destination += 64) {
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source));
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + 16));
+      __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + 32));
+      __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + 48));
+      _mm_stream_si128(reinterpret_cast<__m128i *>(destination), a);
+      _mm_stream_si128(reinterpret_cast<__m128i *>(destination + 16), b);
+      _mm_stream_si128(reinterpret_cast<__m128i *>(destination + 32), c);
+      _mm_stream_si128(reinterpret_cast<__m128i *>(destination + 48), d);
+    }
+    // Make the streamed data visible before the copy is reported as done
+    _mm_sfence();
+#endif
+    memcpy(destination, source, size);
+  }
+};
+
+#endif  // STUB_PARALLEL_COPY_HPP_
@@ -1,7 +1,20 @@
 #ifndef STUB_PUBLISHER_HPP_
 #define STUB_PUBLISHER_HPP_
 
-#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "rcutils/logging_macros.h"
+
+#include "rmw_stub_cpp/stub_injector.hpp"
+#include "rmw_stub_cpp/stub_options.hpp"
+#include "rmw_stub_cpp/stub_sample.hpp"
+#include "rmw_stub_cpp/stub_scheduler.hpp"
+#include "rmw_stub_cpp/stub_topic.hpp"
+#include "rmw_stub_cpp/stub_type_support.hpp"
+#include "rmw_stub_cpp/stub_udp_transport.hpp"
 
 class StubPublisher
 {
@@ -14,6 +27,15 @@ public:
     pub_qos_ = qos_policies;
     static uint64_t id = 0;
     pub_id_ = id++;
+    reliable_ = qos_policies->reliability != RMW_QOS_POLICY_RELIABILITY_BEST_EFFORT;
+    // The background writer would make the order of deliveries nondeterministic
+    StubTopicOptions topic_options = StubOptions::get().get_topic_options(topic_name_);
+    async_ = topic_options.async_publish && !StubOptions::get().virtual_time;
+    udp_ = topic_options.transport != StubTopicOptions::Transport::INTRA;
+    topic_hash_ = StubUdpTransport::get_topic_hash(topic_name_);
+    memfd_threshold_ = udp_ ? StubOptions::get().memfd_threshold : 0;
+    history_depth_ = qos_policies->history == RMW_QOS_POLICY_HISTORY_KEEP_ALL ?
+      topic_options.keep_all_max_samples : qos_policies->depth;
   }
 
   void get_qos_policies(rmw_qos_profile_t * qos)
@@ -26,17 +48,151 @@ public:
     return pub_id_;
   }
 
-  const uint64_t * get_pub_id_ptr() const
+  // Reliable publishers wait for full RELIABLE + KEEP_ALL subscriptions
+  bool is_reliable() const
+  {
+    return reliable_;
+  }
+
+  // Asynchronous publishers hand their samples to the background writer
+  bool is_async() const
+  {
+    return async_;
+  }
+
+  // UDP publishers also send their samples to the UDP peers
+  bool is_udp() const
+  {
+    return udp_;
+  }
+
+  uint64_t get_topic_hash() const
+  {
+    return topic_hash_;
+  }
+
+  // Samples kept to be sent again to the UDP peers which missed them
+  size_t get_history_depth() const
+  {
+    return history_depth_;
+  }
+
+  void set_topic(std::shared_ptr<StubTopic> topic)
+  {
+    topic_ = std::move(topic);
+  }
+
+  const std::shared_ptr<StubTopic> & get_topic() const
+  {
+    return topic_;
+  }
+
+  // Null if the type has no C++ introspection type support
+  void set_type_support(StubTypeSupport * type_support)
+  {
+    type_support_ = type_support;
+  }
+
+  StubTypeSupport * get_type_support() const
+  {
+    return type_support_;
+  }
+
+  // Id of the topic in the recording, -1 if it's not recorded
+  void set_record_topic_id(int32_t record_topic_id)
+  {
+    record_topic_id_ = record_topic_id;
+  }
+
+  int32_t get_record_topic_id() const
+  {
+    return record_topic_id_;
+  }
+
+  // Null if the samples are delivered untouched
+  void set_injection(StubInjection * injection)
+  {
+    injection_ = injection;
+  }
+
+  StubInjection * get_injection() const
+  {
+    return injection_;
+  }
+
+  // Allocate the next sample written by this publisher, to be filled
+  // with `size` bytes of serialized data before being published
+  std::shared_ptr<StubSample> create_sample(size_t size)
+  {
+    // Large samples which other processes subscribe to are written once,
+    // into a memfd which those of the host map
+    if (memfd_threshold_ > 0 && size >= memfd_threshold_ &&
+      StubUdpTransport::instance().has_remote_subscribers(topic_hash_))
+    {
+      std::unique_ptr<StubSharedBuffer> buffer = StubSharedBuffer::create(size);
+      if (buffer) {
+        return std::make_shared<StubSample>(
+          std::move(buffer), pub_id_, ++sequence_number_, StubScheduler::instance().now(),
+          topic_->get_memory_account());
+      }
+    }
+    return std::make_shared<StubSample>(
+      size, pub_id_, ++sequence_number_, StubScheduler::instance().now(),
+      topic_->get_memory_account());
+  }
+
+  // Deliver a sample to the local subscriptions from the scheduler, after
+  // `delay`, without blocking: waiting for a full subscription would hold up
+  // every other event meanwhile. Reliable publishers wait_for_room() before
+  // scheduling their samples; one finding a RELIABLE + KEEP_ALL subscription
+  // full of those scheduled before it is dropped rather than overwriting them.
+  void schedule_delivery(std::shared_ptr<const StubSample> sample, std::chrono::nanoseconds delay)
+  {
+    std::shared_ptr<StubTopic> topic = topic_;
+    const bool reliable = reliable_;
+    StubScheduler::instance().schedule_after(
+      delay,
+      [topic, sample, reliable]() {
+        rmw_ret_t ret = topic->publish(sample, reliable, std::chrono::nanoseconds(0));
+        if (RMW_RET_OK != ret) {
+          RCUTILS_LOG_WARN_NAMED(
+            "rmw_stub_cpp", "publish on '%s' dropped a sample: %s",
+            topic->get_topic_name().c_str(), RMW_RET_TIMEOUT == ret ?
+            "full subscription" : "process memory budget exceeded");
+        }
+      });
+  }
+
+  // Wait at most `timeout` for the full RELIABLE + KEEP_ALL subscriptions to
+  // have room for a sample of `size` bytes, before scheduling its delivery.
+  // Returns RMW_RET_TIMEOUT if they don't, at once in virtual time, whose
+  // outcome mustn't depend on how long the other threads take.
+  rmw_ret_t wait_for_room(size_t size, std::chrono::nanoseconds timeout)
   {
-    return &pub_id_;
+    if (!reliable_) {
+      return RMW_RET_OK;
+    }
+    if (StubOptions::get().virtual_time) {
+      timeout = std::chrono::nanoseconds(0);
+    }
+    return topic_->wait_for_room(size, timeout);
   }
 
 private:
   uint64_t pub_id_;
   const rmw_qos_profile_t * pub_qos_;
-  std::mutex mutex_;
-  std::vector<uint64_t> matched_subscriptions_;
   const std::string topic_name_;
+  bool reliable_;
+  bool async_;
+  bool udp_;
+  uint64_t topic_hash_;
+  size_t memfd_threshold_;
+  size_t history_depth_;
+  std::shared_ptr<StubTopic> topic_;
+  StubTypeSupport * type_support_{nullptr};
+  int32_t record_topic_id_{-1};
+  StubInjection * injection_{nullptr};
+  std::atomic<int64_t> sequence_number_{0};
 };
 
 #endif  // STUB_PUBLISHER_HPP_
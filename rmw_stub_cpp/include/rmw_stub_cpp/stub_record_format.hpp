@@ -0,0 +1,67 @@
+#ifndef STUB_RECORD_FORMAT_HPP_
+#define STUB_RECORD_FORMAT_HPP_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Layout of a recording directory:
+// - topics: a text file with one "<topic id> <topic name> <type name>" line
+//   per recorded topic, in the order they were first published
+// - segment_<n>.log: the samples of all the topics, each one a StubRecordHeader
+//   followed by its serialized payload, padded to 8 bytes
+// - index_<topic id>.idx: a StubRecordIndexEntry per sample of a topic,
+//   appended once its record is written: in publish order, but for the
+//   samples of a topic recorded concurrently
+// Integers are written in host byte order.
+
+constexpr char kStubRecordMagic[8] = {'R', 'M', 'W', 'S', 'T', 'U', 'B', '1'};
+
+struct StubSegmentHeader
+{
+  char magic[8];
+  uint32_t segment;
+  uint32_t reserved;
+};
+
+struct StubRecordHeader
+{
+  uint32_t topic_id;
+  uint32_t size;
+  int64_t source_timestamp;
+  uint64_t publisher_id;
+  int64_t sequence_number;
+};
+
+struct StubRecordIndexEntry
+{
+  uint32_t segment;
+  uint32_t size;
+  // Of the payload, after its StubRecordHeader
+  uint64_t offset;
+  int64_t source_timestamp;
+};
+
+inline size_t get_record_size(size_t payload_size)
+{
+  return sizeof(StubRecordHeader) + (payload_size + 7) / 8 * 8;
+}
+
+inline std::string get_segment_path(const std::string & directory, uint32_t segment)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "/segment_%06u.log", segment);
+  return directory + name;
+}
+
+inline std::string get_index_path(const std::string & directory, uint32_t topic_id)
+{
+  return directory + "/index_" + std::to_string(topic_id) + ".idx";
+}
+
+inline std::string get_topics_path(const std::string & directory)
+{
+  return directory + "/topics";
+}
+
+#endif  // STUB_RECORD_FORMAT_HPP_
@@ -0,0 +1,188 @@
+#ifndef STUB_RECORDER_HPP_
+#define STUB_RECORDER_HPP_
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rcutils/logging_macros.h"
+
+#include "rmw_stub_cpp/stub_mapped_file.hpp"
+#include "rmw_stub_cpp/stub_options.hpp"
+#include "rmw_stub_cpp/stub_record_format.hpp"
+#include "rmw_stub_cpp/stub_sample.hpp"
+
+// Appends the samples published on the recorded topics to memory mapped
+// segment files, see stub_record_format.hpp. A record only reserves room
+// for its sample in the current segment with the recorder locked, then
+// copies the sample unlocked, and only then appends its index entry: an
+// entry never points to a record still being written. A segment is closed,
+// and truncated to what was written to it, once the last sample copied to it
+// is done.
+// A directory already holding a recording is never written to.
+class StubRecorder
+{
+public:
+  static StubRecorder & instance()
+  {
+    static StubRecorder recorder;
+    return recorder;
+  }
+
+  // Id given to a topic in the recording, or -1 if it's not recorded
+  int32_t get_topic_id(const std::string & topic_name, const std::string & type_name)
+  {
+    if (directory_.empty() || !StubOptions::get().get_topic_options(topic_name).record) {
+      return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = topic_ids_.find(topic_name);
+    if (it != topic_ids_.end()) {
+      return it->second;
+    }
+
+    auto index = std::make_unique<StubMappedFile>();
+    uint32_t topic_id = static_cast<uint32_t>(indexes_.size());
+    if (!index->create(get_index_path(directory_, topic_id), 64 * sizeof(StubRecordIndexEntry))) {
+      RCUTILS_LOG_ERROR_NAMED(
+        "rmw_stub_cpp", "can't record '%s': %s", topic_name.c_str(), strerror(errno));
+      return -1;
+    }
+    indexes_.push_back(std::move(index));
+    topic_ids_[topic_name] = static_cast<int32_t>(topic_id);
+
+    if (topics_file_) {
+      fprintf(topics_file_, "%u %s %s\n", topic_id, topic_name.c_str(), type_name.c_str());
+      fflush(topics_file_);
+    }
+    return static_cast<int32_t>(topic_id);
+  }
+
+  void record(int32_t topic_id, const StubSample & sample)
+  {
+    if (sample.size() > std::numeric_limits<uint32_t>::max()) {
+      RCUTILS_LOG_ERROR_NAMED(
+        "rmw_stub_cpp", "can't record a sample of %zu bytes of topic %d: over 4 GiB",
+        sample.size(), topic_id);
+      return;
+    }
+    const size_t record_size = get_record_size(sample.size());
+
+    std::shared_ptr<StubMappedFile> segment;
+    uint8_t * record;
+    StubRecordIndexEntry entry;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      if (!segment_ || segment_->size() + record_size > segment_->get_capacity()) {
+        if (!open_segment(record_size)) {
+          return;
+        }
+      }
+      segment = segment_;
+      record = segment->append(record_size);
+
+      entry.segment = segment_count_ - 1;
+      entry.size = static_cast<uint32_t>(sample.size());
+      entry.offset = static_cast<uint64_t>(record - segment->data()) + sizeof(StubRecordHeader);
+      entry.source_timestamp = sample.get_source_timestamp();
+    }
+
+    StubRecordHeader header;
+    header.topic_id = static_cast<uint32_t>(topic_id);
+    header.size = static_cast<uint32_t>(sample.size());
+    header.source_timestamp = sample.get_source_timestamp();
+    header.publisher_id = sample.get_publisher_id();
+    header.sequence_number = sample.get_sequence_number();
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), sample.data(), sample.size());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint8_t * index_entry = indexes_[topic_id]->append(sizeof(entry));
+    if (!index_entry) {
+      // The record is written, but can't be found
+      RCUTILS_LOG_ERROR_NAMED(
+        "rmw_stub_cpp", "can't index a recorded sample of topic %d: %s",
+        topic_id, strerror(errno));
+      return;
+    }
+    memcpy(index_entry, &entry, sizeof(entry));
+  }
+
+private:
+  StubRecorder()
+  {
+    const std::string & directory = StubOptions::get().record_directory;
+    if (directory.empty()) {
+      return;
+    }
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+      RCUTILS_LOG_ERROR_NAMED(
+        "rmw_stub_cpp", "can't create the recording directory '%s': %s",
+        directory.c_str(), strerror(errno));
+      return;
+    }
+    // Fails if the directory holds a recording already
+    topics_file_ = fopen(get_topics_path(directory).c_str(), "wxe");
+    if (!topics_file_) {
+      RCUTILS_LOG_ERROR_NAMED(
+        "rmw_stub_cpp", "can't record to '%s': %s", directory.c_str(),
+        errno == EEXIST ? "it holds a recording already" : strerror(errno));
+      return;
+    }
+    directory_ = directory;
+  }
+
+  ~StubRecorder()
+  {
+    if (topics_file_) {
+      fclose(topics_file_);
+    }
+  }
+
+  // Start a new segment with room for at least a record of `record_size`
+  bool open_segment(size_t record_size)
+  {
+    size_t capacity = std::max(
+      StubOptions::get().record_segment_size, sizeof(StubSegmentHeader) + record_size);
+
+    auto segment = std::make_shared<StubMappedFile>();
+    if (!segment->create(get_segment_path(directory_, segment_count_), capacity)) {
+      RCUTILS_LOG_ERROR_NAMED(
+        "rmw_stub_cpp", "can't create a recording segment: %s", strerror(errno));
+      return false;
+    }
+
+    StubSegmentHeader header;
+    memcpy(header.magic, kStubRecordMagic, sizeof(header.magic));
+    header.segment = segment_count_++;
+    header.reserved = 0;
+    memcpy(segment->append(sizeof(header)), &header, sizeof(header));
+
+    segment_ = std::move(segment);
+    return true;
+  }
+
+  std::mutex mutex_;
+  // Empty if not recording
+  std::string directory_;
+  FILE * topics_file_{nullptr};
+  std::unordered_map<std::string, int32_t> topic_ids_;
+  // Indexed by topic id
+  std::vector<std::unique_ptr<StubMappedFile>> indexes_;
+  std::shared_ptr<StubMappedFile> segment_;
+  uint32_t segment_count_{0};
+};
+
+#endif  // STUB_RECORDER_HPP_
@@ -0,0 +1,216 @@
+#ifndef STUB_REPLAYER_HPP_
+#define STUB_REPLAYER_HPP_
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "rcutils/logging_macros.h"
+#include "rmw/types.h"
+
+#include "rmw_stub_cpp/stub_mapped_file.hpp"
+#include "rmw_stub_cpp/stub_record_format.hpp"
+#include "rmw_stub_cpp/stub_sample.hpp"
+#include "rmw_stub_cpp/stub_topic.hpp"
+
+// Publishes the samples of a recording directory written by StubRecorder
+// again, in the order they were recorded. The indexes of the replayed topics
+// are merged by position in the segments, which are read through their
+// mapping: the pages ahead of the next sample are prefetched with
+// madvise(MADV_WILLNEED), so that the replay doesn't wait for the disk.
+class StubReplayer
+{
+public:
+  // Bytes of a segment prefetched ahead of the sample being replayed
+  static constexpr size_t kLookahead = 4 * 1024 * 1024;
+
+  // `rate` scales the recorded timing, 0 for no waiting at all.
+  // Replays all the topics if `topic_names` is empty.
+  StubReplayer(std::string directory, double rate, const std::vector<std::string> & topic_names)
+  : directory_(std::move(directory)),
+    rate_(rate)
+  {
+    std::ifstream topics_file(get_topics_path(directory_));
+    std::string line;
+    while (std::getline(topics_file, line)) {
+      std::istringstream fields(line);
+      uint32_t topic_id;
+      std::string topic_name;
+      if (!(fields >> topic_id >> topic_name)) {
+        continue;
+      }
+      if (!topic_names.empty() &&
+        std::find(topic_names.begin(), topic_names.end(), topic_name) == topic_names.end())
+      {
+        continue;
+      }
+
+      auto topic = std::make_unique<Topic>();
+      if (!topic->index.open(get_index_path(directory_, topic_id))) {
+        continue;
+      }
+      topic->topic = StubTopicRegistry::instance().get_topic(topic_name);
+      topics_.push_back(std::move(topic));
+    }
+  }
+
+  // Whether the recording has topics to replay
+  bool is_valid() const
+  {
+    return !topics_.empty();
+  }
+
+  // Returns the number of samples replayed
+  size_t replay()
+  {
+    std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>> cursors;
+    for (auto & topic : topics_) {
+      push_cursor(cursors, topic.get(), 0);
+    }
+
+    size_t replayed = 0;
+    bool started = false;
+    rmw_time_point_value_t first_timestamp = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    while (!cursors.empty()) {
+      Cursor cursor = cursors.top();
+      cursors.pop();
+      push_cursor(cursors, cursor.topic, cursor.position + 1);
+
+      const StubRecordIndexEntry & entry = cursor.entry;
+      const uint8_t * payload = get_payload(entry);
+      if (!payload) {
+        continue;
+      }
+
+      if (rate_ > 0) {
+        if (!started) {
+          first_timestamp = entry.source_timestamp;
+          started = true;
+        }
+        auto offset = std::chrono::nanoseconds(
+          static_cast<int64_t>((entry.source_timestamp - first_timestamp) / rate_));
+        std::this_thread::sleep_until(start + offset);
+      }
+
+      publish(cursor.topic->topic, entry, payload);
+      replayed++;
+    }
+
+    return replayed;
+  }
+
+private:
+  struct Topic
+  {
+    std::shared_ptr<StubTopic> topic;
+    StubMappedFile index;
+  };
+
+  // Next sample of a topic, ordered by position in the recording
+  struct Cursor
+  {
+    StubRecordIndexEntry entry;
+    Topic * topic;
+    size_t position;
+
+    bool operator>(const Cursor & other) const
+    {
+      return entry.segment > other.entry.segment ||
+             (entry.segment == other.entry.segment && entry.offset > other.entry.offset);
+    }
+  };
+
+  template<typename Queue>
+  static void push_cursor(Queue & cursors, Topic * topic, size_t position)
+  {
+    if ((position + 1) * sizeof(StubRecordIndexEntry) > topic->index.size()) {
+      return;
+    }
+    Cursor cursor;
+    memcpy(
+      &cursor.entry, topic->index.data() + position * sizeof(StubRecordIndexEntry),
+      sizeof(cursor.entry));
+    // Entries past the end of an index not truncated by its recorder are zeros
+    if (cursor.entry.offset == 0) {
+      return;
+    }
+    cursor.topic = topic;
+    cursor.position = position;
+    cursors.push(cursor);
+  }
+
+  // Map the segment of an entry, and return its payload or null if it's
+  // not in the segment
+  const uint8_t * get_payload(const StubRecordIndexEntry & entry)
+  {
+    if (!segment_.is_open() || entry.segment != segment_number_) {
+      segment_.close();
+      segment_number_ = entry.segment;
+      if (!segment_.open(get_segment_path(directory_, entry.segment))) {
+        RCUTILS_LOG_WARN_NAMED(
+          "rmw_stub_cpp", "replay: missing segment %u", entry.segment);
+        return nullptr;
+      }
+      segment_.advise(0, segment_.size(), MADV_SEQUENTIAL);
+      prefetched_ = 0;
+    }
+    if (entry.offset + entry.size > segment_.size()) {
+      return nullptr;
+    }
+
+    // Keep the next kLookahead bytes prefetched, half of it at a time
+    size_t end = entry.offset + entry.size;
+    if (end + kLookahead / 2 > prefetched_) {
+      size_t begin = std::max(prefetched_, static_cast<size_t>(entry.offset));
+      prefetched_ = end + kLookahead;
+      segment_.advise(begin, prefetched_ - begin, MADV_WILLNEED);
+    }
+
+    return segment_.data() + entry.offset;
+  }
+
+  static void publish(
+    const std::shared_ptr<StubTopic> & topic, const StubRecordIndexEntry & entry,
+    const uint8_t * payload)
+  {
+    StubRecordHeader header;
+    memcpy(&header, payload - sizeof(header), sizeof(header));
+
+    auto sample = std::make_shared<StubSample>(
+      entry.size, header.publisher_id, header.sequence_number, header.source_timestamp,
+      topic->get_memory_account());
+    memcpy(sample->data(), payload, entry.size);
+
+    // RELIABLE + KEEP_ALL subscriptions slow the replay down, up to the
+    // publish timeout
+    rmw_ret_t ret = topic->publish(std::move(sample), true);
+    if (RMW_RET_OK != ret) {
+      RCUTILS_LOG_WARN_NAMED(
+        "rmw_stub_cpp", "replay on '%s' dropped a sample: %s",
+        topic->get_topic_name().c_str(),
+        RMW_RET_TIMEOUT == ret ? "timed out" : "process memory budget exceeded");
+    }
+  }
+
+  const std::string directory_;
+  const double rate_;
+  std::vector<std::unique_ptr<Topic>> topics_;
+  StubMappedFile segment_;
+  uint32_t segment_number_{0};
+  // End of the range of the segment prefetched so far
+  size_t prefetched_{0};
+};
+
+#endif  // STUB_REPLAYER_HPP_
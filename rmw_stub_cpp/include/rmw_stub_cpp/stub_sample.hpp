@@ -0,0 +1,128 @@
+#ifndef STUB_SAMPLE_HPP_
+#define STUB_SAMPLE_HPP_
+
+#include <cstdint>
+#include <memory>
+
+#include "rmw/types.h"
+
+#include "rmw_stub_cpp/stub_gid.hpp"
+#include "rmw_stub_cpp/stub_memory_account.hpp"
+#include "rmw_stub_cpp/stub_shared_buffer.hpp"
+
+// A serialized message as written by a publisher. Samples are immutable once
+// published and shared by every subscription reading them.
+class StubSample
+{
+public:
+  StubSample(
+    size_t size,
+    uint64_t publisher_id,
+    int64_t sequence_number,
+    rmw_time_point_value_t source_timestamp,
+    std::shared_ptr<StubMemoryAccount> memory_account)
+  : heap_data_(new uint8_t[size]),
+    data_(heap_data_.get()),
+    size_(size),
+    publisher_id_(publisher_id),
+    sequence_number_(sequence_number),
+    source_timestamp_(source_timestamp),
+    memory_account_(std::move(memory_account))
+  {
+    memory_account_->charge(size_);
+  }
+
+  // A sample whose payload is in a buffer shared with other processes
+  StubSample(
+    std::unique_ptr<StubSharedBuffer> shared_buffer,
+    uint64_t publisher_id,
+    int64_t sequence_number,
+    rmw_time_point_value_t source_timestamp,
+    std::shared_ptr<StubMemoryAccount> memory_account)
+  : shared_buffer_(std::move(shared_buffer)),
+    data_(shared_buffer_->data()),
+    size_(shared_buffer_->size()),
+    publisher_id_(publisher_id),
+    sequence_number_(sequence_number),
+    source_timestamp_(source_timestamp),
+    memory_account_(std::move(memory_account))
+  {
+    memory_account_->charge(size_);
+  }
+
+  ~StubSample()
+  {
+    memory_account_->refund(size_);
+  }
+
+  StubSample(const StubSample &) = delete;
+  StubSample & operator=(const StubSample &) = delete;
+
+  // Only the publisher writes the payload, before the sample is published
+  uint8_t * data()
+  {
+    return data_;
+  }
+
+  const uint8_t * data() const
+  {
+    return data_;
+  }
+
+  size_t size() const
+  {
+    return size_;
+  }
+
+  uint64_t get_publisher_id() const
+  {
+    return publisher_id_;
+  }
+
+  // Of the publisher: set by the transports receiving samples from other
+  // processes, before publishing them
+  void set_process_id(uint64_t process_id)
+  {
+    process_id_ = process_id;
+  }
+
+  uint64_t get_process_id() const
+  {
+    return process_id_;
+  }
+
+  int64_t get_sequence_number() const
+  {
+    return sequence_number_;
+  }
+
+  rmw_time_point_value_t get_source_timestamp() const
+  {
+    return source_timestamp_;
+  }
+
+  // Null if the payload is on the heap of the process
+  const StubSharedBuffer * get_shared_buffer() const
+  {
+    return shared_buffer_.get();
+  }
+
+  // Only the publisher seals the buffer, once the payload is written
+  StubSharedBuffer * get_shared_buffer()
+  {
+    return shared_buffer_.get();
+  }
+
+private:
+  std::unique_ptr<uint8_t[]> heap_data_;
+  std::unique_ptr<StubSharedBuffer> shared_buffer_;
+  uint8_t * data_;
+  size_t size_;
+  uint64_t publisher_id_;
+  uint64_t process_id_{::get_process_id()};
+  int64_t sequence_number_;
+  rmw_time_point_value_t source_timestamp_;
+  std::shared_ptr<StubMemoryAccount> memory_account_;
+};
+
+#endif  // STUB_SAMPLE_HPP_
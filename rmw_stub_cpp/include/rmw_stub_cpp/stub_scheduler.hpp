@@ -0,0 +1,185 @@
+#ifndef STUB_SCHEDULER_HPP_
+#define STUB_SCHEDULER_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "rcutils/time.h"
+#include "rmw/types.h"
+
+#include "rmw_stub_cpp/stub_options.hpp"
+
+// Runs callbacks at their deadline. Events are kept in a min-heap ordered by
+// deadline then scheduling order, and can't be cancelled: callbacks check
+// whether they still have something to do when they run.
+// In real time, a background thread sleeps until the earliest deadline.
+// In virtual time (RMW_STUB_VIRTUAL_TIME), there's no thread: the clock
+// starts at 0 and only moves forward when advance() is called, which runs
+// the events due in its own thread, one at a time and always in the same
+// order. Deliveries of samples, requests and responses are then events too,
+// so that they reach their listeners in a reproducible order.
+class StubScheduler
+{
+public:
+  static StubScheduler & instance()
+  {
+    static StubScheduler scheduler;
+    return scheduler;
+  }
+
+  bool is_virtual() const
+  {
+    return virtual_;
+  }
+
+  // Current time, as the timestamps of messages
+  rmw_time_point_value_t now()
+  {
+    if (virtual_) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return virtual_now_;
+    }
+    rcutils_time_point_value_t now = 0;
+    rcutils_system_time_now(&now);
+    return now;
+  }
+
+  void schedule_after(std::chrono::nanoseconds delay, std::function<void()> callback)
+  {
+    bool is_earliest;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      int64_t deadline = get_time_locked() + delay.count();
+      is_earliest = events_.empty() || deadline < events_.top().deadline;
+      events_.push({deadline, sequence_++, std::move(callback)});
+
+      if (!virtual_ && !thread_.joinable()) {
+        thread_ = std::thread(&StubScheduler::run, this);
+      }
+    }
+    // Only wake the thread up if it sleeps until a later deadline
+    if (is_earliest && !virtual_) {
+      cv_.notify_one();
+    }
+  }
+
+  // Virtual time only: move the clock forward by `duration`, running the
+  // events due meanwhile, including the ones they schedule.
+  // Returns the number of events run.
+  size_t advance(std::chrono::nanoseconds duration)
+  {
+    std::lock_guard<std::mutex> advance_lock(advance_mutex_);
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    const int64_t target = virtual_now_ + std::max<int64_t>(duration.count(), 0);
+    size_t count = 0;
+    while (!events_.empty() && events_.top().deadline <= target) {
+      virtual_now_ = std::max(virtual_now_, events_.top().deadline);
+      std::function<void()> callback = pop_event();
+
+      lock.unlock();
+      callback();
+      count++;
+      lock.lock();
+    }
+    virtual_now_ = target;
+    return count;
+  }
+
+private:
+  struct Event
+  {
+    int64_t deadline;
+    // Keeps events with the same deadline in scheduling order
+    uint64_t sequence;
+    std::function<void()> callback;
+
+    bool operator>(const Event & other) const
+    {
+      return deadline > other.deadline ||
+             (deadline == other.deadline && sequence > other.sequence);
+    }
+  };
+
+  StubScheduler()
+  : virtual_(StubOptions::get().virtual_time)
+  {
+  }
+
+  ~StubScheduler()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  // Steady clock time, or virtual time
+  int64_t get_time_locked() const
+  {
+    if (virtual_) {
+      return virtual_now_;
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  std::function<void()> pop_event()
+  {
+    std::function<void()> callback = std::move(const_cast<Event &>(events_.top()).callback);
+    events_.pop();
+    return callback;
+  }
+
+  void run()
+  {
+    StubOptions::get().set_thread_affinity();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (!stop_) {
+      if (events_.empty()) {
+        cv_.wait(lock);
+        continue;
+      }
+
+      int64_t now = get_time_locked();
+      if (now < events_.top().deadline) {
+        cv_.wait_for(lock, std::chrono::nanoseconds(events_.top().deadline - now));
+        continue;
+      }
+
+      std::function<void()> callback = pop_event();
+
+      // Callbacks may schedule events
+      lock.unlock();
+      callback();
+      lock.lock();
+    }
+  }
+
+  const bool virtual_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events_;
+  uint64_t sequence_{0};
+  int64_t virtual_now_{0};
+  // Serializes the threads advancing virtual time
+  std::mutex advance_mutex_;
+  bool stop_{false};
+  std::thread thread_;
+};
+
+#endif  // STUB_SCHEDULER_HPP_
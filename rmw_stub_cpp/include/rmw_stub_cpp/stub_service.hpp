@@ -1,19 +1,141 @@
 #ifndef STUB_SERVICE_HPP_
 #define STUB_SERVICE_HPP_
 
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "rmw/event_callback_type.h"
+#include "rmw/types.h"
+#include "rosidl_typesupport_introspection_cpp/service_introspection.hpp"
+
+#include "rmw_stub_cpp/stub_service_message.hpp"
+
+// Most services (e.g. the parameter services of every node) never get a
+// request: a service is a single allocation, holding its rmw handle, until
+// a request arrives
 class StubService
 {
 public:
-  StubService() = default;
+  using ServiceMembers = rosidl_typesupport_introspection_cpp::ServiceMembers;
+
+  StubService(
+    const char * service_name,
+    const ServiceMembers * members,
+    const char * implementation_identifier)
+  : service_name_(service_name), members_(members)
+  {
+    handle_.implementation_identifier = implementation_identifier;
+    handle_.data = this;
+    handle_.service_name = service_name_.c_str();
+  }
+
+  StubService(const StubService &) = delete;
+  StubService & operator=(const StubService &) = delete;
+
+  rmw_service_t * get_handle()
+  {
+    return &handle_;
+  }
+
+  const std::string & get_service_name() const
+  {
+    return service_name_;
+  }
+
+  // Null if the type has no C++ introspection type support
+  const ServiceMembers * get_members() const
+  {
+    return members_;
+  }
+
+  // Called by the registry for each request sent to this service
+  void push_request(StubServiceMessage request)
+  {
+    {
+      std::lock_guard<std::mutex> lock(requests_mutex_);
+      if (!requests_) {
+        requests_.reset(new std::deque<StubServiceMessage>());
+      }
+      requests_->push_back(std::move(request));
+    }
+    notify();
+  }
+
+  // Requests not taken yet
+  size_t get_queued_requests()
+  {
+    std::lock_guard<std::mutex> lock(requests_mutex_);
+    return requests_ ? requests_->size() : 0;
+  }
+
+  bool take_request(StubServiceMessage & request)
+  {
+    std::lock_guard<std::mutex> lock(requests_mutex_);
+    if (!requests_ || requests_->empty()) {
+      return false;
+    }
+    request = std::move(requests_->front());
+    requests_->pop_front();
+    return true;
+  }
+
+  void
+  notify()
+  {
+    std::unique_lock<std::mutex> lock_mutex(listener_callback_mutex_);
+
+    if(listener_callback_) {
+      listener_callback_(user_data_, 1);
+    } else {
+      unread_count_++;
+    }
+  }
 
   void
   set_callback(
     rmw_event_callback_t callback,
     const void * user_data)
   {
-    (void)callback;
-    (void)user_data;
+    std::unique_lock<std::mutex> lock_mutex(listener_callback_mutex_);
+
+    user_data_ = user_data;
+    listener_callback_ = callback;
+
+    if(callback) {
+      // Push events arrived before setting the executor's callback
+      if (unread_count_) {
+        callback(user_data, unread_count_);
+      }
+      // Reset unread count
+      unread_count_ = 0;
+    }
   }
+
+private:
+  friend class StubServiceRegistry;
+
+  const std::string service_name_;
+  const ServiceMembers * members_;
+  rmw_service_t handle_;
+
+  std::mutex requests_mutex_;
+  // Allocated with the first request
+  std::unique_ptr<std::deque<StubServiceMessage>> requests_;
+
+  // Services no client has looked for yet are only linked in a list by
+  // the registry, and added to its index when a client of theirs appears
+  StubService * pending_previous_{nullptr};
+  StubService * pending_next_{nullptr};
+  bool is_pending_{false};
+
+  // Events executor
+  rmw_event_callback_t listener_callback_{nullptr};
+  const void * user_data_{nullptr};
+  std::mutex listener_callback_mutex_;
+  uint64_t unread_count_ = 0;
 };
 
 #endif  // STUB_SERVICE_HPP_
@@ -0,0 +1,17 @@
+#ifndef STUB_SERVICE_MESSAGE_HPP_
+#define STUB_SERVICE_MESSAGE_HPP_
+
+#include <memory>
+
+#include "rmw/types.h"
+
+// A request or response handed from a client to a service or back. The
+// message is a typed copy, shared by every server receiving the request.
+struct StubServiceMessage
+{
+  std::shared_ptr<void> message;
+  rmw_request_id_t request_id;
+  rmw_time_point_value_t source_timestamp;
+};
+
+#endif  // STUB_SERVICE_MESSAGE_HPP_
@@ -0,0 +1,294 @@
+#ifndef STUB_SERVICE_REGISTRY_HPP_
+#define STUB_SERVICE_REGISTRY_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rmw_stub_cpp/service_dispatch.hpp"
+#include "rmw_stub_cpp/stub_client.hpp"
+#include "rmw_stub_cpp/stub_futex.hpp"
+#include "rmw_stub_cpp/stub_guard_condition.hpp"
+#include "rmw_stub_cpp/stub_service.hpp"
+#include "rmw_stub_cpp/stub_service_message.hpp"
+
+// Clients and services of the process. Requests are routed to the services
+// by name, according to the dispatch of that name, and responses back to
+// their client by the request's writer guid.
+// Requests and responses are pushed with the registry locked, so that
+// a client or service can't be destroyed while receiving one.
+// Services are only indexed by name once they have a client: until then,
+// they are kept in a list at no allocation cost.
+class StubServiceRegistry
+{
+public:
+  static StubServiceRegistry & instance()
+  {
+    static StubServiceRegistry registry;
+    return registry;
+  }
+
+  void add_service(StubService * service)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (client_names_.count(service->get_service_name()) > 0) {
+      index_service(service);
+      return;
+    }
+
+    // Nobody can send requests to this service until a client of it is created
+    service->is_pending_ = true;
+    service->pending_previous_ = nullptr;
+    service->pending_next_ = pending_services_;
+    if (pending_services_) {
+      pending_services_->pending_previous_ = service;
+    }
+    pending_services_ = service;
+  }
+
+  void remove_service(StubService * service)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (service->is_pending_) {
+      unlink_pending_service(service);
+      return;
+    }
+
+    auto it = services_.find(service->get_service_name());
+    if (it == services_.end()) {
+      return;
+    }
+    auto & servers = it->second.servers;
+    servers.erase(std::remove(servers.begin(), servers.end(), service), servers.end());
+    if (servers.empty()) {
+      services_.erase(it);
+      notify_availability_changed();
+    }
+  }
+
+  // Number of servers of a service name
+  size_t get_server_count(const std::string & service_name)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = services_.find(service_name);
+    return it != services_.end() ? it->second.servers.size() : 0;
+  }
+
+  // Block until a service has a server, or the timeout expires.
+  // Returns whether there's a server.
+  bool wait_for_server(const std::string & service_name, std::chrono::nanoseconds timeout)
+  {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (true) {
+      uint32_t availability_count = availability_futex_.value();
+      if (get_server_count(service_name) > 0) {
+        return true;
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      if (now >= deadline) {
+        return false;
+      }
+      availability_futex_.wait(availability_count, deadline - now);
+    }
+  }
+
+  // Graph guard conditions of the nodes, triggered when a service name
+  // gets its first server or loses its last one
+  void add_graph_guard_condition(StubGuardCondition * guard_condition)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    graph_guard_conditions_.push_back(guard_condition);
+  }
+
+  void remove_graph_guard_condition(StubGuardCondition * guard_condition)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    graph_guard_conditions_.erase(
+      std::remove(graph_guard_conditions_.begin(), graph_guard_conditions_.end(), guard_condition),
+      graph_guard_conditions_.end());
+  }
+
+  void add_client(StubClient * client)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    clients_[client->get_client_id()] = client;
+
+    // Index the services of the first client of a service name
+    if (client_names_[client->get_service_name()]++ == 0) {
+      StubService * service = pending_services_;
+      while (service) {
+        StubService * next = service->pending_next_;
+        if (service->get_service_name() == client->get_service_name()) {
+          unlink_pending_service(service);
+          index_service(service);
+        }
+        service = next;
+      }
+    }
+  }
+
+  void remove_client(StubClient * client)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    clients_.erase(client->get_client_id());
+
+    // Indexed services stay indexed
+    auto it = client_names_.find(client->get_service_name());
+    if (it != client_names_.end() && --it->second == 0) {
+      client_names_.erase(it);
+    }
+  }
+
+  // Deliver a request to one or all of the servers of this name.
+  // Returns false if there's none.
+  bool send_request(const std::string & service_name, const StubServiceMessage & request)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = services_.find(service_name);
+    if (it == services_.end()) {
+      return false;
+    }
+
+    std::vector<StubService *> & servers = it->second.servers;
+    switch (get_dispatch_locked(service_name)) {
+      case rmw_stub_cpp::ServiceDispatch::ROUND_ROBIN:
+        servers[it->second.next_server++ % servers.size()]->push_request(request);
+        break;
+      case rmw_stub_cpp::ServiceDispatch::LEAST_QUEUED:
+        {
+          StubService * least_queued = servers.front();
+          size_t least_queued_requests = least_queued->get_queued_requests();
+          for (size_t i = 1; i < servers.size() && least_queued_requests > 0; i++) {
+            size_t queued_requests = servers[i]->get_queued_requests();
+            if (queued_requests < least_queued_requests) {
+              least_queued = servers[i];
+              least_queued_requests = queued_requests;
+            }
+          }
+          least_queued->push_request(request);
+          break;
+        }
+      default:
+        for (StubService * service : servers) {
+          service->push_request(request);
+        }
+        break;
+    }
+    return true;
+  }
+
+  void set_dispatch(const std::string & service_name, rmw_stub_cpp::ServiceDispatch dispatch)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dispatches_[service_name] = dispatch;
+  }
+
+  rmw_stub_cpp::ServiceDispatch get_dispatch(const std::string & service_name)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return get_dispatch_locked(service_name);
+  }
+
+  // Expire a request of a client, if it still exists
+  void expire_request(uint64_t client_id, int64_t sequence_number)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = clients_.find(client_id);
+    if (it != clients_.end()) {
+      it->second->expire_request(sequence_number);
+    }
+  }
+
+  // Deliver a response to the client which sent the request.
+  // Returns false if the client is gone.
+  bool send_response(const StubServiceMessage & response)
+  {
+    uint64_t client_id;
+    memcpy(&client_id, response.request_id.writer_guid, sizeof(client_id));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = clients_.find(client_id);
+    if (it == clients_.end()) {
+      return false;
+    }
+    it->second->push_response(response);
+    return true;
+  }
+
+private:
+  // The servers of a service name
+  struct ServiceEntry
+  {
+    std::vector<StubService *> servers;
+    // Round robin position
+    size_t next_server{0};
+  };
+
+  StubServiceRegistry() = default;
+
+  void index_service(StubService * service)
+  {
+    auto & servers = services_[service->get_service_name()].servers;
+    servers.push_back(service);
+    if (servers.size() == 1) {
+      notify_availability_changed();
+    }
+  }
+
+  void unlink_pending_service(StubService * service)
+  {
+    if (service->pending_previous_) {
+      service->pending_previous_->pending_next_ = service->pending_next_;
+    } else {
+      pending_services_ = service->pending_next_;
+    }
+    if (service->pending_next_) {
+      service->pending_next_->pending_previous_ = service->pending_previous_;
+    }
+    service->pending_previous_ = nullptr;
+    service->pending_next_ = nullptr;
+    service->is_pending_ = false;
+  }
+
+  void notify_availability_changed()
+  {
+    availability_futex_.wake_all();
+    for (StubGuardCondition * guard_condition : graph_guard_conditions_) {
+      guard_condition->trigger();
+    }
+  }
+
+  rmw_stub_cpp::ServiceDispatch get_dispatch_locked(const std::string & service_name) const
+  {
+    auto it = dispatches_.find(service_name);
+    return it != dispatches_.end() ? it->second : rmw_stub_cpp::ServiceDispatch::BROADCAST;
+  }
+
+  std::mutex mutex_;
+  // Services some client may send requests to
+  std::unordered_map<std::string, ServiceEntry> services_;
+  // Other services, which can't have requests yet
+  StubService * pending_services_{nullptr};
+  // Number of clients of each service name
+  std::unordered_map<std::string, size_t> client_names_;
+  // Set by rmw_stub_cpp::set_service_dispatch(), even before the service exists
+  std::unordered_map<std::string, rmw_stub_cpp::ServiceDispatch> dispatches_;
+  std::unordered_map<uint64_t, StubClient *> clients_;
+  std::vector<StubGuardCondition *> graph_guard_conditions_;
+  // Bumped each time a service name gets or loses all its servers
+  StubFutex availability_futex_;
+};
+
+#endif  // STUB_SERVICE_REGISTRY_HPP_
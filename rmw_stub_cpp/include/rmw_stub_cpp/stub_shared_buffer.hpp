@@ -0,0 +1,127 @@
+#ifndef STUB_SHARED_BUFFER_HPP_
+#define STUB_SHARED_BUFFER_HPP_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+// The payload of a sample in a memfd, which other processes of the host
+// map from its fd: either created and written by the publisher's process,
+// or mapped read only by a subscriber's. The size of the memfd is sealed,
+// so that no process can fault the others by shrinking it, and once written
+// its content is sealed too, so that no subscriber can map it writable.
+class StubSharedBuffer
+{
+public:
+  ~StubSharedBuffer()
+  {
+    ::munmap(data_, size_);
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  StubSharedBuffer(const StubSharedBuffer &) = delete;
+  StubSharedBuffer & operator=(const StubSharedBuffer &) = delete;
+
+  // Null if memfds are unavailable
+  static std::unique_ptr<StubSharedBuffer> create(size_t size)
+  {
+    if (size == 0) {
+      return nullptr;
+    }
+    int fd = ::memfd_create("rmw_stub_cpp", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+      return nullptr;
+    }
+    if (::ftruncate(fd, static_cast<off_t>(size)) != 0 ||
+      ::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) != 0)
+    {
+      ::close(fd);
+      return nullptr;
+    }
+    void * data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      ::close(fd);
+      return nullptr;
+    }
+    return std::unique_ptr<StubSharedBuffer>(
+      new StubSharedBuffer(static_cast<uint8_t *>(data), size, fd));
+  }
+
+  // Once written: the mapping of this process stays writable, but no other
+  // can be. Returns false if the kernel can't seal it (before Linux 5.1).
+  bool seal()
+  {
+    if (!sealed_ && fd_ >= 0) {
+      sealed_ = ::fcntl(fd_, F_ADD_SEALS, F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) == 0;
+    }
+    return sealed_;
+  }
+
+  bool is_sealed() const
+  {
+    return sealed_;
+  }
+
+  // Map the buffer of another process, taking its fd. Null if it isn't
+  // sealed to at least `size` bytes and against writes.
+  static std::unique_ptr<StubSharedBuffer> map(int fd, size_t size)
+  {
+    struct stat status;
+    const int seals = ::fcntl(fd, F_GET_SEALS);
+    if (size == 0 || seals < 0 || !(seals & F_SEAL_SHRINK) ||
+      !(seals & (F_SEAL_WRITE | F_SEAL_FUTURE_WRITE)) || ::fstat(fd, &status) != 0 ||
+      static_cast<size_t>(status.st_size) < size)
+    {
+      ::close(fd);
+      return nullptr;
+    }
+    void * data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      return nullptr;
+    }
+    return std::unique_ptr<StubSharedBuffer>(
+      new StubSharedBuffer(static_cast<uint8_t *>(data), size, -1));
+  }
+
+  // Only written if created by this process
+  uint8_t * data() const
+  {
+    return data_;
+  }
+
+  size_t size() const
+  {
+    return size_;
+  }
+
+  // -1 once mapped by a subscriber's process
+  int get_fd() const
+  {
+    return fd_;
+  }
+
+private:
+  StubSharedBuffer(uint8_t * data, size_t size, int fd)
+  : data_(data), size_(size), fd_(fd)
+  {
+  }
+
+  uint8_t * data_;
+  size_t size_;
+  int fd_;
+  bool sealed_{false};
+};
+
+#endif  // STUB_SHARED_BUFFER_HPP_
@@ -0,0 +1,83 @@
+#ifndef STUB_SPSC_QUEUE_HPP_
+#define STUB_SPSC_QUEUE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue with a single producer and a single consumer
+template<typename T>
+class StubSpscQueue
+{
+public:
+  explicit StubSpscQueue(size_t capacity)
+  {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    slots_.resize(size);
+    mask_ = size - 1;
+  }
+
+  // Returns false if the queue is full, in which case `item` is left untouched
+  bool push(T & item)
+  {
+    size_t tail = tail_.value.load(std::memory_order_relaxed);
+    if (tail - head_.value.load(std::memory_order_acquire) == slots_.size()) {
+      return false;
+    }
+
+    slots_[tail & mask_] = std::move(item);
+    tail_.value.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Returns false if the queue is empty
+  bool pop(T & item)
+  {
+    size_t head = head_.value.load(std::memory_order_relaxed);
+    if (head == tail_.value.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    item = std::move(slots_[head & mask_]);
+    head_.value.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate unless called by the producer or the consumer
+  size_t size() const
+  {
+    return tail_.value.load(std::memory_order_acquire) -
+           head_.value.load(std::memory_order_acquire);
+  }
+
+  size_t capacity() const
+  {
+    return slots_.size();
+  }
+
+  bool empty() const
+  {
+    return head_.value.load(std::memory_order_acquire) ==
+           tail_.value.load(std::memory_order_acquire);
+  }
+
+private:
+  static constexpr size_t kCacheLineSize = 64;
+
+  // Keeps the consumer and producer indices on separate cache lines
+  struct PaddedIndex
+  {
+    std::atomic<size_t> value{0};
+    char padding[kCacheLineSize - sizeof(std::atomic<size_t>)];
+  };
+
+  std::vector<T> slots_;
+  size_t mask_;
+  PaddedIndex head_;
+  PaddedIndex tail_;
+};
+
+#endif  // STUB_SPSC_QUEUE_HPP_
@@ -1,6 +1,20 @@
 #ifndef STUB_SUBSCRIPTION_HPP_
 #define STUB_SUBSCRIPTION_HPP_
 
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "rmw/event_callback_type.h"
+#include "rmw/types.h"
+
+#include "rmw_stub_cpp/stub_mailbox.hpp"
+#include "rmw_stub_cpp/stub_options.hpp"
+#include "rmw_stub_cpp/stub_type_support.hpp"
+
+class StubTopic;
+
 class StubSubscription
 {
 public:
@@ -12,6 +26,25 @@ public:
     sub_qos_ = qos_policies;
     static uint64_t id = 0;
     sub_id_ = id++;
+    depth_ = qos_policies->depth > 0 ? qos_policies->depth : 1;
+
+    StubTopicOptions topic_options = StubOptions::get().get_topic_options(topic_name_);
+    udp_ = topic_options.transport != StubTopicOptions::Transport::INTRA;
+    if (qos_policies->history == RMW_QOS_POLICY_HISTORY_KEEP_ALL) {
+      depth_ = topic_options.keep_all_max_samples;
+      max_bytes_ = topic_options.keep_all_max_bytes;
+      // Reliable publishers wait for these subscriptions rather than overwriting
+      blocks_publishers_ = qos_policies->reliability == RMW_QOS_POLICY_RELIABILITY_RELIABLE;
+    }
+
+    // State topics only care about the newest sample: skip the topic's ring
+    using Queue = StubTopicOptions::Queue;
+    if (qos_policies->history != RMW_QOS_POLICY_HISTORY_KEEP_ALL &&
+      topic_options.queue != Queue::RING &&
+      (depth_ == 1 || topic_options.queue == Queue::MAILBOX))
+    {
+      mailbox_.reset(new StubLatestValueMailbox());
+    }
   }
 
   void get_qos_policies(rmw_qos_profile_t * qos)
@@ -19,13 +52,39 @@ public:
     *qos = *sub_qos_;
   }
 
+  // Called by the topic each time a sample is written for this subscription
+  void
+  notify()
+  {
+    std::unique_lock<std::mutex> lock_mutex(listener_callback_mutex_);
+
+    if(listener_callback_) {
+      listener_callback_(user_data_, 1);
+    } else {
+      unread_count_++;
+    }
+  }
+
+  // Provide handlers to perform an action when a
+  // new event from this listener has ocurred
   void
   set_callback(
     rmw_event_callback_t callback,
     const void * user_data)
   {
-    (void)callback;
-    (void)user_data;
+    std::unique_lock<std::mutex> lock_mutex(listener_callback_mutex_);
+
+    user_data_ = user_data;
+    listener_callback_ = callback;
+
+    if(callback) {
+      // Push events arrived before setting the executor's callback
+      if (unread_count_) {
+        callback(user_data, unread_count_);
+      }
+      // Reset unread count
+      unread_count_ = 0;
+    }
   }
 
   uint64_t get_sub_id() const
@@ -38,10 +97,82 @@ public:
     return &sub_id_;
   }
 
+  // Number of samples kept for this subscription before the oldest is overwritten
+  size_t get_depth() const
+  {
+    return depth_;
+  }
+
+  // Number of bytes kept for this subscription before the oldest sample is overwritten
+  size_t get_max_bytes() const
+  {
+    return max_bytes_;
+  }
+
+  // True for RELIABLE + KEEP_ALL subscriptions, which must not lose samples
+  bool blocks_publishers() const
+  {
+    return blocks_publishers_;
+  }
+
+  // UDP subscriptions also get the samples the UDP peers publish
+  bool is_udp() const
+  {
+    return udp_;
+  }
+
+  // Mailbox holding the latest sample, for KEEP_LAST depth 1 subscriptions
+  // unless their topic's queue is ring, or any KEEP_LAST if it's mailbox
+  StubLatestValueMailbox * get_mailbox() const
+  {
+    return mailbox_.get();
+  }
+
+  void set_topic(std::shared_ptr<StubTopic> topic)
+  {
+    topic_ = std::move(topic);
+  }
+
+  const std::shared_ptr<StubTopic> & get_topic() const
+  {
+    return topic_;
+  }
+
+  // Null if the type has no C++ introspection type support
+  void set_type_support(StubTypeSupport * type_support)
+  {
+    type_support_ = type_support;
+  }
+
+  StubTypeSupport * get_type_support() const
+  {
+    return type_support_;
+  }
+
+  // Position of this subscription in the topic's ring, guarded by the topic
+  uint64_t & read_cursor()
+  {
+    return read_cursor_;
+  }
+
 private:
   uint64_t sub_id_;
   const rmw_qos_profile_t * sub_qos_;
   const std::string topic_name_;
+  size_t depth_;
+  size_t max_bytes_{std::numeric_limits<size_t>::max()};
+  bool blocks_publishers_{false};
+  bool udp_;
+  std::shared_ptr<StubTopic> topic_;
+  StubTypeSupport * type_support_{nullptr};
+  uint64_t read_cursor_{0};
+  std::unique_ptr<StubLatestValueMailbox> mailbox_;
+
+  // Events executor
+  rmw_event_callback_t listener_callback_{nullptr};
+  const void * user_data_{nullptr};
+  std::mutex listener_callback_mutex_;
+  uint64_t unread_count_ = 0;
 };
 
 #endif  // STUB_SUBSCRIPTION_HPP_
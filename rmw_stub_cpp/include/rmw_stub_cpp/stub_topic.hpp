@@ -0,0 +1,368 @@
+#ifndef STUB_TOPIC_HPP_
+#define STUB_TOPIC_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rmw/types.h"
+
+#include "rmw_stub_cpp/stub_broadcast_ring.hpp"
+#include "rmw_stub_cpp/stub_futex.hpp"
+#include "rmw_stub_cpp/stub_memory_account.hpp"
+#include "rmw_stub_cpp/stub_options.hpp"
+#include "rmw_stub_cpp/stub_sample.hpp"
+#include "rmw_stub_cpp/stub_subscription.hpp"
+
+// All the publishers and subscriptions sharing a topic name.
+// Samples are written once to a broadcast ring, so a publish costs the same
+// whatever the number of subscriptions; only their listeners are notified.
+// KEEP_LAST depth 1 subscriptions get the sample through their own mailbox
+// instead, so they never need to go through the ring, and are only notified
+// when it gets a sample to take.
+// Reliable publishers don't overwrite samples still unread by RELIABLE + KEEP_ALL
+// subscriptions: they sleep until these read them, up to a timeout.
+// The samples of the topic are charged to its memory account.
+class StubTopic
+{
+public:
+  explicit StubTopic(const std::string & topic_name)
+  : topic_name_(topic_name),
+    memory_account_(std::make_shared<StubMemoryAccount>())
+  {
+  }
+
+  const std::string & get_topic_name() const
+  {
+    return topic_name_;
+  }
+
+  const std::shared_ptr<StubMemoryAccount> & get_memory_account() const
+  {
+    return memory_account_;
+  }
+
+  void add_publisher()
+  {
+    publisher_count_++;
+  }
+
+  void remove_publisher()
+  {
+    publisher_count_--;
+  }
+
+  size_t get_publisher_count() const
+  {
+    return publisher_count_;
+  }
+
+  void add_subscription(StubSubscription * subscription)
+  {
+    std::lock_guard<std::mutex> subscriptions_lock(subscriptions_mutex_);
+    std::lock_guard<std::mutex> ring_lock(ring_mutex_);
+
+    if (!subscription->get_mailbox()) {
+      // Volatile durability: only samples published from now on are received
+      subscription->read_cursor() = ring_.get_write_sequence();
+      ring_reader_count_++;
+      if (subscription->blocks_publishers()) {
+        blocking_reader_count_++;
+      }
+    }
+    subscriptions_.push_back(subscription);
+    update_ring_capacity();
+  }
+
+  void remove_subscription(StubSubscription * subscription)
+  {
+    std::lock_guard<std::mutex> subscriptions_lock(subscriptions_mutex_);
+    std::lock_guard<std::mutex> ring_lock(ring_mutex_);
+
+    auto it = std::find(subscriptions_.begin(), subscriptions_.end(), subscription);
+    if (it != subscriptions_.end()) {
+      if (!subscription->get_mailbox()) {
+        ring_.release(subscription->read_cursor());
+        ring_reader_count_--;
+        if (subscription->blocks_publishers()) {
+          blocking_reader_count_--;
+          // Publishers waiting for it to read
+          read_futex_.wake_all();
+          get_process_read_futex().wake_all();
+        }
+      }
+      subscriptions_.erase(it);
+      update_ring_capacity();
+    }
+  }
+
+  size_t get_subscription_count()
+  {
+    std::lock_guard<std::mutex> subscriptions_lock(subscriptions_mutex_);
+    return subscriptions_.size();
+  }
+
+  // True if the process can't hold one more sample of `sample_size` bytes.
+  // Checked before allocating a sample, so that samples over the process
+  // budget are never allocated, and again when publishing it, once
+  // `charged` to the process.
+  static bool exceeds_memory_budget(size_t sample_size, bool charged = false)
+  {
+    const StubOptions & options = StubOptions::get();
+    size_t samples = StubMemoryAccount::get_process_samples();
+    size_t bytes = StubMemoryAccount::get_process_bytes();
+    if (charged) {
+      samples -= std::min<size_t>(samples, 1);
+      bytes -= std::min(bytes, sample_size);
+    }
+    return samples >= options.max_process_samples ||
+           bytes > options.max_process_bytes ||
+           sample_size > options.max_process_bytes - bytes;
+  }
+
+  // Returns RMW_RET_TIMEOUT if a reliable publish couldn't be
+  // delivered to a full RELIABLE + KEEP_ALL subscription in time, and
+  // RMW_RET_ERROR if the samples held by the process exceed its budget
+  rmw_ret_t publish(std::shared_ptr<const StubSample> sample, bool reliable)
+  {
+    return publish(std::move(sample), reliable, StubOptions::get().publish_timeout);
+  }
+
+  // Same, waiting at most `timeout` for full subscriptions, 0 to return
+  // RMW_RET_TIMEOUT right away
+  rmw_ret_t publish(
+    std::shared_ptr<const StubSample> sample, bool reliable, std::chrono::nanoseconds timeout)
+  {
+    if (exceeds_memory_budget(sample->size(), true)) {
+      return RMW_RET_ERROR;
+    }
+
+    std::unique_lock<std::mutex> subscriptions_lock(subscriptions_mutex_);
+
+    if (reliable && RMW_RET_OK != wait_for_room(subscriptions_lock, sample->size(), timeout)) {
+      return RMW_RET_TIMEOUT;
+    }
+
+    if (subscriptions_.empty()) {
+      return RMW_RET_OK;
+    }
+
+    // Holding subscriptions_mutex_ serializes the mailboxes' writers.
+    // Overwriting an unread sample doesn't give the reader another one to take.
+    for (auto subscription : subscriptions_) {
+      if (subscription->get_mailbox() && subscription->get_mailbox()->write(sample)) {
+        subscription->notify();
+      }
+    }
+
+    if (ring_reader_count_ > 0) {
+      {
+        std::lock_guard<std::mutex> ring_lock(ring_mutex_);
+        ring_.push(std::move(sample), ring_reader_count_);
+      }
+
+      for (auto subscription : subscriptions_) {
+        if (!subscription->get_mailbox()) {
+          subscription->notify();
+        }
+      }
+    }
+
+    return RMW_RET_OK;
+  }
+
+  // Wait at most `timeout` for the RELIABLE + KEEP_ALL subscriptions to
+  // have room for a sample of `sample_size` bytes, as reliable publishes do.
+  // Returns RMW_RET_TIMEOUT if one of them is still full.
+  rmw_ret_t wait_for_room(size_t sample_size, std::chrono::nanoseconds timeout)
+  {
+    std::unique_lock<std::mutex> subscriptions_lock(subscriptions_mutex_);
+    return wait_for_room(subscriptions_lock, sample_size, timeout);
+  }
+
+  // Returns the next sample for this subscription, or nullptr if there is none
+  std::shared_ptr<const StubSample> take(StubSubscription * subscription)
+  {
+    if (subscription->get_mailbox()) {
+      return subscription->get_mailbox()->take();
+    }
+
+    std::shared_ptr<const StubSample> sample;
+    {
+      std::lock_guard<std::mutex> ring_lock(ring_mutex_);
+      sample = ring_.take(
+        subscription->read_cursor(), subscription->get_depth(), subscription->get_max_bytes());
+    }
+
+    if (sample && subscription->blocks_publishers()) {
+      read_futex_.wake_all();
+      get_process_read_futex().wake_all();
+    }
+
+    return sample;
+  }
+
+  // Bumped each time a RELIABLE + KEEP_ALL subscription of any topic takes a
+  // sample or leaves, for the asynchronous writer retrying publishes to full
+  // ones
+  static StubFutex & get_process_read_futex()
+  {
+    static StubFutex futex;
+    return futex;
+  }
+
+private:
+  // Size the ring for the most demanding of its remaining readers.
+  // Must be called with ring_mutex_ and subscriptions_mutex_ held.
+  void update_ring_capacity()
+  {
+    size_t capacity = 0;
+    size_t byte_capacity = 0;
+    for (auto subscription : subscriptions_) {
+      if (!subscription->get_mailbox()) {
+        capacity = std::max(capacity, subscription->get_depth());
+        byte_capacity = std::max(byte_capacity, subscription->get_max_bytes());
+      }
+    }
+    ring_.set_capacity(capacity, byte_capacity);
+  }
+
+  // Same, with subscriptions_lock held
+  rmw_ret_t wait_for_room(
+    std::unique_lock<std::mutex> & subscriptions_lock, size_t sample_size,
+    std::chrono::nanoseconds timeout)
+  {
+    if (blocking_reader_count_ == 0) {
+      return RMW_RET_OK;
+    }
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (true) {
+      uint32_t read_count;
+      {
+        std::lock_guard<std::mutex> ring_lock(ring_mutex_);
+        if (!is_blocking_reader_full(sample_size)) {
+          return RMW_RET_OK;
+        }
+        read_count = read_futex_.value();
+      }
+
+      // Let subscriptions come and go while waiting for them to read
+      subscriptions_lock.unlock();
+      read_futex_.wait(read_count, deadline - std::chrono::steady_clock::now());
+      subscriptions_lock.lock();
+
+      if (std::chrono::steady_clock::now() >= deadline) {
+        std::lock_guard<std::mutex> ring_lock(ring_mutex_);
+        return is_blocking_reader_full(sample_size) ? RMW_RET_TIMEOUT : RMW_RET_OK;
+      }
+    }
+  }
+
+  // True if a RELIABLE + KEEP_ALL subscription has no room for a sample of this size.
+  // Must be called with ring_mutex_ and subscriptions_mutex_ held.
+  bool is_blocking_reader_full(size_t sample_size)
+  {
+    for (auto subscription : subscriptions_) {
+      if (!subscription->blocks_publishers()) {
+        continue;
+      }
+
+      uint64_t cursor = subscription->read_cursor();
+      size_t unread_bytes = ring_.get_unread_bytes(cursor);
+
+      // A sample larger than the limit still goes through an empty queue
+      if (ring_.get_unread_samples(cursor) >= subscription->get_depth() ||
+        (unread_bytes > 0 && unread_bytes + sample_size > subscription->get_max_bytes()))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const std::string topic_name_;
+  std::shared_ptr<StubMemoryAccount> memory_account_;
+  std::atomic<size_t> publisher_count_{0};
+
+  // Lock order: subscriptions_mutex_, then ring_mutex_.
+  // Takes only need the ring, so they don't wait for listeners to be notified.
+  std::mutex subscriptions_mutex_;
+  std::vector<StubSubscription *> subscriptions_;
+  size_t ring_reader_count_{0};
+  size_t blocking_reader_count_{0};
+  // Bumped each time a RELIABLE + KEEP_ALL subscription takes a sample or leaves
+  StubFutex read_futex_;
+  std::mutex ring_mutex_;
+  StubBroadcastRing ring_;
+};
+
+// Process wide lookup of the topics currently in use.
+// A topic lives as long as one of its publishers or subscriptions.
+class StubTopicRegistry
+{
+public:
+  static StubTopicRegistry & instance()
+  {
+    static StubTopicRegistry registry;
+    return registry;
+  }
+
+  // Returns the topic with this name, creating it if needed
+  std::shared_ptr<StubTopic> get_topic(const std::string & topic_name)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::shared_ptr<StubTopic> topic = topics_[topic_name].lock();
+    if (!topic) {
+      topic = std::make_shared<StubTopic>(topic_name);
+      topics_[topic_name] = topic;
+    }
+    return topic;
+  }
+
+  // Returns all the topics currently in use
+  std::vector<std::shared_ptr<StubTopic>> get_topics()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<std::shared_ptr<StubTopic>> topics;
+    for (auto & entry : topics_) {
+      std::shared_ptr<StubTopic> topic = entry.second.lock();
+      if (topic) {
+        topics.push_back(std::move(topic));
+      }
+    }
+    return topics;
+  }
+
+  // Returns the topic with this name, or nullptr if it's not in use
+  std::shared_ptr<StubTopic> find_topic(const std::string & topic_name)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = topics_.find(topic_name);
+    if (it == topics_.end()) {
+      return nullptr;
+    }
+
+    std::shared_ptr<StubTopic> topic = it->second.lock();
+    if (!topic) {
+      topics_.erase(it);
+    }
+    return topic;
+  }
+
+private:
+  StubTopicRegistry() = default;
+
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::weak_ptr<StubTopic>> topics_;
+};
+
+#endif  // STUB_TOPIC_HPP_
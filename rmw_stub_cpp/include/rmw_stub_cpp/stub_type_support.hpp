@@ -0,0 +1,716 @@
+#ifndef STUB_TYPE_SUPPORT_HPP_
+#define STUB_TYPE_SUPPORT_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rcutils/error_handling.h"
+#include "rosidl_runtime_c/message_type_support_struct.h"
+#include "rosidl_typesupport_introspection_cpp/field_types.hpp"
+#include "rosidl_typesupport_introspection_cpp/identifier.hpp"
+#include "rosidl_typesupport_introspection_cpp/message_introspection.hpp"
+
+#include "rmw_stub_cpp/stub_byte_swap.hpp"
+#include "rmw_stub_cpp/stub_parallel_copy.hpp"
+
+// CDR (de)serialization of the messages of one type, driven by their
+// C++ introspection type support. A serialized message is the 4 bytes
+// encapsulation header followed by the payload in the host byte order,
+// each primitive being aligned on its size relative to the payload start.
+// Messages written in the other byte order are byte swapped when read.
+class StubTypeSupport
+{
+public:
+  using MessageMembers = rosidl_typesupport_introspection_cpp::MessageMembers;
+  using MessageMember = rosidl_typesupport_introspection_cpp::MessageMember;
+
+  static constexpr size_t kEncapsulationSize = 4;
+
+  // Returns the (de)serializer of this type,
+  // or nullptr if there is no C++ introspection type support for it
+  static StubTypeSupport * get(const rosidl_message_type_support_t * type_support)
+  {
+    const rosidl_message_type_support_t * introspection = get_message_typesupport_handle(
+      type_support, rosidl_typesupport_introspection_cpp::typesupport_identifier);
+    if (!introspection) {
+      rcutils_reset_error();
+      return nullptr;
+    }
+
+    auto members = static_cast<const MessageMembers *>(introspection->data);
+
+    static std::mutex mutex;
+    static std::unordered_map<const MessageMembers *, std::unique_ptr<StubTypeSupport>> cache;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<StubTypeSupport> & stub_type_support = cache[members];
+    if (!stub_type_support) {
+      stub_type_support.reset(new StubTypeSupport(members));
+    }
+    return stub_type_support.get();
+  }
+
+  const MessageMembers * get_members() const
+  {
+    return members_;
+  }
+
+  // Whether every message of this type has the same serialized size:
+  // no strings and no sequences, in this type or its nested types
+  bool is_fixed_size() const
+  {
+    return fixed_size_;
+  }
+
+  // Serialized size of the messages of a fixed size type
+  size_t get_fixed_serialized_size() const
+  {
+    return kEncapsulationSize + fixed_payload_size_;
+  }
+
+  size_t get_serialized_size(const void * ros_message) const
+  {
+    if (fixed_size_) {
+      return get_fixed_serialized_size();
+    }
+
+    SizeWriter writer;
+    serialize_message(members_, ros_message, writer);
+    return kEncapsulationSize + writer.offset;
+  }
+
+  // `buffer` must hold get_serialized_size() bytes
+  void serialize(const void * ros_message, uint8_t * buffer) const
+  {
+    buffer[0] = 0;
+    buffer[1] = is_little_endian() ? kCdrLittleEndian : kCdrBigEndian;
+    buffer[2] = 0;
+    buffer[3] = 0;
+
+    if (fixed_size_) {
+      serialize_fixed(ros_message, buffer + kEncapsulationSize);
+      return;
+    }
+
+    BufferWriter writer(buffer + kEncapsulationSize);
+    serialize_message(members_, ros_message, writer);
+  }
+
+  // Returns false if the buffer doesn't hold a message of this type
+  bool deserialize(const uint8_t * buffer, size_t size, void * ros_message) const
+  {
+    bool byte_swap = false;
+    if (!get_encapsulation(buffer, size, byte_swap)) {
+      return false;
+    }
+
+    // The copy plan only holds for data in the host byte order
+    if (fixed_size_ && !byte_swap) {
+      return size >= get_fixed_serialized_size() &&
+             deserialize_fixed(buffer + kEncapsulationSize, ros_message);
+    }
+
+    BufferReader reader(buffer + kEncapsulationSize, size - kEncapsulationSize);
+    reader.byte_swap = byte_swap;
+    return deserialize_message(members_, ros_message, reader);
+  }
+
+  // Whether the buffer starts with a plain CDR encapsulation header,
+  // and if so whether its byte order is the opposite of the host's
+  static bool get_encapsulation(const uint8_t * buffer, size_t size, bool & byte_swap)
+  {
+    if (size < kEncapsulationSize || buffer[0] != 0 ||
+      (buffer[1] != kCdrBigEndian && buffer[1] != kCdrLittleEndian))
+    {
+      return false;
+    }
+
+    byte_swap = (buffer[1] == kCdrLittleEndian) != is_little_endian();
+    return true;
+  }
+
+  // Whether the buffer holds CDR in the host byte order, readable in place
+  static bool check_encapsulation(const uint8_t * buffer, size_t size)
+  {
+    bool byte_swap = false;
+    return get_encapsulation(buffer, size, byte_swap) && !byte_swap;
+  }
+
+  static bool is_little_endian()
+  {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return false;
+#else
+    return true;
+#endif
+  }
+
+  static size_t get_padding(size_t offset, size_t alignment)
+  {
+    return (alignment - (offset % alignment)) % alignment;
+  }
+
+  // Size of a primitive type, 0 for strings and messages
+  static size_t get_primitive_size(uint8_t type_id)
+  {
+    namespace ts = rosidl_typesupport_introspection_cpp;
+
+    switch (type_id) {
+      case ts::ROS_TYPE_BOOLEAN:
+      case ts::ROS_TYPE_OCTET:
+      case ts::ROS_TYPE_CHAR:
+      case ts::ROS_TYPE_UINT8:
+      case ts::ROS_TYPE_INT8:
+        return 1;
+      case ts::ROS_TYPE_WCHAR:
+      case ts::ROS_TYPE_UINT16:
+      case ts::ROS_TYPE_INT16:
+        return 2;
+      case ts::ROS_TYPE_FLOAT:
+      case ts::ROS_TYPE_UINT32:
+      case ts::ROS_TYPE_INT32:
+        return 4;
+      case ts::ROS_TYPE_DOUBLE:
+      case ts::ROS_TYPE_UINT64:
+      case ts::ROS_TYPE_INT64:
+        return 8;
+      case ts::ROS_TYPE_LONG_DOUBLE:
+        return sizeof(long double);
+      default:
+        return 0;
+    }
+  }
+
+  // CDR aligns primitives on their size, up to 8 bytes
+  static size_t get_alignment(size_t primitive_size)
+  {
+    return primitive_size < 8 ? primitive_size : 8;
+  }
+
+  static const MessageMembers * get_nested_members(const MessageMember & member)
+  {
+    return static_cast<const MessageMembers *>(member.members_->data);
+  }
+
+  // Unlike fixed size arrays, sequences are prefixed with their length
+  static bool is_sequence(const MessageMember & member)
+  {
+    return member.array_size_ == 0 || member.is_upper_bound_;
+  }
+
+  struct BufferReader
+  {
+    BufferReader(const uint8_t * payload, size_t size)
+    : payload(payload), size(size)
+    {
+    }
+
+    bool align(size_t alignment)
+    {
+      size_t padding = get_padding(offset, alignment);
+      if (padding > size - offset) {
+        return false;
+      }
+      offset += padding;
+      return true;
+    }
+
+    bool read(void * data, size_t length)
+    {
+      if (length > size - offset) {
+        return false;
+      }
+      memcpy(data, payload + offset, length);
+      offset += length;
+      return true;
+    }
+
+    // Read primitives, converting them to the host byte order
+    bool read_array(void * data, size_t count, size_t primitive_size)
+    {
+      if (count > (size - offset) / primitive_size || !read(data, count * primitive_size)) {
+        return false;
+      }
+      if (byte_swap) {
+        StubByteSwap::swap(data, count, primitive_size);
+      }
+      return true;
+    }
+
+    bool read_primitive(void * data, size_t primitive_size)
+    {
+      return read_array(data, 1, primitive_size);
+    }
+
+    bool skip(size_t length)
+    {
+      if (length > size - offset) {
+        return false;
+      }
+      offset += length;
+      return true;
+    }
+
+    size_t get_remaining() const
+    {
+      return size - offset;
+    }
+
+    const uint8_t * payload;
+    size_t size;
+    size_t offset{0};
+    // The payload has the opposite byte order of the host
+    bool byte_swap{false};
+  };
+
+  // Moves the reader past a whole member, without deserializing it
+  static bool skip_member(const MessageMember & member, BufferReader & reader)
+  {
+    if (!member.is_array_) {
+      return skip_element(member, reader);
+    }
+
+    size_t count = member.array_size_;
+    if (is_sequence(member)) {
+      uint32_t length;
+      if (!reader.align(4) || !reader.read_primitive(&length, sizeof(length))) {
+        return false;
+      }
+      count = length;
+    }
+    if (count == 0) {
+      return true;
+    }
+
+    size_t primitive_size = get_primitive_size(member.type_id_);
+    if (member.type_id_ == rosidl_typesupport_introspection_cpp::ROS_TYPE_BOOLEAN) {
+      return reader.skip(count);
+    } else if (primitive_size > 0) {
+      return reader.align(get_alignment(primitive_size)) &&
+             count <= reader.get_remaining() / primitive_size &&
+             reader.skip(count * primitive_size);
+    }
+
+    for (size_t index = 0; index < count; index++) {
+      if (!skip_element(member, reader)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Moves the reader past one element of a member
+  static bool skip_element(const MessageMember & member, BufferReader & reader)
+  {
+    namespace ts = rosidl_typesupport_introspection_cpp;
+
+    uint32_t length;
+    switch (member.type_id_) {
+      case ts::ROS_TYPE_STRING:
+        return reader.align(4) && reader.read_primitive(&length, sizeof(length)) && reader.skip(length);
+      case ts::ROS_TYPE_WSTRING:
+        return reader.align(4) && reader.read_primitive(&length, sizeof(length)) &&
+               length <= reader.get_remaining() / sizeof(char16_t) &&
+               reader.skip(length * sizeof(char16_t));
+      case ts::ROS_TYPE_MESSAGE:
+        return skip_message(get_nested_members(member), reader);
+      case ts::ROS_TYPE_BOOLEAN:
+        return reader.skip(1);
+      default:
+        {
+          size_t primitive_size = get_primitive_size(member.type_id_);
+          return reader.align(get_alignment(primitive_size)) && reader.skip(primitive_size);
+        }
+    }
+  }
+
+  static bool skip_message(const MessageMembers * members, BufferReader & reader)
+  {
+    for (uint32_t i = 0; i < members->member_count_; i++) {
+      if (!skip_member(members->members_[i], reader)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+protected:
+  static constexpr uint8_t kCdrBigEndian = 0;
+  static constexpr uint8_t kCdrLittleEndian = 1;
+
+  explicit StubTypeSupport(const MessageMembers * members)
+  : members_(members)
+  {
+    fixed_size_ = build_copy_plan(members_, 0);
+    if (!fixed_size_) {
+      copy_plan_.clear();
+      fixed_payload_size_ = 0;
+    }
+  }
+
+  // Copy of a run of primitives from the message to the payload. For fixed
+  // size types, the offsets of all the primitives in both are known once and
+  // for all, and adjacent primitives laid out alike are merged in one copy.
+  struct CopyStep
+  {
+    size_t message_offset;
+    size_t payload_offset;
+    size_t size;
+    bool is_bool;
+  };
+
+  // Append the copy steps of a message at `message_offset` to the plan,
+  // or return false if the type is not fixed size
+  bool build_copy_plan(const MessageMembers * members, size_t message_offset)
+  {
+    namespace ts = rosidl_typesupport_introspection_cpp;
+
+    for (uint32_t i = 0; i < members->member_count_; i++) {
+      const MessageMember & member = members->members_[i];
+      if (member.is_array_ && is_sequence(member)) {
+        return false;
+      }
+
+      size_t count = member.is_array_ ? member.array_size_ : 1;
+      size_t offset = message_offset + member.offset_;
+
+      if (member.type_id_ == ts::ROS_TYPE_MESSAGE) {
+        // Fixed size arrays are std::array, with contiguous elements
+        const MessageMembers * nested = get_nested_members(member);
+        for (size_t index = 0; index < count; index++) {
+          if (!build_copy_plan(nested, offset + index * nested->size_of_)) {
+            return false;
+          }
+        }
+        continue;
+      }
+
+      size_t primitive_size = get_primitive_size(member.type_id_);
+      if (primitive_size == 0) {
+        return false;
+      }
+
+      bool is_bool = member.type_id_ == ts::ROS_TYPE_BOOLEAN;
+      if (!is_bool) {
+        size_t padding = get_padding(fixed_payload_size_, get_alignment(primitive_size));
+        fixed_payload_size_ += padding;
+        has_padding_ = has_padding_ || padding > 0;
+      }
+      add_copy_step({offset, fixed_payload_size_, count * primitive_size, is_bool});
+      fixed_payload_size_ += count * primitive_size;
+    }
+
+    return true;
+  }
+
+  void add_copy_step(const CopyStep & step)
+  {
+    if (!copy_plan_.empty()) {
+      CopyStep & last = copy_plan_.back();
+      if (last.is_bool == step.is_bool &&
+        last.message_offset + last.size == step.message_offset &&
+        last.payload_offset + last.size == step.payload_offset)
+      {
+        last.size += step.size;
+        return;
+      }
+    }
+    copy_plan_.push_back(step);
+  }
+
+  void serialize_fixed(const void * ros_message, uint8_t * payload) const
+  {
+    if (has_padding_) {
+      memset(payload, 0, fixed_payload_size_);
+    }
+
+    auto message = static_cast<const uint8_t *>(ros_message);
+    for (const CopyStep & step : copy_plan_) {
+      StubParallelCopy::copy(
+        payload + step.payload_offset, message + step.message_offset, step.size);
+    }
+  }
+
+  bool deserialize_fixed(const uint8_t * payload, void * ros_message) const
+  {
+    auto message = static_cast<uint8_t *>(ros_message);
+    for (const CopyStep & step : copy_plan_) {
+      if (step.is_bool) {
+        // Only 0 and 1 are valid bool values
+        for (size_t i = 0; i < step.size; i++) {
+          message[step.message_offset + i] = payload[step.payload_offset + i] != 0;
+        }
+      } else {
+        memcpy(message + step.message_offset, payload + step.payload_offset, step.size);
+      }
+    }
+    return true;
+  }
+
+  // Only computes the payload size
+  struct SizeWriter
+  {
+    void align(size_t alignment)
+    {
+      offset += get_padding(offset, alignment);
+    }
+
+    void write(const void *, size_t size)
+    {
+      offset += size;
+    }
+
+    void write_bulk(const void *, size_t size)
+    {
+      offset += size;
+    }
+
+    size_t offset{0};
+  };
+
+  struct BufferWriter
+  {
+    explicit BufferWriter(uint8_t * payload)
+    : payload(payload)
+    {
+    }
+
+    void align(size_t alignment)
+    {
+      size_t padding = get_padding(offset, alignment);
+      memset(payload + offset, 0, padding);
+      offset += padding;
+    }
+
+    void write(const void * data, size_t size)
+    {
+      memcpy(payload + offset, data, size);
+      offset += size;
+    }
+
+    // Arrays of primitives, possibly large enough to be copied in parallel
+    void write_bulk(const void * data, size_t size)
+    {
+      StubParallelCopy::copy(payload + offset, data, size);
+      offset += size;
+    }
+
+    uint8_t * payload;
+    size_t offset{0};
+  };
+
+  template<typename Writer>
+  static void serialize_message(
+    const MessageMembers * members, const void * ros_message, Writer & writer)
+  {
+    for (uint32_t i = 0; i < members->member_count_; i++) {
+      const MessageMember & member = members->members_[i];
+      const void * field = static_cast<const uint8_t *>(ros_message) + member.offset_;
+
+      if (!member.is_array_) {
+        serialize_element(member, field, writer);
+        continue;
+      }
+
+      size_t count = member.array_size_;
+      if (is_sequence(member)) {
+        count = member.size_function(field);
+        uint32_t length = static_cast<uint32_t>(count);
+        writer.align(4);
+        writer.write(&length, sizeof(length));
+      }
+      if (count == 0) {
+        continue;
+      }
+
+      size_t primitive_size = get_primitive_size(member.type_id_);
+      if (member.type_id_ == rosidl_typesupport_introspection_cpp::ROS_TYPE_BOOLEAN) {
+        // std::vector<bool> is not contiguous
+        for (size_t index = 0; index < count; index++) {
+          bool value;
+          member.fetch_function(field, index, &value);
+          uint8_t byte = value ? 1 : 0;
+          writer.write(&byte, 1);
+        }
+      } else if (primitive_size > 0) {
+        writer.align(get_alignment(primitive_size));
+        writer.write_bulk(member.get_const_function(field, 0), count * primitive_size);
+      } else {
+        for (size_t index = 0; index < count; index++) {
+          serialize_element(member, member.get_const_function(field, index), writer);
+        }
+      }
+    }
+  }
+
+  template<typename Writer>
+  static void serialize_element(const MessageMember & member, const void * field, Writer & writer)
+  {
+    namespace ts = rosidl_typesupport_introspection_cpp;
+
+    switch (member.type_id_) {
+      case ts::ROS_TYPE_STRING:
+        {
+          auto & value = *static_cast<const std::string *>(field);
+          // CDR strings include their null terminator
+          uint32_t length = static_cast<uint32_t>(value.size() + 1);
+          writer.align(4);
+          writer.write(&length, sizeof(length));
+          writer.write(value.c_str(), length);
+          break;
+        }
+      case ts::ROS_TYPE_WSTRING:
+        {
+          auto & value = *static_cast<const std::u16string *>(field);
+          uint32_t length = static_cast<uint32_t>(value.size());
+          writer.align(4);
+          writer.write(&length, sizeof(length));
+          writer.write(value.data(), length * sizeof(char16_t));
+          break;
+        }
+      case ts::ROS_TYPE_MESSAGE:
+        serialize_message(get_nested_members(member), field, writer);
+        break;
+      case ts::ROS_TYPE_BOOLEAN:
+        {
+          uint8_t byte = *static_cast<const bool *>(field) ? 1 : 0;
+          writer.write(&byte, 1);
+          break;
+        }
+      default:
+        {
+          size_t primitive_size = get_primitive_size(member.type_id_);
+          writer.align(get_alignment(primitive_size));
+          writer.write(field, primitive_size);
+          break;
+        }
+    }
+  }
+
+  static bool deserialize_message(
+    const MessageMembers * members, void * ros_message, BufferReader & reader)
+  {
+    for (uint32_t i = 0; i < members->member_count_; i++) {
+      const MessageMember & member = members->members_[i];
+      void * field = static_cast<uint8_t *>(ros_message) + member.offset_;
+
+      if (!member.is_array_) {
+        if (!deserialize_element(member, field, reader)) {
+          return false;
+        }
+        continue;
+      }
+
+      size_t count = member.array_size_;
+      if (is_sequence(member)) {
+        uint32_t length;
+        if (!reader.align(4) || !reader.read_primitive(&length, sizeof(length))) {
+          return false;
+        }
+        // Every element takes at least one byte
+        if ((member.is_upper_bound_ && length > member.array_size_) ||
+          length > reader.get_remaining())
+        {
+          return false;
+        }
+        member.resize_function(field, length);
+        count = length;
+      }
+      if (count == 0) {
+        continue;
+      }
+
+      size_t primitive_size = get_primitive_size(member.type_id_);
+      if (member.type_id_ == rosidl_typesupport_introspection_cpp::ROS_TYPE_BOOLEAN) {
+        for (size_t index = 0; index < count; index++) {
+          uint8_t byte;
+          if (!reader.read(&byte, 1)) {
+            return false;
+          }
+          bool value = byte != 0;
+          member.assign_function(field, index, &value);
+        }
+      } else if (primitive_size > 0) {
+        if (!reader.align(get_alignment(primitive_size)) ||
+          !reader.read_array(member.get_function(field, 0), count, primitive_size))
+        {
+          return false;
+        }
+      } else {
+        for (size_t index = 0; index < count; index++) {
+          if (!deserialize_element(member, member.get_function(field, index), reader)) {
+            return false;
+          }
+        }
+      }
+    }
+
+    return true;
+  }
+
+  static bool deserialize_element(
+    const MessageMember & member, void * field, BufferReader & reader)
+  {
+    namespace ts = rosidl_typesupport_introspection_cpp;
+
+    switch (member.type_id_) {
+      case ts::ROS_TYPE_STRING:
+        {
+          uint32_t length;
+          if (!reader.align(4) || !reader.read_primitive(&length, sizeof(length)) ||
+            length > reader.get_remaining())
+          {
+            return false;
+          }
+          auto & value = *static_cast<std::string *>(field);
+          const char * chars = reinterpret_cast<const char *>(reader.payload + reader.offset);
+          // Strip the null terminator
+          value.assign(chars, length > 0 ? length - 1 : 0);
+          reader.offset += length;
+          return true;
+        }
+      case ts::ROS_TYPE_WSTRING:
+        {
+          uint32_t length;
+          if (!reader.align(4) || !reader.read_primitive(&length, sizeof(length)) ||
+            length > reader.get_remaining() / sizeof(char16_t))
+          {
+            return false;
+          }
+          auto & value = *static_cast<std::u16string *>(field);
+          value.resize(length);
+          return reader.read_array(&value[0], length, sizeof(char16_t));
+        }
+      case ts::ROS_TYPE_MESSAGE:
+        return deserialize_message(get_nested_members(member), field, reader);
+      case ts::ROS_TYPE_BOOLEAN:
+        {
+          uint8_t byte;
+          if (!reader.read(&byte, 1)) {
+            return false;
+          }
+          *static_cast<bool *>(field) = byte != 0;
+          return true;
+        }
+      default:
+        {
+          size_t primitive_size = get_primitive_size(member.type_id_);
+          return reader.align(get_alignment(primitive_size)) &&
+                 reader.read_primitive(field, primitive_size);
+        }
+    }
+  }
+
+  const MessageMembers * members_;
+  bool fixed_size_{false};
+  bool has_padding_{false};
+  size_t fixed_payload_size_{0};
+  std::vector<CopyStep> copy_plan_;
+};
+
+#endif  // STUB_TYPE_SUPPORT_HPP_
@@ -0,0 +1,322 @@
+#ifndef STUB_UDP_RELIABILITY_HPP_
+#define STUB_UDP_RELIABILITY_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+#include "rmw_stub_cpp/stub_sample.hpp"
+
+// Sent by a reliable writer to its peers, after each batch of its samples
+// and periodically: the readers NACK what they miss of [first, last].
+// First is the first sample the writer kept since it knows of the reader.
+struct StubUdpHeartbeat
+{
+  uint32_t magic;
+  uint32_t reserved;
+  uint64_t sender_id;
+  uint64_t topic_hash;
+  uint64_t publisher_id;
+  int64_t first_sequence_number;
+  int64_t last_sequence_number;
+};
+
+// Sent back by a reader to the writer of a heartbeat: the writer sends the
+// samples of the bitmap again, bit i standing for base + i
+struct StubUdpNack
+{
+  static constexpr size_t kBitmapWords = 4;
+  static constexpr int64_t kBitmapSize = 64 * kBitmapWords;
+
+  uint32_t magic;
+  uint32_t reserved;
+  // Of the writer, to which the NACK is addressed
+  uint64_t sender_id;
+  uint64_t topic_hash;
+  uint64_t publisher_id;
+  int64_t base_sequence_number;
+  uint64_t bitmap[kBitmapWords];
+};
+
+// The last samples of a reliable writer, which it can send again, each at
+// most once per heartbeat period however many NACKs ask for it, along with
+// when they were queued, to tell which a reader that came later should get.
+// Sequence numbers are consecutive, as publishers number their samples.
+class StubWriterHistory
+{
+public:
+  explicit StubWriterHistory(size_t depth)
+  : depth_(depth > 0 ? depth : 1)
+  {
+  }
+
+  void add(std::shared_ptr<const StubSample> sample, std::chrono::steady_clock::time_point queued)
+  {
+    if (!samples_.empty() &&
+      sample->get_sequence_number() != get_last_sequence_number() + 1)
+    {
+      samples_.clear();
+    }
+    samples_.push_back({std::move(sample), queued, 0});
+    if (samples_.size() > depth_) {
+      samples_.pop_front();
+    }
+  }
+
+  bool empty() const
+  {
+    return samples_.empty();
+  }
+
+  int64_t get_first_sequence_number() const
+  {
+    return samples_.front().sample->get_sequence_number();
+  }
+
+  int64_t get_last_sequence_number() const
+  {
+    return samples_.back().sample->get_sequence_number();
+  }
+
+  // First sample queued since `time`, last + 1 if none
+  int64_t get_first_sequence_number(std::chrono::steady_clock::time_point time) const
+  {
+    auto it = std::lower_bound(
+      samples_.begin(), samples_.end(), time, [](const Entry & entry,
+      std::chrono::steady_clock::time_point value) {return entry.queued < value;});
+    return it != samples_.end() ?
+           it->sample->get_sequence_number() : get_last_sequence_number() + 1;
+  }
+
+  // The sample to send again for a NACK received in the given heartbeat
+  // period (counted from 1). Null if the sample is not in the history
+  // anymore, or was already sent again in this period.
+  std::shared_ptr<const StubSample> resend(int64_t sequence_number, uint64_t period)
+  {
+    if (samples_.empty() || sequence_number < get_first_sequence_number() ||
+      sequence_number > get_last_sequence_number())
+    {
+      return nullptr;
+    }
+    Entry & entry = samples_[static_cast<size_t>(sequence_number - get_first_sequence_number())];
+    if (entry.resent_period == period) {
+      return nullptr;
+    }
+    entry.resent_period = period;
+    return entry.sample;
+  }
+
+private:
+  struct Entry
+  {
+    std::shared_ptr<const StubSample> sample;
+    std::chrono::steady_clock::time_point queued;
+    // Heartbeat period in which it was last sent again, 0 if never
+    uint64_t resent_period;
+  };
+
+  const size_t depth_;
+  std::deque<Entry> samples_;
+};
+
+// The samples of a reliable writer received by a reader: all of them below
+// base, the first one missing, and a bitmap of the next kWindowSize. Samples
+// too far ahead of base move the window forward, giving up on the missing
+// ones behind it. NACKs ask for the missing ones from base, a bitmap at a time:
+// the samples found missing since the last NACK right away, and the ones
+// already NACKed again only once per heartbeat period.
+// A window created by a sample rather than by a heartbeat moves back to the
+// first sample of the first heartbeat: the samples lost before the first
+// one received are NACKed too.
+class StubReaderWindow
+{
+public:
+  static constexpr size_t kWindowWords = 64;
+  static constexpr int64_t kWindowSize = 64 * kWindowWords;
+
+  explicit StubReaderWindow(int64_t base)
+  : base_(base), created_base_(base), nacked_until_(base - 1)
+  {
+  }
+
+  // Returns false for a sample already received, or given up on
+  bool receive(int64_t sequence_number)
+  {
+    if (sequence_number < base_) {
+      return false;
+    }
+    if (sequence_number >= base_ + kWindowSize) {
+      move_base(sequence_number - kWindowSize + 1);
+    }
+    size_t bit = static_cast<size_t>(sequence_number - base_);
+    if (bitmap_[bit / 64] & (1ull << (bit % 64))) {
+      return false;
+    }
+    bitmap_[bit / 64] |= 1ull << (bit % 64);
+    skip_received();
+    return true;
+  }
+
+  bool has_received(int64_t sequence_number) const
+  {
+    if (sequence_number < base_) {
+      return true;
+    }
+    if (sequence_number >= base_ + kWindowSize) {
+      return false;
+    }
+    size_t bit = static_cast<size_t>(sequence_number - base_);
+    return bitmap_[bit / 64] & (1ull << (bit % 64));
+  }
+
+  int64_t get_base() const
+  {
+    return base_;
+  }
+
+  // The writer doesn't have the samples before first anymore
+  void on_heartbeat(int64_t first)
+  {
+    if (!has_heartbeat_) {
+      has_heartbeat_ = true;
+      move_base_back(first);
+    }
+    if (first > base_) {
+      move_base(first);
+      skip_received();
+    }
+  }
+
+  // First sample to NACK for a heartbeat up to last, received in the given
+  // heartbeat period (counted from 1): base in a new period, otherwise the
+  // first one after those NACKed already
+  int64_t begin_nack(uint64_t period, int64_t last)
+  {
+    int64_t begin = base_;
+    if (period == nack_period_) {
+      begin = std::max(base_, nacked_until_ + 1);
+    }
+    nack_period_ = period;
+    nacked_until_ = std::max(nacked_until_, last);
+    return begin;
+  }
+
+  // Something was received from the writer
+  void mark_active()
+  {
+    idle_periods_ = 0;
+  }
+
+  // Called every heartbeat period: true once nothing was received from the
+  // writer for more than `periods`, e.g. because it's gone
+  bool is_expired(unsigned periods)
+  {
+    return ++idle_periods_ > periods;
+  }
+
+  // Fill a NACK with the samples missing of the bitmap starting at begin,
+  // up to last. Returns false if none are missing.
+  bool get_missing(int64_t begin, int64_t last, StubUdpNack & nack) const
+  {
+    bool missing = false;
+    nack.base_sequence_number = begin;
+    for (size_t word = 0; word < StubUdpNack::kBitmapWords; word++) {
+      nack.bitmap[word] = 0;
+    }
+    const int64_t end = std::min(last + 1, begin + StubUdpNack::kBitmapSize);
+    for (int64_t sequence_number = begin; sequence_number < end; sequence_number++) {
+      if (!has_received(sequence_number)) {
+        size_t bit = static_cast<size_t>(sequence_number - begin);
+        nack.bitmap[bit / 64] |= 1ull << (bit % 64);
+        missing = true;
+      }
+    }
+    return missing;
+  }
+
+private:
+  void move_base(int64_t base)
+  {
+    const int64_t shift = base - base_;
+    if (shift <= 0) {
+      return;
+    }
+    base_ = base;
+    const size_t words = static_cast<size_t>(std::min<int64_t>(shift / 64, kWindowWords));
+    const unsigned bits = static_cast<unsigned>(shift % 64);
+    for (size_t word = 0; word < kWindowWords; word++) {
+      const uint64_t low = word + words < kWindowWords ? bitmap_[word + words] : 0;
+      const uint64_t high = word + words + 1 < kWindowWords ? bitmap_[word + words + 1] : 0;
+      bitmap_[word] = bits ? (low >> bits) | (high << (64 - bits)) : low;
+    }
+  }
+
+  // Back to the samples sent before the one the window was created with.
+  // Those received meanwhile stay received, and so do the ones given up on.
+  void move_base_back(int64_t base)
+  {
+    int64_t highest = base_ - 1;
+    for (size_t word = kWindowWords; word-- > 0; ) {
+      if (bitmap_[word]) {
+        highest = base_ + static_cast<int64_t>(word * 64 + 63 - __builtin_clzll(bitmap_[word]));
+        break;
+      }
+    }
+    base = std::max(base, highest - kWindowSize + 1);
+    if (base >= created_base_) {
+      return;
+    }
+
+    uint64_t bitmap[kWindowWords];
+    std::copy(bitmap_, bitmap_ + kWindowWords, bitmap);
+    const int64_t previous_base = base_;
+    base_ = base;
+    std::fill(bitmap_, bitmap_ + kWindowWords, 0);
+    for (int64_t sequence_number = created_base_; sequence_number < previous_base;
+      sequence_number++)
+    {
+      mark(sequence_number);
+    }
+    for (size_t bit = 0; bit < static_cast<size_t>(kWindowSize); bit++) {
+      if (bitmap[bit / 64] & (1ull << (bit % 64))) {
+        mark(previous_base + static_cast<int64_t>(bit));
+      }
+    }
+    nacked_until_ = base_ - 1;
+  }
+
+  void mark(int64_t sequence_number)
+  {
+    size_t bit = static_cast<size_t>(sequence_number - base_);
+    bitmap_[bit / 64] |= 1ull << (bit % 64);
+  }
+
+  // Move base to the first sample missing
+  void skip_received()
+  {
+    int64_t received = 0;
+    for (size_t word = 0; word < kWindowWords; word++) {
+      if (bitmap_[word] != ~0ull) {
+        received += __builtin_ctzll(~bitmap_[word]);
+        break;
+      }
+      received += 64;
+    }
+    move_base(base_ + received);
+  }
+
+  int64_t base_;
+  uint64_t bitmap_[kWindowWords] = {};
+  // Base the window was created with, and whether the writer's first
+  // heartbeat was received since
+  const int64_t created_base_;
+  bool has_heartbeat_{false};
+  // Last sample NACKed, and heartbeat period of the last NACK
+  int64_t nacked_until_;
+  uint64_t nack_period_{0};
+  unsigned idle_periods_{0};
+};
+
+#endif  // STUB_UDP_RELIABILITY_HPP_
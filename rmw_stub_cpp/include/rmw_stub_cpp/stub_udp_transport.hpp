@@ -0,0 +1,1375 @@
+#ifndef STUB_UDP_TRANSPORT_HPP_
+#define STUB_UDP_TRANSPORT_HPP_
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "rcutils/logging_macros.h"
+
+#include "rmw_stub_cpp/stub_gid.hpp"
+#include "rmw_stub_cpp/stub_io_uring.hpp"
+#include "rmw_stub_cpp/stub_options.hpp"
+#include "rmw_stub_cpp/stub_sample.hpp"
+#include "rmw_stub_cpp/stub_shared_buffer.hpp"
+#include "rmw_stub_cpp/stub_topic.hpp"
+#include "rmw_stub_cpp/stub_udp_reliability.hpp"
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+// Header of each datagram: a sample is sent as fragments of at most
+// udp_datagram_size bytes, header included
+struct StubUdpHeader
+{
+  uint32_t magic;
+  // Of the fragment's payload in the sample
+  uint32_t fragment_offset;
+  // Process which sent the sample, see get_process_id()
+  uint64_t sender_id;
+  // FNV-1a hash of the topic name
+  uint64_t topic_hash;
+  uint64_t publisher_id;
+  int64_t sequence_number;
+  int64_t source_timestamp;
+  uint32_t sample_size;
+  // kFlagReliable if the sender can send the sample again
+  uint32_t flags;
+};
+
+// Sent to the udp_peers every udp_heartbeat_period, and as soon as a topic
+// gets subscribed to: the hashes of the topics subscribed to follow it
+struct StubUdpSubscriptions
+{
+  uint32_t magic;
+  uint32_t topic_count;
+  uint64_t sender_id;
+};
+
+// Samples exchanged with other processes through a UDP socket bound to
+// 127.0.0.1:udp_port, for the topics with "transport = auto" when udp_peers
+// are set. Processes tell their peers which topics they subscribe to, and
+// the samples published on a topic are only sent to the peers subscribing
+// to it, the subscriptions of the process getting them directly from their
+// StubTopic. Samples received are published to the local subscriptions of
+// their topic, once: duplicates are dropped by GID and sequence number. A
+// sample which a full RELIABLE + KEEP_ALL subscription has no room for isn't
+// received yet, and is NACKed again.
+// Samples of at least memfd_threshold bytes are written by their publisher
+// into a memfd, whose fd goes to the subscribers on the same host through a
+// unix socket named after their UDP port: they map it read only, and the
+// payload is never copied.
+// Publishers only queue their samples, waking the I/O thread up when the
+// queue was empty: it drains the queue and sends everything queued meanwhile
+// at once, each fragmented sample going as a single UDP GSO buffer when the
+// kernel supports it, and reassembles the fragmented samples it receives.
+// With udp_io_uring, the I/O thread runs a single io_uring loop: a multishot
+// receive fills the buffers provided to the kernel without any system call,
+// and each batch of sends is submitted along with the wait for completions.
+// On kernels without io_uring, it waits on epoll, and sends and receives
+// batches of datagrams with sendmmsg() and recvmmsg().
+// Reliable publishers keep their last samples, as many as their history
+// depth, and send heartbeats with the range they keep after each batch and
+// every udp_heartbeat_period. A peer which misses some of them answers with
+// a NACK, a bitmap of the samples to send again, see stub_udp_reliability.hpp.
+// A sample is NACKed, and sent again, at most once per heartbeat period, and
+// the state kept for a writer expires once nothing came from it for a while.
+// Samples are delivered as they complete, not in sequence.
+class StubUdpTransport
+{
+public:
+  static constexpr uint32_t kMagic = 0x31555352;  // "RSU1"
+  static constexpr uint32_t kHeartbeatMagic = 0x31485352;  // "RSH1"
+  static constexpr uint32_t kNackMagic = 0x314e5352;  // "RSN1"
+  static constexpr uint32_t kSubscriptionsMagic = 0x31535352;  // "RSS1"
+  static constexpr uint32_t kHandoffMagic = 0x314d5352;  // "RSM1"
+  static constexpr uint32_t kFlagReliable = 1;
+  // Datagrams received per recvmmsg(), or buffers provided to io_uring
+  static constexpr size_t kBatchSize = 64;
+  // Largest UDP payload
+  static constexpr size_t kMaxDatagramSize = 65507;
+  // Fragmented samples being reassembled at once, beyond which the oldest
+  // one is dropped
+  static constexpr size_t kMaxPartialSamples = 256;
+  // Heartbeat periods after which the subscriptions of a peer which stopped
+  // telling them expire
+  static constexpr int kSubscriptionPeriods = 3;
+
+  static StubUdpTransport & instance()
+  {
+    static StubUdpTransport transport;
+    return transport;
+  }
+
+  static uint64_t get_topic_hash(const std::string & topic_name)
+  {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : topic_name) {
+      hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+    }
+    return hash;
+  }
+
+  bool is_valid() const
+  {
+    return fd_ >= 0;
+  }
+
+  // Deliver the samples received for this topic to its local subscriptions,
+  // called for each of them
+  void add_topic(const std::shared_ptr<StubTopic> & topic)
+  {
+    {
+      std::lock_guard<std::mutex> lock(topics_mutex_);
+      LocalTopic & local_topic = topics_[get_topic_hash(topic->get_topic_name())];
+      if (local_topic.topic.expired()) {
+        local_topic = {topic, 0};
+      }
+      if (local_topic.subscription_count++ > 0) {
+        return;
+      }
+    }
+    // Tell the peers now rather than at the next heartbeat
+    announce_ = true;
+    wake();
+  }
+
+  // Called as each of the subscriptions of add_topic() is destroyed. Once
+  // the last one is, the topic isn't announced anymore, and the peers stop
+  // sending it when their subscription times out.
+  void remove_topic(const std::shared_ptr<StubTopic> & topic)
+  {
+    std::lock_guard<std::mutex> lock(topics_mutex_);
+    auto it = topics_.find(get_topic_hash(topic->get_topic_name()));
+    if (it != topics_.end() && --it->second.subscription_count == 0) {
+      topics_.erase(it);
+    }
+  }
+
+  // Reliable samples are kept in the history of their publisher, of
+  // `history_depth` samples, until it's destroyed. Beyond udp_queue_size
+  // samples waiting for the I/O thread, the oldest one is dropped, as on a
+  // congested network: reliable peers NACK it.
+  void send(
+    uint64_t topic_hash, std::shared_ptr<const StubSample> sample, bool reliable,
+    size_t history_depth)
+  {
+    bool was_empty;
+    {
+      std::lock_guard<std::mutex> lock(send_mutex_);
+      if (failed_ || !remote_topics_.count(topic_hash)) {
+        return;
+      }
+      was_empty = send_queue_.empty();
+      if (send_queue_.size() >= queue_size_) {
+        send_queue_.erase(send_queue_.begin());
+      }
+      send_queue_.push_back({topic_hash, sample, reliable, false, {}});
+    }
+    if (reliable) {
+      const auto now = std::chrono::steady_clock::now();
+      std::lock_guard<std::mutex> lock(histories_mutex_);
+      StreamKey key(topic_hash, sample->get_publisher_id());
+      auto it = histories_.find(key);
+      if (it == histories_.end()) {
+        it = histories_.emplace(key, StubWriterHistory(history_depth)).first;
+      }
+      it->second.add(std::move(sample), now);
+    }
+    if (was_empty) {
+      wake();
+    }
+  }
+
+  bool has_remote_subscribers(uint64_t topic_hash)
+  {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    return remote_topics_.count(topic_hash) > 0;
+  }
+
+  void remove_publisher(uint64_t topic_hash, uint64_t publisher_id)
+  {
+    std::lock_guard<std::mutex> lock(histories_mutex_);
+    histories_.erase(StreamKey(topic_hash, publisher_id));
+  }
+
+private:
+  struct Outgoing
+  {
+    uint64_t topic_hash;
+    std::shared_ptr<const StubSample> sample;
+    bool reliable;
+    // Sent again to the peer which NACKed it only, rather than to all the
+    // peers subscribing to the topic
+    bool resent;
+    sockaddr_in destination;
+  };
+
+  // Topic hash and publisher id, of the local reliable publishers
+  using StreamKey = std::pair<uint64_t, uint64_t>;
+  // Sender id, topic hash and publisher id, of the remote ones
+  using RemoteStreamKey = std::tuple<uint64_t, uint64_t, uint64_t>;
+  using SampleKey = std::tuple<uint64_t, uint64_t, uint64_t, int64_t>;
+
+  // A peer subscribing to a topic
+  struct RemoteSubscriber
+  {
+    sockaddr_in address;
+    uint64_t process_id;
+    std::chrono::steady_clock::time_point last_seen;
+    // The samples queued from then on are sent to it
+    std::chrono::steady_clock::time_point joined;
+  };
+
+  // A topic subscribed to in this process
+  struct LocalTopic
+  {
+    std::weak_ptr<StubTopic> topic;
+    size_t subscription_count;
+  };
+
+  // A fragmented sample being received
+  struct PartialSample
+  {
+    std::shared_ptr<StubSample> sample;
+    std::shared_ptr<StubTopic> topic;
+    // Offsets of the fragments received, which may be received twice
+    std::set<uint32_t> fragments;
+    size_t received;
+    uint64_t age;
+  };
+
+  StubUdpTransport()
+  {
+    const StubOptions & options = StubOptions::get();
+
+    sender_id_ = get_process_id();
+    drop_generator_.seed(sender_id_);
+    subscription_timeout_ = options.udp_heartbeat_period * static_cast<int>(kSubscriptionPeriods);
+
+    datagram_size_ = std::min(
+      std::max(options.udp_datagram_size, sizeof(StubUdpHeader) + 1),
+      static_cast<size_t>(kMaxDatagramSize));
+    fragment_size_ = datagram_size_ - sizeof(StubUdpHeader);
+
+    for (const std::string & peer : options.udp_peers) {
+      sockaddr_in address;
+      if (!parse_address(peer, address)) {
+        RCUTILS_LOG_WARN_NAMED("rmw_stub_cpp", "ignoring invalid UDP peer '%s'", peer.c_str());
+        continue;
+      }
+      peers_.push_back(address);
+    }
+
+    fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+      RCUTILS_LOG_ERROR_NAMED("rmw_stub_cpp", "can't create the UDP socket: %s", strerror(errno));
+      return;
+    }
+    int buffer_size = 4 * 1024 * 1024;
+    setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+    setsockopt(fd_, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(options.udp_port);
+    if (bind(fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+      RCUTILS_LOG_ERROR_NAMED(
+        "rmw_stub_cpp", "can't bind the UDP socket to port %u: %s", options.udp_port,
+        strerror(errno));
+      close(fd_);
+      fd_ = -1;
+      return;
+    }
+
+    // Named after the UDP port, for the peers to find it
+    handoff_fd_ = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (handoff_fd_ >= 0) {
+      sockaddr_un handoff_address;
+      socklen_t length = get_handoff_address(options.udp_port, handoff_address);
+      if (bind(handoff_fd_, reinterpret_cast<sockaddr *>(&handoff_address), length) != 0) {
+        RCUTILS_LOG_WARN_NAMED(
+          "rmw_stub_cpp", "can't bind the memfd socket, using UDP only: %s", strerror(errno));
+        close(handoff_fd_);
+        handoff_fd_ = -1;
+      }
+    }
+
+    // The kernel splits buffers of several fragments into datagrams
+    int segment_size = static_cast<int>(datagram_size_);
+    gso_segments_ = setsockopt(fd_, SOL_UDP, UDP_SEGMENT, &segment_size, sizeof(segment_size)) ?
+      1 : std::min<size_t>(64, kMaxDatagramSize / datagram_size_);
+
+    // Woken up by publishers, and for the periodic heartbeats
+    event_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (event_fd_ < 0 || timer_fd_ < 0) {
+      RCUTILS_LOG_ERROR_NAMED(
+        "rmw_stub_cpp", "can't create the UDP transport's events: %s", strerror(errno));
+      close(fd_);
+      fd_ = -1;
+      return;
+    }
+    const auto period = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      options.udp_heartbeat_period).count();
+    itimerspec heartbeats = {};
+    heartbeats.it_interval.tv_sec = period / 1000000000;
+    heartbeats.it_interval.tv_nsec = period % 1000000000;
+    heartbeats.it_value = heartbeats.it_interval;
+    timerfd_settime(timer_fd_, 0, &heartbeats, nullptr);
+
+    thread_ = std::thread(&StubUdpTransport::run, this);
+  }
+
+  ~StubUdpTransport()
+  {
+    if (thread_.joinable()) {
+      stop_ = true;
+      wake();
+      thread_.join();
+    }
+    for (int fd : {timer_fd_, event_fd_, handoff_fd_, fd_}) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  void wake()
+  {
+    uint64_t one = 1;
+    ssize_t result = write(event_fd_, &one, sizeof(one));
+    (void)result;
+  }
+
+  // "host:port", the host being an IPv4 address
+  static bool parse_address(const std::string & peer, sockaddr_in & address)
+  {
+    size_t colon = peer.rfind(':');
+    if (colon == std::string::npos) {
+      return false;
+    }
+    char * end = nullptr;
+    std::string port = peer.substr(colon + 1);
+    unsigned long number = strtoul(port.c_str(), &end, 10);
+    if (port.empty() || *end != '\0' || number == 0 || number > 65535) {
+      return false;
+    }
+
+    address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(number));
+    return inet_pton(AF_INET, peer.substr(0, colon).c_str(), &address.sin_addr) == 1;
+  }
+
+  void run()
+  {
+    StubOptions::get().set_thread_affinity();
+#if STUB_HAS_IO_URING
+    if (StubOptions::get().udp_io_uring && run_io_uring()) {
+      return;
+    }
+#endif
+    run_epoll();
+    // Nothing is sent anymore, so publishers mustn't queue samples forever
+    failed_ = true;
+  }
+
+  // Take the samples queued, and build the messages sending them to the
+  // peers subscribing to their topic, along with the heartbeats of their
+  // reliable publishers. Periodically, the heartbeats of all of them and the
+  // topics subscribed to are sent, and the peers' subscriptions expire.
+  // Returns false if there is nothing to send.
+  bool build_batch(bool periodic)
+  {
+    if (periodic) {
+      heartbeat_period_++;
+      expire_subscribers();
+      expire_reader_windows();
+    }
+
+    outgoing_.clear();
+    {
+      std::lock_guard<std::mutex> lock(send_mutex_);
+      outgoing_.swap(send_queue_);
+    }
+
+    streams_.clear();
+    for (const Outgoing & entry : outgoing_) {
+      if (entry.reliable && !entry.resent) {
+        streams_.emplace(entry.topic_hash, entry.sample->get_publisher_id());
+      }
+    }
+    get_heartbeats(periodic, streams_, heartbeats_, heartbeat_destinations_);
+
+    // Headers and iovecs are only pointed to once they're all built
+    headers_.clear();
+    for (const Outgoing & entry : outgoing_) {
+      add_headers(entry, headers_);
+    }
+
+    iovecs_.clear();
+    messages_.clear();
+    first_iovecs_.clear();
+    destinations_.clear();
+    size_t header_index = 0;
+    for (const Outgoing & entry : outgoing_) {
+      const size_t fragment_count = get_fragment_count(entry.sample->size());
+      const std::vector<RemoteSubscriber> * subscribers = get_subscribers(entry.topic_hash);
+      // Samples in a memfd go to the subscribers on the host as its fd,
+      // right away, and over UDP to the others or if that fails
+      handed_off_.clear();
+      if (!entry.resent && subscribers && entry.sample->get_shared_buffer()) {
+        for (const RemoteSubscriber & subscriber : *subscribers) {
+          handed_off_.push_back(
+            is_local(subscriber) &&
+            send_handoff(headers_[header_index], *entry.sample->get_shared_buffer(), subscriber));
+        }
+      }
+      const bool all_handed_off = !handed_off_.empty() &&
+        std::find(handed_off_.begin(), handed_off_.end(), false) == handed_off_.end();
+      for (size_t first = 0; first < fragment_count; first += gso_segments_) {
+        if (!entry.resent && (!subscribers || all_handed_off)) {
+          break;
+        }
+        const size_t count = std::min(gso_segments_, fragment_count - first);
+        mmsghdr message = {};
+        message.msg_hdr.msg_iovlen = 2 * count;
+        const size_t first_iovec = iovecs_.size();
+        for (size_t i = first; i < first + count; i++) {
+          size_t offset = i * fragment_size_;
+          iovecs_.push_back({&headers_[header_index + i], sizeof(StubUdpHeader)});
+          iovecs_.push_back(
+            {const_cast<uint8_t *>(entry.sample->data()) + offset,
+              std::min(fragment_size_, entry.sample->size() - offset)});
+        }
+        if (entry.resent) {
+          add_message(message, first_iovec, entry.destination);
+          continue;
+        }
+        for (size_t i = 0; i < subscribers->size(); i++) {
+          if (handed_off_.empty() || !handed_off_[i]) {
+            add_message(message, first_iovec, (*subscribers)[i].address);
+          }
+        }
+      }
+      header_index += fragment_count;
+    }
+    for (size_t i = 0; i < heartbeats_.size(); i++) {
+      mmsghdr message = {};
+      message.msg_hdr.msg_iovlen = 1;
+      const size_t first_iovec = iovecs_.size();
+      iovecs_.push_back({&heartbeats_[i], sizeof(heartbeats_[i])});
+      add_message(message, first_iovec, heartbeat_destinations_[i]);
+    }
+    if (periodic || announce_.exchange(false)) {
+      add_subscriptions();
+    }
+    // The iovecs and destinations don't move anymore
+    for (size_t i = 0; i < messages_.size(); i++) {
+      messages_[i].msg_hdr.msg_iov = iovecs_.data() + first_iovecs_[i];
+      messages_[i].msg_hdr.msg_name = &destinations_[i];
+      messages_[i].msg_hdr.msg_namelen = sizeof(destinations_[i]);
+    }
+
+    if (drop_ > 0) {
+      drop_messages(messages_);
+    }
+    return !messages_.empty();
+  }
+
+  void add_message(const mmsghdr & message, size_t first_iovec, const sockaddr_in & destination)
+  {
+    messages_.push_back(message);
+    first_iovecs_.push_back(first_iovec);
+    destinations_.push_back(destination);
+  }
+
+  // Null if no peer subscribes to the topic
+  const std::vector<RemoteSubscriber> * get_subscribers(uint64_t topic_hash) const
+  {
+    auto it = remote_subscribers_.find(topic_hash);
+    return it != remote_subscribers_.end() ? &it->second : nullptr;
+  }
+
+  // Same host, other process
+  bool is_local(const RemoteSubscriber & subscriber) const
+  {
+    return subscriber.process_id >> 32 == sender_id_ >> 32;
+  }
+
+  // Abstract unix socket address of the process bound to UDP port `port`
+  static socklen_t get_handoff_address(uint16_t port, sockaddr_un & address)
+  {
+    address = {};
+    address.sun_family = AF_UNIX;
+    int length = snprintf(
+      address.sun_path + 1, sizeof(address.sun_path) - 1, "rmw_stub_cpp.%u", port);
+    return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + length);
+  }
+
+  // The header of the sample's first fragment, along with the memfd
+  bool send_handoff(
+    const StubUdpHeader & first_header, const StubSharedBuffer & buffer,
+    const RemoteSubscriber & subscriber)
+  {
+    if (handoff_fd_ < 0 || buffer.get_fd() < 0 || !buffer.is_sealed()) {
+      return false;
+    }
+    StubUdpHeader header = first_header;
+    header.magic = kHandoffMagic;
+    iovec iov = {&header, sizeof(header)};
+    sockaddr_un address;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+
+    msghdr message = {};
+    message.msg_name = &address;
+    message.msg_namelen = get_handoff_address(ntohs(subscriber.address.sin_port), address);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr * cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    const int fd = buffer.get_fd();
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+
+    while (sendmsg(handoff_fd_, &message, MSG_DONTWAIT) < 0) {
+      if (errno != EINTR) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Tell each of the udp_peers the topics subscribed to
+  void add_subscriptions()
+  {
+    topic_hashes_.clear();
+    {
+      std::lock_guard<std::mutex> lock(topics_mutex_);
+      for (auto it = topics_.begin(); it != topics_.end(); ) {
+        if (it->second.topic.expired()) {
+          it = topics_.erase(it);
+        } else {
+          topic_hashes_.push_back(it->first);
+          ++it;
+        }
+      }
+    }
+
+    const size_t words = sizeof(StubUdpSubscriptions) / sizeof(uint64_t);
+    const size_t hashes_per_datagram = (datagram_size_ - sizeof(StubUdpSubscriptions)) /
+      sizeof(uint64_t);
+    subscriptions_.clear();
+    for (size_t first = 0; first < topic_hashes_.size(); first += hashes_per_datagram) {
+      const size_t count = std::min(hashes_per_datagram, topic_hashes_.size() - first);
+      StubUdpSubscriptions header = {};
+      header.magic = kSubscriptionsMagic;
+      header.topic_count = static_cast<uint32_t>(count);
+      header.sender_id = sender_id_;
+      subscriptions_.resize(subscriptions_.size() + words);
+      memcpy(&subscriptions_[subscriptions_.size() - words], &header, sizeof(header));
+      subscriptions_.insert(
+        subscriptions_.end(), topic_hashes_.begin() + static_cast<ptrdiff_t>(first),
+        topic_hashes_.begin() + static_cast<ptrdiff_t>(first + count));
+    }
+
+    // The datagrams don't move anymore
+    for (size_t offset = 0; offset < subscriptions_.size(); ) {
+      StubUdpSubscriptions header;
+      memcpy(&header, &subscriptions_[offset], sizeof(header));
+      const size_t size = (words + header.topic_count) * sizeof(uint64_t);
+      mmsghdr message = {};
+      message.msg_hdr.msg_iovlen = 1;
+      const size_t first_iovec = iovecs_.size();
+      iovecs_.push_back({&subscriptions_[offset], size});
+      for (const sockaddr_in & peer : peers_) {
+        add_message(message, first_iovec, peer);
+      }
+      offset += words + header.topic_count;
+    }
+  }
+
+  void expire_subscribers()
+  {
+    const auto now = std::chrono::steady_clock::now();
+    for (auto it = remote_subscribers_.begin(); it != remote_subscribers_.end(); ) {
+      std::vector<RemoteSubscriber> & subscribers = it->second;
+      subscribers.erase(
+        std::remove_if(
+          subscribers.begin(), subscribers.end(),
+          [this, now](const RemoteSubscriber & subscriber) {
+            return now - subscriber.last_seen > subscription_timeout_;
+          }),
+        subscribers.end());
+      if (!subscribers.empty()) {
+        ++it;
+        continue;
+      }
+      {
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        remote_topics_.erase(it->first);
+      }
+      it = remote_subscribers_.erase(it);
+    }
+  }
+
+  // Of the writers which stopped sending samples and heartbeats
+  void expire_reader_windows()
+  {
+    for (auto it = reader_windows_.begin(); it != reader_windows_.end(); ) {
+      if (it->second.is_expired(static_cast<unsigned>(kSubscriptionPeriods))) {
+        it = reader_windows_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  // Heartbeats of the given reliable publishers, or of all of them, to each
+  // of their subscribers: from the first sample queued since it subscribed
+  void get_heartbeats(
+    bool all_streams, const std::set<StreamKey> & streams,
+    std::vector<StubUdpHeartbeat> & heartbeats, std::vector<sockaddr_in> & destinations)
+  {
+    heartbeats.clear();
+    destinations.clear();
+    StubUdpHeartbeat heartbeat = {};
+    heartbeat.magic = kHeartbeatMagic;
+    heartbeat.sender_id = sender_id_;
+
+    std::lock_guard<std::mutex> lock(histories_mutex_);
+    for (const auto & entry : histories_) {
+      if ((!all_streams && !streams.count(entry.first)) || entry.second.empty()) {
+        continue;
+      }
+      const std::vector<RemoteSubscriber> * subscribers = get_subscribers(entry.first.first);
+      if (!subscribers) {
+        continue;
+      }
+      heartbeat.topic_hash = entry.first.first;
+      heartbeat.publisher_id = entry.first.second;
+      heartbeat.last_sequence_number = entry.second.get_last_sequence_number();
+      for (const RemoteSubscriber & subscriber : *subscribers) {
+        heartbeat.first_sequence_number = entry.second.get_first_sequence_number(subscriber.joined);
+        heartbeats.push_back(heartbeat);
+        destinations.push_back(subscriber.address);
+      }
+    }
+  }
+
+  // udp_drop, like losses on the network
+  void drop_messages(std::vector<mmsghdr> & messages)
+  {
+    std::uniform_real_distribution<double> probability(0.0, 1.0);
+    messages.erase(
+      std::remove_if(
+        messages.begin(), messages.end(),
+        [this, &probability](const mmsghdr &) {return probability(drop_generator_) < drop_;}),
+      messages.end());
+  }
+
+  // Empty samples still take a datagram
+  size_t get_fragment_count(size_t sample_size) const
+  {
+    return std::max<size_t>(1, (sample_size + fragment_size_ - 1) / fragment_size_);
+  }
+
+  void add_headers(const Outgoing & entry, std::vector<StubUdpHeader> & headers) const
+  {
+    const StubSample & sample = *entry.sample;
+    StubUdpHeader header = {};
+    header.magic = kMagic;
+    header.sender_id = sender_id_;
+    header.topic_hash = entry.topic_hash;
+    header.publisher_id = sample.get_publisher_id();
+    header.sequence_number = sample.get_sequence_number();
+    header.source_timestamp = sample.get_source_timestamp();
+    header.sample_size = static_cast<uint32_t>(sample.size());
+    header.flags = entry.reliable ? kFlagReliable : 0;
+
+    const size_t fragment_count = get_fragment_count(sample.size());
+    for (size_t i = 0; i < fragment_count; i++) {
+      header.fragment_offset = static_cast<uint32_t>(i * fragment_size_);
+      headers.push_back(header);
+    }
+  }
+
+  void send_messages(std::vector<mmsghdr> & messages)
+  {
+    size_t sent = 0;
+    while (sent < messages.size()) {
+      unsigned int count =
+        static_cast<unsigned int>(std::min<size_t>(1024, messages.size() - sent));
+      int result = sendmmsg(fd_, messages.data() + sent, count, 0);
+      if (result < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        // Like a loss on the network, but skip the message which failed
+        if (errno != ECONNREFUSED) {
+          RCUTILS_LOG_WARN_NAMED("rmw_stub_cpp", "UDP send failed: %s", strerror(errno));
+        }
+        result = 1;
+      }
+      sent += static_cast<size_t>(result);
+    }
+  }
+
+  void run_epoll()
+  {
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+      RCUTILS_LOG_ERROR_NAMED("rmw_stub_cpp", "can't create an epoll: %s", strerror(errno));
+      return;
+    }
+    for (int fd : {fd_, event_fd_, timer_fd_, handoff_fd_}) {
+      if (fd < 0) {
+        continue;
+      }
+      epoll_event event = {};
+      event.events = EPOLLIN;
+      event.data.fd = fd;
+      epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    std::vector<uint8_t> buffers(kBatchSize * kMaxDatagramSize);
+    while (!stop_) {
+      epoll_event events[4];
+      int count = epoll_wait(epoll_fd, events, 4, -1);
+      bool heartbeat_due = false;
+      for (int i = 0; i < count; i++) {
+        if (events[i].data.fd == fd_) {
+          receive_batches(buffers);
+          continue;
+        }
+        if (events[i].data.fd == handoff_fd_) {
+          receive_handoffs();
+          continue;
+        }
+        uint64_t value;
+        ssize_t result = read(events[i].data.fd, &value, sizeof(value));
+        (void)result;
+        heartbeat_due |= events[i].data.fd == timer_fd_;
+      }
+      if (!stop_ && build_batch(heartbeat_due)) {
+        send_messages(messages_);
+      }
+    }
+    close(epoll_fd);
+  }
+
+  // Until the socket has no more datagrams
+  void receive_batches(std::vector<uint8_t> & buffers)
+  {
+    iovec iovecs[kBatchSize];
+    mmsghdr messages[kBatchSize];
+    // Where NACKs are sent
+    sockaddr_in sources[kBatchSize];
+
+    int count = kBatchSize;
+    while (count == kBatchSize) {
+      for (size_t i = 0; i < kBatchSize; i++) {
+        iovecs[i] = {buffers.data() + i * kMaxDatagramSize, kMaxDatagramSize};
+        messages[i] = {};
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        messages[i].msg_hdr.msg_name = &sources[i];
+        messages[i].msg_hdr.msg_namelen = sizeof(sources[i]);
+      }
+
+      count = recvmmsg(fd_, messages, kBatchSize, MSG_DONTWAIT, nullptr);
+      if (count < 0) {
+        if (errno != EAGAIN && errno != EINTR && errno != ECONNREFUSED) {
+          RCUTILS_LOG_WARN_NAMED("rmw_stub_cpp", "UDP receive failed: %s", strerror(errno));
+        }
+        return;
+      }
+      for (int i = 0; i < count; i++) {
+        receive(
+          buffers.data() + static_cast<size_t>(i) * kMaxDatagramSize, messages[i].msg_len,
+          sources[i]);
+      }
+    }
+  }
+
+#if STUB_HAS_IO_URING
+  enum : uint64_t
+  {
+    kReceiveData = 1,
+    kEventData,
+    kTimerData,
+    kSendData,
+    kHandoffData,
+  };
+
+  // Returns false if the kernel doesn't support what it needs, or if it
+  // failed: the samples being sent may be lost, as on the network
+  bool run_io_uring()
+  {
+    // Each provided buffer receives the recvmsg() header, the address of
+    // the sender, then the datagram
+    const size_t buffer_size = sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in) +
+      kMaxDatagramSize;
+    std::vector<uint8_t> buffers(kBatchSize * buffer_size);
+    msghdr receive_header = {};
+    receive_header.msg_namelen = sizeof(sockaddr_in);
+    uint64_t event_value;
+    uint64_t timer_value;
+
+    StubIoUring ring;
+    if (!ring.create(256) ||
+      !ring.provide_buffers(0, buffers.data(), buffer_size, static_cast<uint16_t>(kBatchSize)))
+    {
+      RCUTILS_LOG_DEBUG_NAMED(
+        "rmw_stub_cpp", "io_uring unavailable, using epoll: %s", strerror(errno));
+      return false;
+    }
+    prepare_receive(ring, receive_header);
+    prepare_read(ring, event_fd_, &event_value, kEventData);
+    prepare_read(ring, timer_fd_, &timer_value, kTimerData);
+    if (handoff_fd_ >= 0) {
+      prepare_poll(ring, handoff_fd_, kHandoffData);
+    }
+
+    bool received = false;
+    bool send_due = false;
+    bool heartbeat_due = false;
+    size_t sending = 0;
+    while (true) {
+      if (ring.enter(1) < 0 && errno != EBUSY && errno != EAGAIN) {
+        RCUTILS_LOG_ERROR_NAMED(
+          "rmw_stub_cpp", "io_uring failed, using epoll: %s", strerror(errno));
+        return false;
+      }
+
+      for (const io_uring_cqe * cqe = ring.get_cqe(); cqe; cqe = ring.get_cqe()) {
+        const uint64_t data = cqe->user_data;
+        const int32_t result = cqe->res;
+        const uint32_t flags = cqe->flags;
+        ring.cqe_seen();
+
+        if (data == kReceiveData) {
+          if (flags & IORING_CQE_F_BUFFER) {
+            const uint16_t id = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+            receive_buffer(ring.get_buffer(id), receive_header);
+            ring.recycle_buffer(id);
+            received = true;
+          }
+          // Multishot receives stop when the buffers run out
+          if (!(flags & IORING_CQE_F_MORE)) {
+            if (result == -EINVAL && !received) {
+              RCUTILS_LOG_DEBUG_NAMED(
+                "rmw_stub_cpp", "io_uring multishot receives unsupported, using epoll");
+              return false;
+            }
+            prepare_receive(ring, receive_header);
+          }
+        } else if (data == kEventData) {
+          send_due = true;
+          prepare_read(ring, event_fd_, &event_value, kEventData);
+        } else if (data == kTimerData) {
+          heartbeat_due = true;
+          prepare_read(ring, timer_fd_, &timer_value, kTimerData);
+        } else if (data == kHandoffData) {
+          receive_handoffs();
+          prepare_poll(ring, handoff_fd_, kHandoffData);
+        } else if (data == kSendData) {
+          sending--;
+          if (result < 0 && result != -ECONNREFUSED) {
+            RCUTILS_LOG_WARN_NAMED("rmw_stub_cpp", "UDP send failed: %s", strerror(-result));
+          }
+        }
+      }
+      if (stop_) {
+        return true;
+      }
+
+      // The messages being sent can't change until they're all sent
+      if (sending == 0 && (send_due || heartbeat_due)) {
+        if (build_batch(heartbeat_due)) {
+          for (mmsghdr & message : messages_) {
+            io_uring_sqe * sqe = ring.get_sqe();
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = fd_;
+            sqe->addr = reinterpret_cast<uint64_t>(&message.msg_hdr);
+            sqe->len = 1;
+            sqe->user_data = kSendData;
+            sending++;
+          }
+        }
+        send_due = false;
+        heartbeat_due = false;
+      }
+    }
+  }
+
+  void prepare_receive(StubIoUring & ring, msghdr & header)
+  {
+    io_uring_sqe * sqe = ring.get_sqe();
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = fd_;
+    sqe->addr = reinterpret_cast<uint64_t>(&header);
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = kReceiveData;
+  }
+
+  static void prepare_read(StubIoUring & ring, int fd, uint64_t * value, uint64_t data)
+  {
+    io_uring_sqe * sqe = ring.get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(value);
+    sqe->len = sizeof(*value);
+    sqe->off = static_cast<uint64_t>(-1);
+    sqe->user_data = data;
+  }
+
+  // Few samples are handed off: they're received once the socket is readable
+  static void prepare_poll(StubIoUring & ring, int fd, uint64_t data)
+  {
+    io_uring_sqe * sqe = ring.get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = data;
+  }
+
+  void receive_buffer(const uint8_t * buffer, const msghdr & header)
+  {
+    io_uring_recvmsg_out out;
+    memcpy(&out, buffer, sizeof(out));
+    if (out.flags & MSG_TRUNC || out.namelen < sizeof(sockaddr_in)) {
+      return;
+    }
+    sockaddr_in source;
+    memcpy(&source, buffer + sizeof(out), sizeof(source));
+    receive(
+      buffer + sizeof(out) + header.msg_namelen + header.msg_controllen, out.payloadlen, source);
+  }
+#endif  // STUB_HAS_IO_URING
+
+  void receive(const uint8_t * datagram, size_t size, const sockaddr_in & source)
+  {
+    uint32_t magic = 0;
+    if (size >= sizeof(magic)) {
+      memcpy(&magic, datagram, sizeof(magic));
+    }
+    if (magic == kMagic) {
+      receive_datagram(datagram, size);
+    } else if (magic == kHeartbeatMagic) {
+      receive_heartbeat(datagram, size, source);
+    } else if (magic == kNackMagic) {
+      receive_nack(datagram, size, source);
+    } else if (magic == kSubscriptionsMagic) {
+      receive_subscriptions(datagram, size, source);
+    }
+  }
+
+  void receive_subscriptions(const uint8_t * datagram, size_t size, const sockaddr_in & source)
+  {
+    StubUdpSubscriptions header;
+    if (size < sizeof(header)) {
+      return;
+    }
+    memcpy(&header, datagram, sizeof(header));
+    if (header.sender_id == sender_id_ ||
+      size < sizeof(header) + header.topic_count * sizeof(uint64_t))
+    {
+      return;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < header.topic_count; i++) {
+      uint64_t topic_hash;
+      memcpy(&topic_hash, datagram + sizeof(header) + i * sizeof(topic_hash), sizeof(topic_hash));
+
+      std::vector<RemoteSubscriber> & subscribers = remote_subscribers_[topic_hash];
+      auto subscriber = std::find_if(
+        subscribers.begin(), subscribers.end(), [&source](const RemoteSubscriber & known) {
+          return known.address.sin_addr.s_addr == source.sin_addr.s_addr &&
+          known.address.sin_port == source.sin_port;
+        });
+      if (subscriber != subscribers.end()) {
+        subscriber->process_id = header.sender_id;
+        subscriber->last_seen = now;
+        continue;
+      }
+      subscribers.push_back({source, header.sender_id, now, now});
+      if (subscribers.size() == 1) {
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        remote_topics_.insert(topic_hash);
+      }
+    }
+  }
+
+  void receive_datagram(const uint8_t * datagram, size_t size)
+  {
+    StubUdpHeader header;
+    if (size < sizeof(header)) {
+      return;
+    }
+    memcpy(&header, datagram, sizeof(header));
+    const size_t payload_size = size - sizeof(header);
+    if (header.sender_id == sender_id_ || header.sample_size > max_sample_size_ ||
+      header.fragment_offset + payload_size > header.sample_size)
+    {
+      return;
+    }
+    const uint8_t * payload = datagram + sizeof(header);
+
+    // Samples received already: sent again for another peer, or received
+    // from two paths
+    StubReaderWindow * window = &get_reader_window(header);
+    if (window->has_received(header.sequence_number)) {
+      return;
+    }
+
+    // Whole samples skip the reassembly
+    if (payload_size == header.sample_size) {
+      std::shared_ptr<StubTopic> topic = get_topic(header.topic_hash);
+      if (topic) {
+        auto sample = create_sample(header, topic);
+        memcpy(sample->data(), payload, payload_size);
+        deliver(*window, *topic, std::move(sample));
+      }
+      return;
+    }
+
+    SampleKey key(header.sender_id, header.topic_hash, header.publisher_id, header.sequence_number);
+    auto it = partial_samples_.find(key);
+    if (it == partial_samples_.end()) {
+      std::shared_ptr<StubTopic> topic = get_topic(header.topic_hash);
+      if (!topic) {
+        return;
+      }
+      // The sample is allocated before its fragments are all received
+      if (StubTopic::exceeds_memory_budget(header.sample_size)) {
+        return;
+      }
+      if (partial_samples_.size() >= kMaxPartialSamples) {
+        drop_oldest_partial_sample();
+      }
+      it = partial_samples_.emplace(
+        key, PartialSample{create_sample(header, topic), topic, {}, 0, partial_age_++}).first;
+    }
+
+    PartialSample & partial = it->second;
+    if (!partial.fragments.insert(header.fragment_offset).second) {
+      return;
+    }
+    memcpy(partial.sample->data() + header.fragment_offset, payload, payload_size);
+    partial.received += payload_size;
+    if (partial.received >= header.sample_size) {
+      deliver(*window, *partial.topic, std::move(partial.sample));
+      partial_samples_.erase(it);
+    }
+  }
+
+  StubReaderWindow & get_reader_window(const StubUdpHeader & header)
+  {
+    RemoteStreamKey stream(header.sender_id, header.topic_hash, header.publisher_id);
+    auto it = reader_windows_.find(stream);
+    if (it == reader_windows_.end()) {
+      it = reader_windows_.emplace(stream, StubReaderWindow(header.sequence_number)).first;
+    }
+    it->second.mark_active();
+    return it->second;
+  }
+
+  // Until the unix socket has no more samples handed off
+  void receive_handoffs()
+  {
+    while (true) {
+      StubUdpHeader header;
+      iovec iov = {&header, sizeof(header)};
+      alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+      msghdr message = {};
+      message.msg_iov = &iov;
+      message.msg_iovlen = 1;
+      message.msg_control = control;
+      message.msg_controllen = sizeof(control);
+
+      ssize_t size = recvmsg(handoff_fd_, &message, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+      if (size < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno != EAGAIN) {
+          RCUTILS_LOG_WARN_NAMED("rmw_stub_cpp", "memfd receive failed: %s", strerror(errno));
+        }
+        return;
+      }
+      int fd = -1;
+      cmsghdr * cmsg = CMSG_FIRSTHDR(&message);
+      if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(int)))
+      {
+        memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+      }
+      if (fd < 0) {
+        continue;
+      }
+      if (static_cast<size_t>(size) != sizeof(header) || header.magic != kHandoffMagic ||
+        header.sender_id == sender_id_)
+      {
+        close(fd);
+        continue;
+      }
+      receive_handoff(header, fd);
+    }
+  }
+
+  // Taking the fd of the memfd
+  void receive_handoff(const StubUdpHeader & header, int fd)
+  {
+    StubReaderWindow & window = get_reader_window(header);
+    std::shared_ptr<StubTopic> topic = get_topic(header.topic_hash);
+    if (!topic || window.has_received(header.sequence_number)) {
+      close(fd);
+      return;
+    }
+    std::unique_ptr<StubSharedBuffer> buffer = StubSharedBuffer::map(fd, header.sample_size);
+    if (!buffer) {
+      return;
+    }
+    auto sample = std::make_shared<StubSample>(
+      std::move(buffer), header.publisher_id, header.sequence_number, header.source_timestamp,
+      topic->get_memory_account());
+    sample->set_process_id(header.sender_id);
+    deliver(window, *topic, std::move(sample));
+  }
+
+  // Publish a sample received to the local subscriptions. Full RELIABLE +
+  // KEEP_ALL ones are never overwritten: the sample is only marked received
+  // once published, so that it's NACKed and sent again until they have room.
+  void deliver(StubReaderWindow & window, StubTopic & topic, std::shared_ptr<StubSample> sample)
+  {
+    const int64_t sequence_number = sample->get_sequence_number();
+    if (topic.publish(std::move(sample), true, std::chrono::nanoseconds(0)) == RMW_RET_OK) {
+      window.receive(sequence_number);
+    }
+  }
+
+  // Answer with NACKs of the samples missed
+  void receive_heartbeat(const uint8_t * datagram, size_t size, const sockaddr_in & source)
+  {
+    StubUdpHeartbeat heartbeat;
+    if (size < sizeof(heartbeat)) {
+      return;
+    }
+    memcpy(&heartbeat, datagram, sizeof(heartbeat));
+    if (heartbeat.sender_id == sender_id_ || !get_topic(heartbeat.topic_hash)) {
+      return;
+    }
+
+    // Like the samples published before a subscription, the ones queued
+    // before the writer knew of it aren't missed
+    RemoteStreamKey stream(heartbeat.sender_id, heartbeat.topic_hash, heartbeat.publisher_id);
+    auto it = reader_windows_.find(stream);
+    if (it == reader_windows_.end()) {
+      it = reader_windows_.emplace(
+        stream, StubReaderWindow(heartbeat.first_sequence_number)).first;
+    }
+
+    StubUdpNack nack = {};
+    nack.magic = kNackMagic;
+    nack.sender_id = heartbeat.sender_id;
+    nack.topic_hash = heartbeat.topic_hash;
+    nack.publisher_id = heartbeat.publisher_id;
+    StubReaderWindow & window = it->second;
+    window.mark_active();
+    window.on_heartbeat(heartbeat.first_sequence_number);
+    const int64_t last = std::min(
+      heartbeat.last_sequence_number, window.get_base() + StubReaderWindow::kWindowSize - 1);
+    const int64_t first = window.begin_nack(heartbeat_period_, last);
+    for (int64_t begin = first; begin <= last; begin += StubUdpNack::kBitmapSize) {
+      if (window.get_missing(begin, last, nack)) {
+        sendto(
+          fd_, &nack, sizeof(nack), 0, reinterpret_cast<const sockaddr *>(&source),
+          sizeof(source));
+      }
+    }
+  }
+
+  // Send the samples NACKed again, to the peer which NACKed them only, unless
+  // they were already sent again in this heartbeat period
+  void receive_nack(const uint8_t * datagram, size_t size, const sockaddr_in & source)
+  {
+    StubUdpNack nack;
+    if (size < sizeof(nack)) {
+      return;
+    }
+    memcpy(&nack, datagram, sizeof(nack));
+    if (nack.sender_id != sender_id_) {
+      return;
+    }
+
+    std::vector<Outgoing> resent;
+    {
+      std::lock_guard<std::mutex> lock(histories_mutex_);
+      auto it = histories_.find(StreamKey(nack.topic_hash, nack.publisher_id));
+      if (it == histories_.end()) {
+        return;
+      }
+      for (int64_t bit = 0; bit < StubUdpNack::kBitmapSize; bit++) {
+        if (!(nack.bitmap[bit / 64] & (1ull << (bit % 64)))) {
+          continue;
+        }
+        auto sample = it->second.resend(nack.base_sequence_number + bit, heartbeat_period_);
+        if (sample) {
+          resent.push_back({nack.topic_hash, std::move(sample), true, true, source});
+        }
+      }
+    }
+    if (resent.empty()) {
+      return;
+    }
+    bool was_empty;
+    {
+      std::lock_guard<std::mutex> lock(send_mutex_);
+      was_empty = send_queue_.empty();
+      send_queue_.insert(
+        send_queue_.end(), std::make_move_iterator(resent.begin()),
+        std::make_move_iterator(resent.end()));
+    }
+    if (was_empty) {
+      wake();
+    }
+  }
+
+  static std::shared_ptr<StubSample> create_sample(
+    const StubUdpHeader & header, const std::shared_ptr<StubTopic> & topic)
+  {
+    auto sample = std::make_shared<StubSample>(
+      header.sample_size, header.publisher_id, header.sequence_number, header.source_timestamp,
+      topic->get_memory_account());
+    sample->set_process_id(header.sender_id);
+    return sample;
+  }
+
+  std::shared_ptr<StubTopic> get_topic(uint64_t topic_hash)
+  {
+    std::lock_guard<std::mutex> lock(topics_mutex_);
+    auto it = topics_.find(topic_hash);
+    if (it == topics_.end()) {
+      return nullptr;
+    }
+    std::shared_ptr<StubTopic> topic = it->second.topic.lock();
+    if (!topic) {
+      topics_.erase(it);
+    }
+    return topic;
+  }
+
+  // Its missing fragments were lost
+  void drop_oldest_partial_sample()
+  {
+    auto oldest = std::min_element(
+      partial_samples_.begin(), partial_samples_.end(),
+      [](const std::pair<const SampleKey, PartialSample> & a,
+      const std::pair<const SampleKey, PartialSample> & b) {
+        return a.second.age < b.second.age;
+      });
+    partial_samples_.erase(oldest);
+  }
+
+  int fd_{-1};
+  // Receives the memfds of samples from the processes of the host, -1 if
+  // they're only sent over UDP
+  int handoff_fd_{-1};
+  // Wakes the I/O thread up
+  int event_fd_{-1};
+  // Expires every udp_heartbeat_period
+  int timer_fd_{-1};
+  uint64_t sender_id_;
+  size_t datagram_size_;
+  // Sample bytes per datagram
+  size_t fragment_size_;
+  // Datagrams per sendmmsg() message, 1 without UDP GSO
+  size_t gso_segments_{1};
+  std::vector<sockaddr_in> peers_;
+  std::atomic<bool> stop_{false};
+  // Set if the I/O thread exited on an error
+  std::atomic<bool> failed_{false};
+  // udp_drop, only used by the I/O thread
+  double drop_{StubOptions::get().udp_drop};
+  const size_t queue_size_{StubOptions::get().udp_queue_size};
+  // Larger samples announced by a datagram header are ignored
+  const size_t max_sample_size_{StubOptions::get().udp_max_sample_size};
+  std::mt19937_64 drop_generator_;
+  std::thread thread_;
+
+  std::mutex send_mutex_;
+  std::vector<Outgoing> send_queue_;
+  // Topics some peer subscribes to
+  std::unordered_set<uint64_t> remote_topics_;
+
+  std::mutex topics_mutex_;
+  std::unordered_map<uint64_t, LocalTopic> topics_;
+  // Set when a topic gets subscribed to, for the peers to be told
+  std::atomic<bool> announce_{false};
+
+  std::mutex histories_mutex_;
+  std::map<StreamKey, StubWriterHistory> histories_;
+
+  // Only used by the I/O thread, reused from batch to batch
+  std::vector<Outgoing> outgoing_;
+  std::vector<StubUdpHeader> headers_;
+  std::vector<StubUdpHeartbeat> heartbeats_;
+  std::vector<sockaddr_in> heartbeat_destinations_;
+  std::set<StreamKey> streams_;
+  std::vector<iovec> iovecs_;
+  std::vector<mmsghdr> messages_;
+  // Index of the first iovec of each message, and its destination
+  std::vector<size_t> first_iovecs_;
+  std::vector<sockaddr_in> destinations_;
+  // Of each subscriber of a sample, whether it got the sample's memfd
+  std::vector<bool> handed_off_;
+  std::vector<uint64_t> topic_hashes_;
+  std::vector<uint64_t> subscriptions_;
+  std::unordered_map<uint64_t, std::vector<RemoteSubscriber>> remote_subscribers_;
+  std::chrono::steady_clock::duration subscription_timeout_;
+  std::map<SampleKey, PartialSample> partial_samples_;
+  uint64_t partial_age_{0};
+  std::map<RemoteStreamKey, StubReaderWindow> reader_windows_;
+  // Heartbeat periods elapsed, from 1
+  uint64_t heartbeat_period_{1};
+};
+
+#endif  // STUB_UDP_TRANSPORT_HPP_
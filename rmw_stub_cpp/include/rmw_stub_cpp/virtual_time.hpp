@@ -0,0 +1,32 @@
+#ifndef RMW_STUB_CPP__VIRTUAL_TIME_HPP_
+#define RMW_STUB_CPP__VIRTUAL_TIME_HPP_
+
+#include <chrono>
+
+#include "rmw/types.h"
+
+namespace rmw_stub_cpp
+{
+
+// Whether the process runs on virtual time, set with RMW_STUB_VIRTUAL_TIME=1.
+// Published samples, requests and responses are then only delivered when
+// virtual time is advanced, in the order they were sent, and their
+// timestamps are virtual time.
+bool
+is_virtual_time();
+
+// Current virtual time, starting at 0 when the process starts
+rmw_time_point_value_t
+get_virtual_time();
+
+// Move virtual time forward by `duration`, delivering what was sent before
+// and what these deliveries cause in turn (including request timeouts),
+// in a reproducible order. `events_run`, if not null, gets the number of
+// deliveries and timeouts.
+// Returns RMW_RET_UNSUPPORTED if the process doesn't run on virtual time.
+rmw_ret_t
+advance_virtual_time(std::chrono::nanoseconds duration, size_t * events_run = nullptr);
+
+}  // namespace rmw_stub_cpp
+
+#endif  // RMW_STUB_CPP__VIRTUAL_TIME_HPP_
@@ -0,0 +1,22 @@
+#ifndef RMW_STUB_CPP__WAIT_FOR_SERVICE_HPP_
+#define RMW_STUB_CPP__WAIT_FOR_SERVICE_HPP_
+
+#include <chrono>
+
+#include "rmw/types.h"
+
+namespace rmw_stub_cpp
+{
+
+// Block until the service of a client has a server, or the timeout expires.
+// Sleeps until a server is created, instead of polling
+// rmw_service_server_is_available().
+rmw_ret_t
+wait_for_service_server(
+  const rmw_client_t * client,
+  std::chrono::nanoseconds timeout,
+  bool * is_available);
+
+}  // namespace rmw_stub_cpp
+
+#endif  // RMW_STUB_CPP__WAIT_FOR_SERVICE_HPP_
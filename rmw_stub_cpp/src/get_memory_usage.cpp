@@ -0,0 +1,53 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "rmw_stub_cpp/get_memory_usage.hpp"
+#include "rmw_stub_cpp/stub_memory_account.hpp"
+#include "rmw_stub_cpp/stub_topic.hpp"
+
+namespace rmw_stub_cpp
+{
+
+std::vector<TopicMemoryUsage>
+get_topic_memory_usage()
+{
+  std::vector<TopicMemoryUsage> usage;
+
+  for (auto & topic : StubTopicRegistry::instance().get_topics()) {
+    const auto & account = topic->get_memory_account();
+    if (account->get_samples() > 0) {
+      usage.push_back({topic->get_topic_name(), account->get_samples(), account->get_bytes()});
+    }
+  }
+
+  std::sort(
+    usage.begin(), usage.end(),
+    [](const TopicMemoryUsage & a, const TopicMemoryUsage & b) {
+      return a.bytes > b.bytes;
+    });
+
+  return usage;
+}
+
+TopicMemoryUsage
+get_process_memory_usage()
+{
+  return {"", StubMemoryAccount::get_process_samples(), StubMemoryAccount::get_process_bytes()};
+}
+
+}  // namespace rmw_stub_cpp
@@ -0,0 +1,243 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "rmw_stub_cpp/message_view.hpp"
+#include "rmw_stub_cpp/stub_type_support.hpp"
+
+namespace rmw_stub_cpp
+{
+
+using MessageMember = StubTypeSupport::MessageMember;
+using MessageMembers = StubTypeSupport::MessageMembers;
+using BufferReader = StubTypeSupport::BufferReader;
+
+namespace ts = rosidl_typesupport_introspection_cpp;
+
+MessageView::MessageView(
+  const rmw_serialized_message_t * serialized_message,
+  const rosidl_message_type_support_t * type_support)
+{
+  StubTypeSupport * stub_type_support = StubTypeSupport::get(type_support);
+  if (!stub_type_support ||
+    !StubTypeSupport::check_encapsulation(
+      serialized_message->buffer, serialized_message->buffer_length))
+  {
+    return;
+  }
+
+  payload_ = serialized_message->buffer + StubTypeSupport::kEncapsulationSize;
+  size_ = serialized_message->buffer_length - StubTypeSupport::kEncapsulationSize;
+  members_ = stub_type_support->get_members();
+}
+
+MessageView::MessageView(
+  std::shared_ptr<const void> owner, const uint8_t * payload, size_t size,
+  const void * members, size_t offset)
+: owner_(std::move(owner)), payload_(payload), size_(size), members_(members), offset_(offset)
+{
+}
+
+FieldView
+MessageView::get_field(const char * name) const
+{
+  FieldView field;
+  if (!is_valid()) {
+    return field;
+  }
+
+  auto members = static_cast<const MessageMembers *>(members_);
+  BufferReader reader(payload_, size_);
+  reader.offset = offset_;
+
+  for (uint32_t i = 0; i < members->member_count_; i++) {
+    const MessageMember & member = members->members_[i];
+    if (strcmp(member.name_, name) == 0) {
+      field.message_ = *this;
+      field.member_ = &member;
+      field.offset_ = reader.offset;
+      return field;
+    }
+    if (!StubTypeSupport::skip_member(member, reader)) {
+      break;
+    }
+  }
+
+  return field;
+}
+
+FieldView
+MessageView::operator[](const char * name) const
+{
+  return get_field(name);
+}
+
+uint8_t
+FieldView::get_type_id() const
+{
+  return is_valid() ? static_cast<const MessageMember *>(member_)->type_id_ : 0;
+}
+
+bool
+FieldView::is_array() const
+{
+  return is_valid() && static_cast<const MessageMember *>(member_)->is_array_;
+}
+
+size_t
+FieldView::size() const
+{
+  if (!is_valid()) {
+    return 0;
+  }
+
+  auto & member = *static_cast<const MessageMember *>(member_);
+  if (!member.is_array_) {
+    return 1;
+  }
+  if (!StubTypeSupport::is_sequence(member)) {
+    return member.array_size_;
+  }
+
+  BufferReader reader(message_.payload_, message_.size_);
+  reader.offset = offset_;
+  uint32_t length = 0;
+  if (!reader.align(4) || !reader.read(&length, sizeof(length))) {
+    return 0;
+  }
+  return length;
+}
+
+bool
+FieldView::locate(size_t index, size_t & offset) const
+{
+  if (!is_valid()) {
+    return false;
+  }
+
+  auto & member = *static_cast<const MessageMember *>(member_);
+  BufferReader reader(message_.payload_, message_.size_);
+  reader.offset = offset_;
+
+  size_t count = 1;
+  if (member.is_array_) {
+    count = member.array_size_;
+    if (StubTypeSupport::is_sequence(member)) {
+      uint32_t length;
+      if (!reader.align(4) || !reader.read(&length, sizeof(length))) {
+        return false;
+      }
+      count = length;
+    }
+  }
+  if (index >= count) {
+    return false;
+  }
+
+  // Primitives have a fixed size: jump straight to the element
+  size_t primitive_size = StubTypeSupport::get_primitive_size(member.type_id_);
+  if (primitive_size > 0) {
+    if (member.type_id_ != ts::ROS_TYPE_BOOLEAN &&
+      !reader.align(StubTypeSupport::get_alignment(primitive_size)))
+    {
+      return false;
+    }
+    if (index >= reader.get_remaining() / primitive_size) {
+      return false;
+    }
+    offset = reader.offset + index * primitive_size;
+    return true;
+  }
+
+  for (size_t i = 0; i < index; i++) {
+    if (!StubTypeSupport::skip_element(member, reader)) {
+      return false;
+    }
+  }
+  offset = reader.offset;
+  return true;
+}
+
+bool
+FieldView::get_bytes(void * value, size_t value_size, size_t index) const
+{
+  auto member = static_cast<const MessageMember *>(member_);
+  size_t offset;
+  if (!member || StubTypeSupport::get_primitive_size(member->type_id_) != value_size ||
+    !locate(index, offset))
+  {
+    return false;
+  }
+
+  memcpy(value, message_.payload_ + offset, value_size);
+  return true;
+}
+
+bool
+FieldView::get_string(std::string & value, size_t index) const
+{
+  size_t offset;
+  if (get_type_id() != ts::ROS_TYPE_STRING || !locate(index, offset)) {
+    return false;
+  }
+
+  BufferReader reader(message_.payload_, message_.size_);
+  reader.offset = offset;
+  uint32_t length;
+  if (!reader.align(4) || !reader.read(&length, sizeof(length)) ||
+    length > reader.get_remaining())
+  {
+    return false;
+  }
+
+  // Strip the null terminator
+  value.assign(
+    reinterpret_cast<const char *>(message_.payload_ + reader.offset),
+    length > 0 ? length - 1 : 0);
+  return true;
+}
+
+MessageView
+FieldView::get_message(size_t index) const
+{
+  size_t offset;
+  if (get_type_id() != ts::ROS_TYPE_MESSAGE || !locate(index, offset)) {
+    return MessageView();
+  }
+
+  auto & member = *static_cast<const MessageMember *>(member_);
+  return MessageView(
+    message_.owner_, message_.payload_, message_.size_,
+    StubTypeSupport::get_nested_members(member), offset);
+}
+
+const void *
+FieldView::data() const
+{
+  auto member = static_cast<const MessageMember *>(member_);
+  size_t offset;
+  if (!member || StubTypeSupport::get_primitive_size(member->type_id_) == 0 ||
+    !locate(0, offset))
+  {
+    return nullptr;
+  }
+
+  return message_.payload_ + offset;
+}
+
+}  // namespace rmw_stub_cpp
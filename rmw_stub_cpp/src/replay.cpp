@@ -0,0 +1,43 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+
+#include "rmw/error_handling.h"
+
+#include "rmw_stub_cpp/replay.hpp"
+#include "rmw_stub_cpp/stub_replayer.hpp"
+
+namespace rmw_stub_cpp
+{
+
+rmw_ret_t
+replay(const std::string & directory, const ReplayOptions & options)
+{
+  if (options.rate < 0) {
+    RMW_SET_ERROR_MSG("replay rate must not be negative");
+    return RMW_RET_INVALID_ARGUMENT;
+  }
+
+  StubReplayer replayer(directory, options.rate, options.topics);
+  if (!replayer.is_valid()) {
+    RMW_SET_ERROR_MSG_WITH_FORMAT_STRING("no recorded topics to replay in '%s'", directory.c_str());
+    return RMW_RET_ERROR;
+  }
+
+  replayer.replay();
+  return RMW_RET_OK;
+}
+
+}  // namespace rmw_stub_cpp
@@ -26,6 +26,7 @@
 #include "rmw/names_and_types.h"
 #include "rmw/rmw.h"
 #include "rmw/sanity_checks.h"
+#include "rmw/serialized_message.h"
 #include "rmw/types.h"
 #include "rmw/validate_namespace.h"
 #include "rmw/validate_node_name.h"
@@ -39,15 +40,30 @@
 #include "rmw_dds_common/msg/participant_entities_info.hpp"
 
 #include "rosidl_typesupport_cpp/message_type_support.hpp"
-
+#include "rosidl_typesupport_introspection_cpp/identifier.hpp"
+#include "rosidl_typesupport_introspection_cpp/service_introspection.hpp"
+
+#include "rmw_stub_cpp/get_memory_usage.hpp"
+#include "rmw_stub_cpp/message_view.hpp"
+#include "rmw_stub_cpp/request_timeout.hpp"
+#include "rmw_stub_cpp/wait_for_service.hpp"
+#include "rmw_stub_cpp/stub_async_writer.hpp"
 #include "rmw_stub_cpp/stub_client.hpp"
 #include "rmw_stub_cpp/stub_context_implementation.hpp"
 #include "rmw_stub_cpp/stub_event.hpp"
 #include "rmw_stub_cpp/stub_guard_condition.hpp"
+#include "rmw_stub_cpp/stub_message_copy.hpp"
 #include "rmw_stub_cpp/stub_node.hpp"
+#include "rmw_stub_cpp/stub_options.hpp"
 #include "rmw_stub_cpp/stub_publisher.hpp"
+#include "rmw_stub_cpp/stub_recorder.hpp"
+#include "rmw_stub_cpp/stub_scheduler.hpp"
 #include "rmw_stub_cpp/stub_service.hpp"
+#include "rmw_stub_cpp/stub_service_registry.hpp"
 #include "rmw_stub_cpp/stub_subscription.hpp"
+#include "rmw_stub_cpp/stub_topic.hpp"
+#include "rmw_stub_cpp/stub_type_support.hpp"
+#include "rmw_stub_cpp/stub_udp_transport.hpp"
 
 using namespace std::literals::chrono_literals;
 
@@ -60,23 +76,41 @@ using rmw_dds_common::msg::ParticipantEntitiesInfo;
 const char * const stub_identifier = "rmw_stub_cpp";
 const char * const stub_serialization_format = "cdr";
 
-static const char ROS_TOPIC_PREFIX[] = "rt";
-
 // /////////////////////////////////////////////////////////////////////////////////////////
 // ///////////                                                                   ///////////
 // ///////////    STATIC FUNCTIONS                                               ///////////
 // ///////////                                                                   ///////////
 // /////////////////////////////////////////////////////////////////////////////////////////
 
+// "package/msg/Type", or empty without introspection type support
+static std::string get_type_name(const StubTypeSupport * type_support)
+{
+  if (!type_support) {
+    return "";
+  }
+  std::string type_name = type_support->get_members()->message_namespace_;
+  for (size_t i = type_name.find("::"); i != std::string::npos; i = type_name.find("::", i)) {
+    type_name.replace(i, 2, "/");
+  }
+  return type_name + "/" + type_support->get_members()->message_name_;
+}
+
 static rmw_publisher_t * create_publisher(
   const rmw_qos_profile_t * qos_policies,
   const rmw_publisher_options_t * publisher_options,
   const rosidl_message_type_support_t * type_supports,
   const char * topic_name)
 {
-  (void)type_supports;
-
   auto * stub_pub = new StubPublisher(qos_policies, topic_name);
+  stub_pub->set_type_support(StubTypeSupport::get(type_supports));
+
+  auto topic = StubTopicRegistry::instance().get_topic(topic_name);
+  topic->add_publisher();
+  stub_pub->set_topic(topic);
+
+  stub_pub->set_injection(StubInjector::instance().get_injection(topic_name));
+  stub_pub->set_record_topic_id(
+    StubRecorder::instance().get_topic_id(topic_name, get_type_name(stub_pub->get_type_support())));
 
   rmw_publisher_t * rmw_publisher = rmw_publisher_allocate();
 
@@ -94,6 +128,15 @@ static rmw_publisher_t * create_publisher(
 static void destroy_publisher(rmw_publisher_t * publisher)
 {
   auto stub_pub = static_cast<StubPublisher *>(publisher->data);
+  // Its samples queued on the writer thread still use it
+  if (stub_pub->is_async()) {
+    StubAsyncWriter::instance().flush();
+  }
+  stub_pub->get_topic()->remove_publisher();
+  if (stub_pub->is_udp() && stub_pub->is_reliable()) {
+    StubUdpTransport::instance().remove_publisher(
+      stub_pub->get_topic_hash(), stub_pub->get_pub_id());
+  }
   delete stub_pub;
   rmw_free(const_cast<char *>(publisher->topic_name));
   rmw_publisher_free(publisher);
@@ -105,9 +148,16 @@ static rmw_subscription_t * create_subscription(
   const rosidl_message_type_support_t * type_supports,
   const char * topic_name)
 {
-  (void)type_supports;
-
   auto * stub_sub = new StubSubscription(qos_policies, topic_name);
+  stub_sub->set_type_support(StubTypeSupport::get(type_supports));
+
+  auto topic = StubTopicRegistry::instance().get_topic(topic_name);
+  topic->add_subscription(stub_sub);
+  stub_sub->set_topic(topic);
+
+  if (stub_sub->is_udp()) {
+    StubUdpTransport::instance().add_topic(topic);
+  }
 
   rmw_subscription_t * rmw_subscription = rmw_subscription_allocate();
 
@@ -125,20 +175,297 @@ static rmw_subscription_t * create_subscription(
 static void destroy_subscription(rmw_subscription_t * subscription)
 {
   auto stub_sub = static_cast<StubSubscription *>(subscription->data);
+  stub_sub->get_topic()->remove_subscription(stub_sub);
+  if (stub_sub->is_udp()) {
+    StubUdpTransport::instance().remove_topic(stub_sub->get_topic());
+  }
   delete stub_sub;
   rmw_free(const_cast<char *>(subscription->topic_name));
   rmw_subscription_free(subscription);
 }
 
-static std::string mangle_topic_name(
-  const char * prefix, const char * topic_name, const char * suffix,
-  bool avoid_ros_namespace_conventions)
+// Tell which topic holds most of the memory when the process budget is exceeded
+static void set_memory_budget_error()
 {
-  if (avoid_ros_namespace_conventions) {
-    return std::string(topic_name) + std::string(suffix);
+  auto process_usage = rmw_stub_cpp::get_process_memory_usage();
+  auto topics_usage = rmw_stub_cpp::get_topic_memory_usage();
+
+  if (topics_usage.empty()) {
+    RMW_SET_ERROR_MSG_WITH_FORMAT_STRING(
+      "process memory budget exceeded: %zu samples, %zu bytes held",
+      process_usage.samples, process_usage.bytes);
   } else {
-    return std::string(prefix) + std::string(topic_name) + std::string(suffix);
+    RMW_SET_ERROR_MSG_WITH_FORMAT_STRING(
+      "process memory budget exceeded: %zu samples, %zu bytes held, "
+      "%zu samples, %zu bytes by topic '%s'",
+      process_usage.samples, process_usage.bytes,
+      topics_usage.front().samples, topics_usage.front().bytes,
+      topics_usage.front().topic_name.c_str());
+  }
+}
+
+// Copy a sample to the recording. Synchronous publishers leave the copy to
+// the asynchronous writer's thread if their queue has room, but in virtual
+// time, where the recording is written in publish order.
+static void record_sample(StubPublisher * stub_pub, const std::shared_ptr<StubSample> & sample)
+{
+  const int32_t topic_id = stub_pub->get_record_topic_id();
+  if (!stub_pub->is_async() && !StubScheduler::instance().is_virtual() &&
+    StubAsyncWriter::instance().try_submit(
+      stub_pub->get_topic(), [topic_id, sample]() {
+        StubRecorder::instance().record(topic_id, *sample);
+        return RMW_RET_OK;
+      }))
+  {
+    return;
+  }
+  StubRecorder::instance().record(topic_id, *sample);
+}
+
+// Record a sample and send it to the other processes. Sets `deliver` if
+// the local subscriptions are to get it now, rather than lost or left to the
+// scheduler. Returns RMW_RET_TIMEOUT, without sending it, if the scheduler
+// would deliver it to full subscriptions.
+static rmw_ret_t send_sample(
+  StubPublisher * stub_pub, const std::shared_ptr<StubSample> & sample,
+  std::chrono::nanoseconds timeout, bool & deliver)
+{
+  deliver = false;
+  // Injected and virtual time samples may go through the scheduler, which
+  // doesn't wait for full subscriptions
+  if (stub_pub->get_injection() || StubScheduler::instance().is_virtual()) {
+    rmw_ret_t ret = stub_pub->wait_for_room(sample->size(), timeout);
+    if (RMW_RET_OK != ret) {
+      return ret;
+    }
+  }
+
+  // Written: processes of the host may now map it, read only
+  if (sample->get_shared_buffer()) {
+    sample->get_shared_buffer()->seal();
+  }
+  if (stub_pub->get_record_topic_id() >= 0) {
+    record_sample(stub_pub, sample);
+  }
+  if (stub_pub->is_udp()) {
+    StubUdpTransport::instance().send(
+      stub_pub->get_topic_hash(), sample, stub_pub->is_reliable(), stub_pub->get_history_depth());
+  }
+
+  std::chrono::nanoseconds delay(0);
+  if (stub_pub->get_injection() && !stub_pub->get_injection()->get_delay(delay)) {
+    // Lost on the way, as far as the publisher knows
+    return RMW_RET_OK;
+  }
+
+  // Delayed samples are delivered by the scheduler, as all samples in
+  // virtual time
+  if (delay.count() > 0 || StubScheduler::instance().is_virtual()) {
+    stub_pub->schedule_delivery(sample, delay);
+    return RMW_RET_OK;
+  }
+  deliver = true;
+  return RMW_RET_OK;
+}
+
+// Record, send and deliver a sample on the publishing thread
+static rmw_ret_t deliver_sample(StubPublisher * stub_pub, std::shared_ptr<StubSample> sample)
+{
+  const std::chrono::nanoseconds timeout = StubOptions::get().publish_timeout;
+  bool deliver;
+  rmw_ret_t ret = send_sample(stub_pub, sample, timeout, deliver);
+  if (RMW_RET_OK != ret || !deliver) {
+    return ret;
+  }
+  return stub_pub->get_topic()->publish(std::move(sample), stub_pub->is_reliable(), timeout);
+}
+
+// Same on the asynchronous writer's thread, which runs it again while it
+// returns RMW_RET_TIMEOUT rather than waiting for full subscriptions.
+// `sent` keeps the sample from being recorded and sent again.
+static rmw_ret_t deliver_sample_async(
+  StubPublisher * stub_pub, const std::shared_ptr<StubSample> & sample, bool & sent)
+{
+  if (!sent) {
+    bool deliver;
+    rmw_ret_t ret = send_sample(stub_pub, sample, std::chrono::nanoseconds(0), deliver);
+    if (RMW_RET_OK != ret) {
+      return ret;
+    }
+    sent = true;
+    if (!deliver) {
+      return RMW_RET_OK;
+    }
+  }
+  return stub_pub->get_topic()->publish(
+    sample, stub_pub->is_reliable(), std::chrono::nanoseconds(0));
+}
+
+static rmw_ret_t publish_sample(
+  StubPublisher * stub_pub, std::shared_ptr<StubSample> sample, const char * function_name)
+{
+  rmw_ret_t ret;
+  if (stub_pub->is_async()) {
+    ret = StubAsyncWriter::instance().submit(
+      stub_pub->get_topic(), [stub_pub, sample, sent = false]() mutable {
+        return deliver_sample_async(stub_pub, sample, sent);
+      });
+  } else {
+    ret = deliver_sample(stub_pub, std::move(sample));
+  }
+
+  if (RMW_RET_TIMEOUT == ret) {
+    RMW_SET_ERROR_MSG_WITH_FORMAT_STRING(
+      "%s: timed out waiting for a full queue", function_name);
+  } else if (RMW_RET_ERROR == ret) {
+    set_memory_budget_error();
+  }
+
+  return ret;
+}
+
+static void fill_message_info(const StubSample & sample, rmw_message_info_t * message_info)
+{
+  rmw_time_point_value_t now = StubScheduler::instance().now();
+
+  message_info->source_timestamp = sample.get_source_timestamp();
+  message_info->received_timestamp = now;
+  message_info->from_intra_process = false;
+  message_info->publisher_gid.implementation_identifier = stub_identifier;
+  fill_gid(sample.get_process_id(), sample.get_publisher_id(), &message_info->publisher_gid);
+}
+
+static rmw_ret_t take_serialized_message(
+  const rmw_subscription_t * subscription,
+  rmw_serialized_message_t * serialized_message,
+  bool * taken,
+  rmw_message_info_t * message_info)
+{
+  RMW_CHECK_ARGUMENT_FOR_NULL(subscription, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(serialized_message, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(taken, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    subscription,
+    subscription->implementation_identifier,
+    stub_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+
+  *taken = false;
+
+  auto stub_sub = static_cast<StubSubscription *>(subscription->data);
+  auto sample = stub_sub->get_topic()->take(stub_sub);
+
+  if (!sample) {
+    return RMW_RET_OK;
+  }
+
+  if (serialized_message->buffer_capacity < sample->size()) {
+    rmw_ret_t ret = rmw_serialized_message_resize(serialized_message, sample->size());
+    if (RMW_RET_OK != ret) {
+      return ret;
+    }
+  }
+
+  StubParallelCopy::copy(serialized_message->buffer, sample->data(), sample->size());
+  serialized_message->buffer_length = sample->size();
+
+  if (message_info) {
+    fill_message_info(*sample, message_info);
+  }
+
+  *taken = true;
+  return RMW_RET_OK;
+}
+
+static rmw_ret_t take_message(
+  const rmw_subscription_t * subscription,
+  void * ros_message,
+  bool * taken,
+  rmw_message_info_t * message_info)
+{
+  RMW_CHECK_ARGUMENT_FOR_NULL(subscription, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(ros_message, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(taken, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    subscription,
+    subscription->implementation_identifier,
+    stub_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+
+  *taken = false;
+
+  auto stub_sub = static_cast<StubSubscription *>(subscription->data);
+  StubTypeSupport * type_support = stub_sub->get_type_support();
+  if (!type_support) {
+    RMW_SET_ERROR_MSG("take: no introspection type support for this subscription");
+    return RMW_RET_UNSUPPORTED;
+  }
+
+  auto sample = stub_sub->get_topic()->take(stub_sub);
+
+  if (!sample) {
+    return RMW_RET_OK;
+  }
+
+  if (!type_support->deserialize(sample->data(), sample->size(), ros_message)) {
+    RMW_SET_ERROR_MSG("take: failed to deserialize the sample");
+    return RMW_RET_ERROR;
+  }
+
+  if (message_info) {
+    fill_message_info(*sample, message_info);
+  }
+
+  *taken = true;
+  return RMW_RET_OK;
+}
+
+// Returns nullptr if the service has no C++ introspection type support
+static const rosidl_typesupport_introspection_cpp::ServiceMembers * get_service_members(
+  const rosidl_service_type_support_t * type_supports)
+{
+  const rosidl_service_type_support_t * introspection = get_service_typesupport_handle(
+    type_supports, rosidl_typesupport_introspection_cpp::typesupport_identifier);
+  if (!introspection) {
+    rcutils_reset_error();
+    return nullptr;
   }
+  return static_cast<const rosidl_typesupport_introspection_cpp::ServiceMembers *>(
+    introspection->data);
+}
+
+static StubServiceMessage create_service_message(
+  const rosidl_typesupport_introspection_cpp::MessageMembers * members,
+  const void * ros_message,
+  const rmw_request_id_t & request_id)
+{
+  rmw_time_point_value_t now = StubScheduler::instance().now();
+
+  return {StubMessageCopy::clone(members, ros_message), request_id, now};
+}
+
+// Hand a taken request or response over to the caller's message
+static void take_service_message(
+  const rosidl_typesupport_introspection_cpp::MessageMembers * members,
+  StubServiceMessage & service_message,
+  void * ros_message,
+  rmw_service_info_t * service_info)
+{
+  // A timeout response has no message: the caller's is left as is
+  if (service_message.message) {
+    // A message no other server holds can be moved rather than copied
+    if (service_message.message.use_count() == 1) {
+      StubMessageCopy::move_message(members, service_message.message.get(), ros_message);
+    } else {
+      StubMessageCopy::copy_message(members, service_message.message.get(), ros_message);
+    }
+  }
+
+  rmw_time_point_value_t now = StubScheduler::instance().now();
+
+  service_info->source_timestamp = service_message.source_timestamp;
+  service_info->received_timestamp = now;
+  service_info->request_id = service_message.request_id;
 }
 
 // /////////////////////////////////////////////////////////////////////////////////////////
@@ -382,6 +709,10 @@ rmw_ret_t rmw_init(const rmw_init_options_t * options, rmw_context_t * context)
   auto restore_context = rcpputils::make_scope_exit(
     [context]() {*context = rmw_get_zero_initialized_context();});
 
+  // Read the environment and RMW_STUB_CONFIG now rather than when the first
+  // endpoint is created
+  StubOptions::get();
+
   context->instance_id = options->instance_id;
   context->implementation_identifier = stub_identifier;
   // No custom handling of RMW_DEFAULT_DOMAIN_ID. Simply use a reasonable domain id.
@@ -460,7 +791,7 @@ rmw_node_t * rmw_create_node(
   auto finalize_context = rcpputils::make_scope_exit(
     [context]() {context->impl->fini();});
 
-  auto * stub_node = new StubNode();
+  auto * stub_node = new StubNode(stub_identifier);
 
   rmw_node_t * node = rmw_node_allocate();
 
@@ -515,12 +846,26 @@ rmw_ret_t rmw_get_serialized_message_size(
   const rosidl_message_type_support_t * type_support,
   const rosidl_runtime_c__Sequence__bound * message_bounds, size_t * size)
 {
-  static_cast<void>(type_support);
   static_cast<void>(message_bounds);
-  static_cast<void>(size);
 
-  RMW_SET_ERROR_MSG("rmw_get_serialized_message_size: not implemented");
-  return RMW_RET_UNSUPPORTED;
+  RMW_CHECK_ARGUMENT_FOR_NULL(type_support, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(size, RMW_RET_INVALID_ARGUMENT);
+
+  StubTypeSupport * stub_type_support = StubTypeSupport::get(type_support);
+  if (!stub_type_support) {
+    RMW_SET_ERROR_MSG(
+      "rmw_get_serialized_message_size: no introspection type support for this type");
+    return RMW_RET_UNSUPPORTED;
+  }
+
+  // Only the size of fixed size types is known without a message
+  if (!stub_type_support->is_fixed_size()) {
+    RMW_SET_ERROR_MSG("rmw_get_serialized_message_size: not a fixed size type");
+    return RMW_RET_UNSUPPORTED;
+  }
+
+  *size = stub_type_support->get_fixed_serialized_size();
+  return RMW_RET_OK;
 }
 
 rmw_ret_t rmw_serialize(
@@ -528,11 +873,28 @@ rmw_ret_t rmw_serialize(
   const rosidl_message_type_support_t * type_support,
   rmw_serialized_message_t * serialized_message)
 {
-  (void)ros_message;
-  (void)type_support;
-  (void)serialized_message;
-  RMW_SET_ERROR_MSG("rmw_serialize: not implemented");
-  return RMW_RET_UNSUPPORTED;
+  RMW_CHECK_ARGUMENT_FOR_NULL(ros_message, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(type_support, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(serialized_message, RMW_RET_INVALID_ARGUMENT);
+
+  StubTypeSupport * stub_type_support = StubTypeSupport::get(type_support);
+  if (!stub_type_support) {
+    RMW_SET_ERROR_MSG("rmw_serialize: no introspection type support for this type");
+    return RMW_RET_UNSUPPORTED;
+  }
+
+  size_t size = stub_type_support->get_serialized_size(ros_message);
+  if (serialized_message->buffer_capacity < size) {
+    rmw_ret_t ret = rmw_serialized_message_resize(serialized_message, size);
+    if (RMW_RET_OK != ret) {
+      return ret;
+    }
+  }
+
+  stub_type_support->serialize(ros_message, serialized_message->buffer);
+  serialized_message->buffer_length = size;
+
+  return RMW_RET_OK;
 }
 
 rmw_ret_t rmw_deserialize(
@@ -540,11 +902,24 @@ rmw_ret_t rmw_deserialize(
   const rosidl_message_type_support_t * type_support,
   void * ros_message)
 {
-  (void)serialized_message;
-  (void)type_support;
-  (void)ros_message;
-  RMW_SET_ERROR_MSG("rmw_deserialize: not implemented");
-  return RMW_RET_UNSUPPORTED;
+  RMW_CHECK_ARGUMENT_FOR_NULL(serialized_message, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(type_support, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(ros_message, RMW_RET_INVALID_ARGUMENT);
+
+  StubTypeSupport * stub_type_support = StubTypeSupport::get(type_support);
+  if (!stub_type_support) {
+    RMW_SET_ERROR_MSG("rmw_deserialize: no introspection type support for this type");
+    return RMW_RET_UNSUPPORTED;
+  }
+
+  if (!stub_type_support->deserialize(
+      serialized_message->buffer, serialized_message->buffer_length, ros_message))
+  {
+    RMW_SET_ERROR_MSG("rmw_deserialize: invalid serialized message");
+    return RMW_RET_ERROR;
+  }
+
+  return RMW_RET_OK;
 }
 
 // /////////////////////////////////////////////////////////////////////////////////////////
@@ -557,24 +932,86 @@ rmw_ret_t rmw_publish(
   const rmw_publisher_t * publisher, const void * ros_message,
   rmw_publisher_allocation_t * allocation)
 {
-  (void)publisher;
-  (void)ros_message;
   (void)allocation;
 
-  RMW_SET_ERROR_MSG("rmw_publish not implemented");
-  return RMW_RET_UNSUPPORTED;
+  RMW_CHECK_ARGUMENT_FOR_NULL(publisher, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(ros_message, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    publisher,
+    publisher->implementation_identifier,
+    stub_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+
+  auto stub_pub = static_cast<StubPublisher *>(publisher->data);
+  StubTypeSupport * type_support = stub_pub->get_type_support();
+  if (!type_support) {
+    RMW_SET_ERROR_MSG("rmw_publish: no introspection type support for this publisher");
+    return RMW_RET_UNSUPPORTED;
+  }
+
+  // Asynchronous publishers serialize a copy of the message on the writer thread
+  if (stub_pub->is_async()) {
+    std::shared_ptr<void> message = StubMessageCopy::clone(
+      type_support->get_members(), ros_message);
+    rmw_ret_t ret = StubAsyncWriter::instance().submit(
+      stub_pub->get_topic(),
+      [stub_pub, type_support, message, sample = std::shared_ptr<StubSample>(),
+      sent = false]() mutable {
+        if (!sample) {
+          size_t size = type_support->get_serialized_size(message.get());
+          if (StubTopic::exceeds_memory_budget(size)) {
+            return RMW_RET_ERROR;
+          }
+          sample = stub_pub->create_sample(size);
+          type_support->serialize(message.get(), sample->data());
+        }
+        return deliver_sample_async(stub_pub, sample, sent);
+      });
+    if (RMW_RET_TIMEOUT == ret) {
+      RMW_SET_ERROR_MSG("rmw_publish: timed out waiting for a full queue");
+    }
+    return ret;
+  }
+
+  size_t size = type_support->get_serialized_size(ros_message);
+  if (StubTopic::exceeds_memory_budget(size)) {
+    set_memory_budget_error();
+    return RMW_RET_ERROR;
+  }
+
+  // Serialize straight into the sample shared with the subscriptions
+  auto sample = stub_pub->create_sample(size);
+  type_support->serialize(ros_message, sample->data());
+
+  return publish_sample(stub_pub, std::move(sample), "rmw_publish");
 }
 
 rmw_ret_t rmw_publish_serialized_message(
   const rmw_publisher_t * publisher,
   const rmw_serialized_message_t * serialized_message, rmw_publisher_allocation_t * allocation)
 {
-  (void)publisher;
-  (void)serialized_message;
   (void)allocation;
 
-  RMW_SET_ERROR_MSG("rmw_publish_serialized_message: not implemented");
-  return RMW_RET_UNSUPPORTED;
+  RMW_CHECK_ARGUMENT_FOR_NULL(publisher, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(serialized_message, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    publisher,
+    publisher->implementation_identifier,
+    stub_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+
+  auto stub_pub = static_cast<StubPublisher *>(publisher->data);
+
+  if (StubTopic::exceeds_memory_budget(serialized_message->buffer_length)) {
+    set_memory_budget_error();
+    return RMW_RET_ERROR;
+  }
+
+  auto sample = stub_pub->create_sample(serialized_message->buffer_length);
+  StubParallelCopy::copy(
+    sample->data(), serialized_message->buffer, serialized_message->buffer_length);
+
+  return publish_sample(stub_pub, std::move(sample), "rmw_publish_serialized_message");
 }
 
 rmw_ret_t rmw_publish_loaned_message(
@@ -672,13 +1109,8 @@ rmw_ret_t rmw_get_gid_for_publisher(const rmw_publisher_t * publisher, rmw_gid_t
 
   gid->implementation_identifier = stub_identifier;
 
-  memset(gid->data, 0, sizeof(gid->data));
-
   auto stub_pub = static_cast<const StubPublisher *>(publisher->data);
-
-  assert(sizeof(stub_pub->get_pub_id()) <= sizeof(gid->data));
-
-  memcpy(gid->data, stub_pub->get_pub_id_ptr(), sizeof(stub_pub->get_pub_id()));
+  fill_gid(get_process_id(), stub_pub->get_pub_id(), gid);
 
   return RMW_RET_OK;
 }
@@ -718,7 +1150,9 @@ rmw_ret_t rmw_publisher_count_matched_subscriptions(
     stub_identifier,
     return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
 
-  *subscription_count = 0;
+  auto stub_pub = static_cast<StubPublisher *>(publisher->data);
+
+  *subscription_count = stub_pub->get_topic()->get_subscription_count();
 
   return RMW_RET_OK;
 }
@@ -882,11 +1316,19 @@ rmw_ret_t rmw_subscription_set_on_new_message_callback(
 rmw_ret_t rmw_subscription_count_matched_publishers(
   const rmw_subscription_t * subscription, size_t * publisher_count)
 {
-  (void)subscription;
-  (void)publisher_count;
+  RMW_CHECK_ARGUMENT_FOR_NULL(subscription, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(publisher_count, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    subscription,
+    subscription->implementation_identifier,
+    stub_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
 
-  RMW_SET_ERROR_MSG("rmw_subscription_count_matched_publishers: not implemented");
-  return RMW_RET_UNSUPPORTED;
+  auto stub_sub = static_cast<StubSubscription *>(subscription->data);
+
+  *publisher_count = stub_sub->get_topic()->get_publisher_count();
+
+  return RMW_RET_OK;
 }
 
 rmw_ret_t rmw_subscription_get_actual_qos(
@@ -932,13 +1374,9 @@ rmw_ret_t rmw_take(
   const rmw_subscription_t * subscription, void * ros_message,
   bool * taken, rmw_subscription_allocation_t * allocation)
 {
-  (void)subscription;
-  (void)ros_message;
-  (void)taken;
   (void)allocation;
 
-  RMW_SET_ERROR_MSG("rmw_take: not implemented");
-  return RMW_RET_UNSUPPORTED;
+  return take_message(subscription, ros_message, taken, nullptr);
 }
 
 rmw_ret_t rmw_take_with_info(
@@ -946,14 +1384,11 @@ rmw_ret_t rmw_take_with_info(
   bool * taken, rmw_message_info_t * message_info,
   rmw_subscription_allocation_t * allocation)
 {
-  (void)subscription;
-  (void)ros_message;
-  (void)taken;
-  (void)message_info;
   (void)allocation;
 
-  RMW_SET_ERROR_MSG("rmw_take_with_info: not implemented");
-  return RMW_RET_UNSUPPORTED;
+  RMW_CHECK_ARGUMENT_FOR_NULL(message_info, RMW_RET_INVALID_ARGUMENT);
+
+  return take_message(subscription, ros_message, taken, message_info);
 }
 
 rmw_ret_t rmw_take_sequence(
@@ -962,15 +1397,38 @@ rmw_ret_t rmw_take_sequence(
   rmw_message_info_sequence_t * message_info_sequence,
   size_t * taken, rmw_subscription_allocation_t * allocation)
 {
-  (void)subscription;
-  (void)count;
-  (void)message_sequence;
-  (void)message_info_sequence;
-  (void)taken;
   (void)allocation;
 
-  RMW_SET_ERROR_MSG("rmw_take_sequence: not implemented");
-  return RMW_RET_UNSUPPORTED;
+  RMW_CHECK_ARGUMENT_FOR_NULL(message_sequence, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(message_info_sequence, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(taken, RMW_RET_INVALID_ARGUMENT);
+
+  if (0u == count || count > message_sequence->capacity ||
+    count > message_info_sequence->capacity)
+  {
+    RMW_SET_ERROR_MSG("rmw_take_sequence: invalid count");
+    return RMW_RET_INVALID_ARGUMENT;
+  }
+
+  *taken = 0;
+  while (*taken < count) {
+    bool taken_flag = false;
+    rmw_ret_t ret = take_message(
+      subscription, message_sequence->data[*taken], &taken_flag,
+      &message_info_sequence->data[*taken]);
+    if (RMW_RET_OK != ret) {
+      return ret;
+    }
+    if (!taken_flag) {
+      break;
+    }
+    (*taken)++;
+  }
+
+  message_sequence->size = *taken;
+  message_info_sequence->size = *taken;
+
+  return RMW_RET_OK;
 }
 
 rmw_ret_t rmw_take_serialized_message(
@@ -979,13 +1437,9 @@ rmw_ret_t rmw_take_serialized_message(
   bool * taken,
   rmw_subscription_allocation_t * allocation)
 {
-  (void)subscription;
-  (void)serialized_message;
-  (void)taken;
   (void)allocation;
 
-  RMW_SET_ERROR_MSG("rmw_take_serialized_message: not implemented");
-  return RMW_RET_UNSUPPORTED;
+  return take_serialized_message(subscription, serialized_message, taken, nullptr);
 }
 
 rmw_ret_t rmw_take_serialized_message_with_info(
@@ -993,14 +1447,11 @@ rmw_ret_t rmw_take_serialized_message_with_info(
   rmw_serialized_message_t * serialized_message, bool * taken, rmw_message_info_t * message_info,
   rmw_subscription_allocation_t * allocation)
 {
-  (void)subscription;
-  (void)serialized_message;
-  (void)message_info;
-  (void)taken;
   (void)allocation;
 
-  RMW_SET_ERROR_MSG("rmw_take_serialized_message_with_info: not implemented");
-  return RMW_RET_UNSUPPORTED;
+  RMW_CHECK_ARGUMENT_FOR_NULL(message_info, RMW_RET_INVALID_ARGUMENT);
+
+  return take_serialized_message(subscription, serialized_message, taken, message_info);
 }
 
 rmw_ret_t rmw_take_loaned_message(
@@ -1170,13 +1621,33 @@ rmw_ret_t rmw_take_response(
   rmw_service_info_t * request_header, void * ros_response,
   bool * taken)
 {
-  (void)client;
-  (void)request_header;
-  (void)ros_response;
-  (void)taken;
+  RMW_CHECK_ARGUMENT_FOR_NULL(client, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(request_header, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(ros_response, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(taken, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    client,
+    client->implementation_identifier,
+    stub_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
 
-  RMW_SET_ERROR_MSG("rmw_take_response not implemented");
-  return RMW_RET_UNSUPPORTED;
+  *taken = false;
+
+  auto stub_client = static_cast<StubClient *>(client->data);
+  if (!stub_client->get_members()) {
+    RMW_SET_ERROR_MSG("rmw_take_response: no introspection type support for this client");
+    return RMW_RET_UNSUPPORTED;
+  }
+  StubServiceMessage response;
+  if (!stub_client->take_response(response)) {
+    return RMW_RET_OK;
+  }
+
+  take_service_message(
+    stub_client->get_members()->response_members_, response, ros_response, request_header);
+
+  *taken = true;
+  return RMW_RET_OK;
 }
 
 
@@ -1185,37 +1656,116 @@ rmw_ret_t rmw_take_request(
   rmw_service_info_t * request_header, void * ros_request,
   bool * taken)
 {
-  (void)service;
-  (void)request_header;
-  (void)ros_request;
-  (void)taken;
+  RMW_CHECK_ARGUMENT_FOR_NULL(service, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(request_header, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(ros_request, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(taken, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    service,
+    service->implementation_identifier,
+    stub_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
 
-  RMW_SET_ERROR_MSG("rmw_take_request not implemented");
-  return RMW_RET_UNSUPPORTED;
+  *taken = false;
+
+  auto stub_service = static_cast<StubService *>(service->data);
+  if (!stub_service->get_members()) {
+    RMW_SET_ERROR_MSG("rmw_take_request: no introspection type support for this service");
+    return RMW_RET_UNSUPPORTED;
+  }
+  StubServiceMessage request;
+  if (!stub_service->take_request(request)) {
+    return RMW_RET_OK;
+  }
+
+  take_service_message(
+    stub_service->get_members()->request_members_, request, ros_request, request_header);
+
+  *taken = true;
+  return RMW_RET_OK;
 }
 
 rmw_ret_t rmw_send_response(
   const rmw_service_t * service,
   rmw_request_id_t * request_header, void * ros_response)
 {
-  (void)service;
-  (void)request_header;
-  (void)ros_response;
+  RMW_CHECK_ARGUMENT_FOR_NULL(service, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(request_header, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(ros_response, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    service,
+    service->implementation_identifier,
+    stub_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
 
-  RMW_SET_ERROR_MSG("rmw_send_response not implemented");
-  return RMW_RET_UNSUPPORTED;
+  auto stub_service = static_cast<StubService *>(service->data);
+  if (!stub_service->get_members()) {
+    RMW_SET_ERROR_MSG("rmw_send_response: no introspection type support for this service");
+    return RMW_RET_UNSUPPORTED;
+  }
+
+  // Responses to a client destroyed meanwhile are dropped
+  StubServiceMessage response = create_service_message(
+    stub_service->get_members()->response_members_, ros_response, *request_header);
+  if (StubScheduler::instance().is_virtual()) {
+    StubScheduler::instance().schedule_after(
+      std::chrono::nanoseconds(0),
+      [response]() {StubServiceRegistry::instance().send_response(response);});
+  } else {
+    StubServiceRegistry::instance().send_response(response);
+  }
+
+  return RMW_RET_OK;
 }
 
 rmw_ret_t rmw_send_request(
   const rmw_client_t * client, const void * ros_request,
   int64_t * sequence_id)
 {
-  (void)client;
-  (void)ros_request;
-  (void)sequence_id;
+  RMW_CHECK_ARGUMENT_FOR_NULL(client, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(ros_request, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(sequence_id, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    client,
+    client->implementation_identifier,
+    stub_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
 
-  RMW_SET_ERROR_MSG("rmw_send_response not implemented");
-  return RMW_RET_UNSUPPORTED;
+  auto stub_client = static_cast<StubClient *>(client->data);
+  if (!stub_client->get_members()) {
+    RMW_SET_ERROR_MSG("rmw_send_request: no introspection type support for this client");
+    return RMW_RET_UNSUPPORTED;
+  }
+  rmw_request_id_t request_id = stub_client->create_request_id();
+
+  std::chrono::nanoseconds timeout = stub_client->get_request_timeout();
+  if (timeout.count() > 0) {
+    uint64_t client_id = stub_client->get_client_id();
+    int64_t sequence_number = request_id.sequence_number;
+    stub_client->add_pending_request(sequence_number);
+    StubScheduler::instance().schedule_after(
+      timeout,
+      [client_id, sequence_number]() {
+        StubServiceRegistry::instance().expire_request(client_id, sequence_number);
+      });
+  }
+
+  // Like a request sent on the network, a request without servers is lost
+  StubServiceMessage request = create_service_message(
+    stub_client->get_members()->request_members_, ros_request, request_id);
+  if (StubScheduler::instance().is_virtual()) {
+    std::string service_name = stub_client->get_service_name();
+    StubScheduler::instance().schedule_after(
+      std::chrono::nanoseconds(0),
+      [service_name, request]() {
+        StubServiceRegistry::instance().send_request(service_name, request);
+      });
+  } else {
+    StubServiceRegistry::instance().send_request(stub_client->get_service_name(), request);
+  }
+
+  *sequence_id = request_id.sequence_number;
+  return RMW_RET_OK;
 }
 
 rmw_client_t * rmw_create_client(
@@ -1225,12 +1775,19 @@ rmw_client_t * rmw_create_client(
   const rmw_qos_profile_t * qos_policies)
 {
   (void)node;
-  (void)type_supports;
   (void)qos_policies;
 
+  RMW_CHECK_ARGUMENT_FOR_NULL(type_supports, nullptr);
+  RMW_CHECK_ARGUMENT_FOR_NULL(service_name, nullptr);
+
+  // Without C++ introspection type support, the handle is still created, but
+  // requests and responses are unsupported
+  auto members = get_service_members(type_supports);
+
   rmw_client_t * rmw_client = rmw_client_allocate();
   rmw_client->implementation_identifier = stub_identifier;
-  StubClient * stub_client = new StubClient();
+  StubClient * stub_client = new StubClient(service_name, members);
+  StubServiceRegistry::instance().add_client(stub_client);
   rmw_client->data = stub_client;
   rmw_client->service_name = reinterpret_cast<const char *>(rmw_allocate(strlen(service_name) + 1));
   memcpy(const_cast<char *>(rmw_client->service_name), service_name, strlen(service_name) + 1);
@@ -1242,7 +1799,8 @@ rmw_ret_t rmw_destroy_client(rmw_node_t * node, rmw_client_t * client)
 {
   (void)node;
 
-  auto stub_client = static_cast<StubService *>(client->data);
+  auto stub_client = static_cast<StubClient *>(client->data);
+  StubServiceRegistry::instance().remove_client(stub_client);
   delete stub_client;
   rmw_free(const_cast<char *>(client->service_name));
   rmw_client_free(client);
@@ -1256,15 +1814,19 @@ rmw_service_t * rmw_create_service(
   const rmw_qos_profile_t * qos_policies)
 {
   (void)node;
-  (void)type_supports;
   (void)qos_policies;
 
-  rmw_service_t * rmw_service = rmw_service_allocate();
-  rmw_service->implementation_identifier = stub_identifier;
-  StubService * stub_service = new StubService();
-  rmw_service->data = stub_service;
-  rmw_service->service_name = reinterpret_cast<const char *>(rmw_allocate(strlen(service_name) + 1));
-  memcpy(const_cast<char *>(rmw_service->service_name), service_name, strlen(service_name) + 1);
+  RMW_CHECK_ARGUMENT_FOR_NULL(type_supports, nullptr);
+  RMW_CHECK_ARGUMENT_FOR_NULL(service_name, nullptr);
+
+  // Without C++ introspection type support, the handle is still created, but
+  // requests and responses are unsupported
+  auto members = get_service_members(type_supports);
+
+  // The service holds its rmw handle and the name it points to
+  StubService * stub_service = new StubService(service_name, members, stub_identifier);
+  StubServiceRegistry::instance().add_service(stub_service);
+  rmw_service_t * rmw_service = stub_service->get_handle();
   return rmw_service;
 }
 
@@ -1273,9 +1835,8 @@ rmw_ret_t rmw_destroy_service(rmw_node_t * node, rmw_service_t * service)
   (void)node;
 
   auto stub_service = static_cast<StubService *>(service->data);
+  StubServiceRegistry::instance().remove_service(stub_service);
   delete stub_service;
-  rmw_free(const_cast<char *>(service->service_name));
-  rmw_service_free(service);
   return RMW_RET_OK;
 }
 
@@ -1346,12 +1907,20 @@ rmw_ret_t rmw_service_server_is_available(
   const rmw_client_t * client,
   bool * is_available)
 {
-  (void)node;
-  (void)client;
-  (void)is_available;
+  RMW_CHECK_ARGUMENT_FOR_NULL(node, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(client, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(is_available, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    client,
+    client->implementation_identifier,
+    stub_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
 
-  RMW_SET_ERROR_MSG("rmw_service_server_is_available not implemented");
-  return RMW_RET_UNSUPPORTED;
+  auto stub_client = static_cast<StubClient *>(client->data);
+  *is_available =
+    StubServiceRegistry::instance().get_server_count(stub_client->get_service_name()) > 0;
+
+  return RMW_RET_OK;
 }
 
 rmw_ret_t rmw_count_publishers(
@@ -1377,9 +1946,10 @@ rmw_ret_t rmw_count_publishers(
   }
   RMW_CHECK_ARGUMENT_FOR_NULL(count, RMW_RET_INVALID_ARGUMENT);
 
-  auto common_context = static_cast<rmw_dds_common::Context *>(node->context->impl->common);
-  const std::string mangled_topic_name = mangle_topic_name(ROS_TOPIC_PREFIX, topic_name, "", false);
-  return common_context->graph_cache.get_writer_count(mangled_topic_name, count);
+  auto topic = StubTopicRegistry::instance().find_topic(topic_name);
+  *count = topic ? topic->get_publisher_count() : 0;
+
+  return RMW_RET_OK;
 }
 
 rmw_ret_t rmw_count_subscribers(
@@ -1405,11 +1975,10 @@ rmw_ret_t rmw_count_subscribers(
   }
   RMW_CHECK_ARGUMENT_FOR_NULL(count, RMW_RET_INVALID_ARGUMENT);
 
-  auto common_context = static_cast<rmw_dds_common::Context *>(node->context->impl->common);
-
-  const std::string mangled_topic_name = mangle_topic_name(ROS_TOPIC_PREFIX, topic_name, "", false);
+  auto topic = StubTopicRegistry::instance().find_topic(topic_name);
+  *count = topic ? topic->get_subscription_count() : 0;
 
-  return common_context->graph_cache.get_reader_count(mangled_topic_name, count);
+  return RMW_RET_OK;
 }
 
 rmw_ret_t rmw_get_subscriber_names_and_types_by_node(
@@ -1561,3 +2130,100 @@ rmw_ret_t rmw_qos_profile_check_compatible(
   return RMW_RET_UNSUPPORTED;
 }
 }  // extern "C"
+
+namespace rmw_stub_cpp
+{
+
+rmw_ret_t
+take_message_view(
+  const rmw_subscription_t * subscription,
+  MessageView * message_view,
+  bool * taken,
+  rmw_message_info_t * message_info)
+{
+  RMW_CHECK_ARGUMENT_FOR_NULL(subscription, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(message_view, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(taken, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    subscription,
+    subscription->implementation_identifier,
+    stub_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+
+  *taken = false;
+
+  auto stub_sub = static_cast<StubSubscription *>(subscription->data);
+  StubTypeSupport * type_support = stub_sub->get_type_support();
+  if (!type_support) {
+    RMW_SET_ERROR_MSG("take_message_view: no introspection type support for this subscription");
+    return RMW_RET_UNSUPPORTED;
+  }
+
+  auto sample = stub_sub->get_topic()->take(stub_sub);
+
+  if (!sample) {
+    return RMW_RET_OK;
+  }
+
+  if (!StubTypeSupport::check_encapsulation(sample->data(), sample->size())) {
+    RMW_SET_ERROR_MSG("take_message_view: invalid sample");
+    return RMW_RET_ERROR;
+  }
+
+  if (message_info) {
+    fill_message_info(*sample, message_info);
+  }
+
+  // The view keeps the sample alive, in place of a deserialized copy
+  const uint8_t * payload = sample->data() + StubTypeSupport::kEncapsulationSize;
+  size_t size = sample->size() - StubTypeSupport::kEncapsulationSize;
+  *message_view = MessageView(std::move(sample), payload, size, type_support->get_members(), 0);
+
+  *taken = true;
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+wait_for_service_server(
+  const rmw_client_t * client,
+  std::chrono::nanoseconds timeout,
+  bool * is_available)
+{
+  RMW_CHECK_ARGUMENT_FOR_NULL(client, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_ARGUMENT_FOR_NULL(is_available, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    client,
+    client->implementation_identifier,
+    stub_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+
+  auto stub_client = static_cast<StubClient *>(client->data);
+  *is_available =
+    StubServiceRegistry::instance().wait_for_server(stub_client->get_service_name(), timeout);
+
+  return RMW_RET_OK;
+}
+
+rmw_ret_t
+set_request_timeout(const rmw_client_t * client, std::chrono::nanoseconds timeout)
+{
+  RMW_CHECK_ARGUMENT_FOR_NULL(client, RMW_RET_INVALID_ARGUMENT);
+  RMW_CHECK_TYPE_IDENTIFIERS_MATCH(
+    client,
+    client->implementation_identifier,
+    stub_identifier,
+    return RMW_RET_INCORRECT_RMW_IMPLEMENTATION);
+
+  auto stub_client = static_cast<StubClient *>(client->data);
+  stub_client->set_request_timeout(timeout);
+
+  return RMW_RET_OK;
+}
+
+bool
+is_timeout_response(const rmw_service_info_t * request_header)
+{
+  return request_header && StubClient::is_timeout(request_header->request_id);
+}
+
+}  // namespace rmw_stub_cpp
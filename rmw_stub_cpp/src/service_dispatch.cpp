@@ -0,0 +1,35 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+
+#include "rmw_stub_cpp/service_dispatch.hpp"
+#include "rmw_stub_cpp/stub_service_registry.hpp"
+
+namespace rmw_stub_cpp
+{
+
+void
+set_service_dispatch(const std::string & service_name, ServiceDispatch dispatch)
+{
+  StubServiceRegistry::instance().set_dispatch(service_name, dispatch);
+}
+
+ServiceDispatch
+get_service_dispatch(const std::string & service_name)
+{
+  return StubServiceRegistry::instance().get_dispatch(service_name);
+}
+
+}  // namespace rmw_stub_cpp
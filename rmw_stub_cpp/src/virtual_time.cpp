@@ -0,0 +1,54 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rmw/error_handling.h"
+
+#include "rmw_stub_cpp/stub_scheduler.hpp"
+#include "rmw_stub_cpp/virtual_time.hpp"
+
+namespace rmw_stub_cpp
+{
+
+bool
+is_virtual_time()
+{
+  return StubScheduler::instance().is_virtual();
+}
+
+rmw_time_point_value_t
+get_virtual_time()
+{
+  return is_virtual_time() ? StubScheduler::instance().now() : 0;
+}
+
+rmw_ret_t
+advance_virtual_time(std::chrono::nanoseconds duration, size_t * events_run)
+{
+  if (!is_virtual_time()) {
+    RMW_SET_ERROR_MSG("advance_virtual_time: not running on virtual time");
+    return RMW_RET_UNSUPPORTED;
+  }
+  if (duration.count() < 0) {
+    RMW_SET_ERROR_MSG("advance_virtual_time: time can't go backwards");
+    return RMW_RET_INVALID_ARGUMENT;
+  }
+
+  size_t count = StubScheduler::instance().advance(duration);
+  if (events_run) {
+    *events_run = count;
+  }
+  return RMW_RET_OK;
+}
+
+}  // namespace rmw_stub_cpp
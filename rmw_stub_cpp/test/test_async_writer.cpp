@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rmw/types.h"
+
+#include "rmw_stub_cpp/stub_async_writer.hpp"
+#include "rmw_stub_cpp/stub_sample.hpp"
+#include "rmw_stub_cpp/stub_subscription.hpp"
+#include "rmw_stub_cpp/stub_topic.hpp"
+
+// Run with RMW_STUB_KEEP_ALL_MAX_SAMPLES=2 and RMW_STUB_PUBLISH_TIMEOUT_MS=1000
+class TestAsyncWriter : public ::testing::Test
+{
+protected:
+  void TearDown() override
+  {
+    for (size_t i = 0; i < subscriptions_.size(); i++) {
+      topics_[i]->remove_subscription(subscriptions_[i].get());
+    }
+  }
+
+  std::shared_ptr<StubTopic> subscribe(
+    const std::string & suffix, rmw_qos_history_policy_t history, size_t depth)
+  {
+    const std::string topic_name = std::string("/") +
+      ::testing::UnitTest::GetInstance()->current_test_info()->name() + suffix;
+    qos_.emplace_back(new rmw_qos_profile_t());
+    qos_.back()->history = history;
+    qos_.back()->depth = depth;
+    qos_.back()->reliability = RMW_QOS_POLICY_RELIABILITY_RELIABLE;
+    topics_.push_back(StubTopicRegistry::instance().get_topic(topic_name));
+    subscriptions_.emplace_back(new StubSubscription(qos_.back().get(), topic_name.c_str()));
+    topics_.back()->add_subscription(subscriptions_.back().get());
+    return topics_.back();
+  }
+
+  // Queue a reliable publish from the calling thread, as asynchronous publishers do
+  static void submit(const std::shared_ptr<StubTopic> & topic, int64_t sequence_number)
+  {
+    auto sample = std::make_shared<StubSample>(
+      8, 0, sequence_number, 0, topic->get_memory_account());
+    ASSERT_EQ(
+      RMW_RET_OK, StubAsyncWriter::instance().submit(
+        topic, [topic, sample]() {
+          return topic->publish(sample, true, std::chrono::nanoseconds(0));
+        }));
+  }
+
+  // Wait up to `timeout` for a sample to take
+  std::shared_ptr<const StubSample> take(
+    const std::shared_ptr<StubTopic> & topic, std::chrono::milliseconds timeout)
+  {
+    StubSubscription * subscription = nullptr;
+    for (size_t i = 0; i < topics_.size(); i++) {
+      if (topics_[i] == topic) {
+        subscription = subscriptions_[i].get();
+      }
+    }
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+      auto sample = topic->take(subscription);
+      if (sample || std::chrono::steady_clock::now() >= deadline) {
+        return sample;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  std::vector<std::unique_ptr<rmw_qos_profile_t>> qos_;
+  std::vector<std::shared_ptr<StubTopic>> topics_;
+  std::vector<std::unique_ptr<StubSubscription>> subscriptions_;
+};
+
+// A publish waiting for a full RELIABLE + KEEP_ALL subscription holds up
+// the next ones of its thread, but not those of the other threads
+TEST_F(TestAsyncWriter, full_subscription_only_holds_up_its_thread) {
+  auto full = subscribe("_full", RMW_QOS_POLICY_HISTORY_KEEP_ALL, 0);
+  auto other = subscribe("_other", RMW_QOS_POLICY_HISTORY_KEEP_LAST, 10);
+
+  std::thread publisher([&]() {
+      for (int64_t i = 0; i < 3; i++) {
+        submit(full, i);
+      }
+      submit(other, 100);
+    });
+  publisher.join();
+
+  auto start = std::chrono::steady_clock::now();
+  submit(other, 200);
+  auto sample = take(other, std::chrono::milliseconds(900));
+  ASSERT_NE(nullptr, sample);
+  EXPECT_EQ(200, sample->get_sequence_number());
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(500));
+
+  // Taking a sample makes room for the third one, then the thread's next job runs
+  for (int64_t i = 0; i < 3; i++) {
+    sample = take(full, std::chrono::milliseconds(900));
+    ASSERT_NE(nullptr, sample);
+    EXPECT_EQ(i, sample->get_sequence_number());
+  }
+  sample = take(other, std::chrono::milliseconds(900));
+  ASSERT_NE(nullptr, sample);
+  EXPECT_EQ(100, sample->get_sequence_number());
+}
+
+TEST_F(TestAsyncWriter, full_subscription_times_out) {
+  auto full = subscribe("", RMW_QOS_POLICY_HISTORY_KEEP_ALL, 0);
+
+  for (int64_t i = 0; i < 3; i++) {
+    submit(full, i);
+  }
+  // The third sample is dropped after the publish timeout
+  auto start = std::chrono::steady_clock::now();
+  StubAsyncWriter::instance().flush();
+  EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(500));
+
+  for (int64_t i = 0; i < 2; i++) {
+    auto sample = take(full, std::chrono::milliseconds(0));
+    ASSERT_NE(nullptr, sample);
+    EXPECT_EQ(i, sample->get_sequence_number());
+  }
+  EXPECT_EQ(nullptr, take(full, std::chrono::milliseconds(0)));
+}
+
+TEST_F(TestAsyncWriter, try_submit_never_waits) {
+  auto full = subscribe("", RMW_QOS_POLICY_HISTORY_KEEP_ALL, 0);
+
+  // The third publish holds up the queue of this thread
+  for (int64_t i = 0; i < 3; i++) {
+    submit(full, i);
+  }
+  auto start = std::chrono::steady_clock::now();
+  size_t queued = 0;
+  for (int i = 0; i < 2000; i++) {
+    queued += StubAsyncWriter::instance().try_submit(full, []() {return RMW_RET_OK;});
+  }
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(500));
+  EXPECT_GT(queued, 0u);
+  EXPECT_LT(queued, 2000u);
+
+  take(full, std::chrono::milliseconds(0));
+  StubAsyncWriter::instance().flush();
+}
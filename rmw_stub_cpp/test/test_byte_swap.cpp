@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "rmw_stub_cpp/stub_byte_swap.hpp"
+
+// The vector kernels must swap exactly as the scalar reference does, for
+// any element size, array length and alignment of the array
+class TestByteSwap : public ::testing::TestWithParam<size_t>
+{
+protected:
+  static void expect_same_as_scalar(size_t element_size, size_t count, size_t offset)
+  {
+    std::vector<uint8_t> input(offset + count * element_size + 64);
+    for (size_t i = 0; i < input.size(); i++) {
+      input[i] = static_cast<uint8_t>(i * 7 + 3);
+    }
+    std::vector<uint8_t> expected = input;
+    std::vector<uint8_t> swapped = input;
+
+    StubByteSwap::swap_scalar(expected.data() + offset, count, element_size);
+    StubByteSwap::swap(swapped.data() + offset, count, element_size);
+
+    ASSERT_EQ(0, memcmp(expected.data(), swapped.data(), expected.size())) <<
+      "element size " << element_size << ", count " << count << ", offset " << offset;
+  }
+};
+
+TEST_P(TestByteSwap, matches_scalar) {
+  const size_t element_size = GetParam();
+  // Lengths around the 16 and 32 byte blocks of the SSSE3 and AVX2 kernels
+  for (size_t count = 0; count <= 130; count++) {
+    for (size_t offset = 0; offset < 8; offset++) {
+      expect_same_as_scalar(element_size, count, offset);
+    }
+  }
+}
+
+TEST_P(TestByteSwap, large_arrays) {
+  const size_t element_size = GetParam();
+  for (size_t size : {4096u, 4097u * 8u, 65536u + 24u}) {
+    expect_same_as_scalar(element_size, size / element_size, 1);
+    expect_same_as_scalar(element_size, size / element_size, 0);
+  }
+}
+
+TEST_P(TestByteSwap, swaps_twice_to_original) {
+  const size_t element_size = GetParam();
+  std::vector<uint8_t> original(1000 * element_size + 3);
+  for (size_t i = 0; i < original.size(); i++) {
+    original[i] = static_cast<uint8_t>(i);
+  }
+  std::vector<uint8_t> bytes = original;
+
+  StubByteSwap::swap(bytes.data() + 3, 1000, element_size);
+  EXPECT_NE(original, bytes);
+  StubByteSwap::swap(bytes.data() + 3, 1000, element_size);
+  EXPECT_EQ(original, bytes);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+  element_sizes, TestByteSwap, ::testing::Values<size_t>(2, 4, 8));
+
+TEST(TestByteSwapScalar, reverses_each_element) {
+  uint8_t bytes_2[] = {1, 2, 3, 4, 5, 6, 7, 8};
+  StubByteSwap::swap_scalar(bytes_2, 4, 2);
+  const uint8_t swapped_2[] = {2, 1, 4, 3, 6, 5, 8, 7};
+  EXPECT_EQ(0, memcmp(bytes_2, swapped_2, sizeof(bytes_2)));
+
+  uint8_t bytes_4[] = {1, 2, 3, 4, 5, 6, 7, 8};
+  StubByteSwap::swap_scalar(bytes_4, 2, 4);
+  const uint8_t swapped_4[] = {4, 3, 2, 1, 8, 7, 6, 5};
+  EXPECT_EQ(0, memcmp(bytes_4, swapped_4, sizeof(bytes_4)));
+
+  uint8_t bytes_8[] = {1, 2, 3, 4, 5, 6, 7, 8};
+  StubByteSwap::swap_scalar(bytes_8, 1, 8);
+  const uint8_t swapped_8[] = {8, 7, 6, 5, 4, 3, 2, 1};
+  EXPECT_EQ(0, memcmp(bytes_8, swapped_8, sizeof(bytes_8)));
+}
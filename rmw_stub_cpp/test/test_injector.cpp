@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "rmw_stub_cpp/stub_injector.hpp"
+
+namespace
+{
+
+std::vector<std::chrono::nanoseconds> draw(StubInjection & injection, size_t count)
+{
+  std::vector<std::chrono::nanoseconds> delays;
+  for (size_t i = 0; i < count; i++) {
+    std::chrono::nanoseconds delay(-1);
+    EXPECT_TRUE(injection.get_delay(delay));
+    delays.push_back(delay);
+  }
+  return delays;
+}
+
+}  // namespace
+
+class TestInjector : public ::testing::Test
+{
+protected:
+  // Before the injector reads them: delay /delayed, drop everything on
+  // /lost and reorder the other topics, next to an invalid entry
+  static void SetUpTestCase()
+  {
+    setenv(
+      "RMW_STUB_INJECT",
+      "/delayed:delay_us=500,jitter_us=100;/lost:drop=1;*:reorder=1,reorder_delay_us=2000;invalid",
+      1);
+    setenv("RMW_STUB_INJECT_SEED", "42", 1);
+  }
+};
+
+TEST_F(TestInjector, parses_settings) {
+  StubInjection injection;
+  EXPECT_TRUE(
+    StubInjector::parse_injection(
+      "delay_us=100,jitter_us=2.5,distribution=normal,drop=0.5,reorder=1,"
+      "reorder_delay_us=3000", injection));
+  EXPECT_EQ(std::chrono::microseconds(100), injection.delay);
+  EXPECT_EQ(std::chrono::nanoseconds(2500), injection.jitter);
+  EXPECT_EQ(StubInjection::Distribution::NORMAL, injection.distribution);
+  EXPECT_EQ(0.5, injection.drop);
+  EXPECT_EQ(1.0, injection.reorder);
+  EXPECT_EQ(std::chrono::milliseconds(3), injection.reorder_delay);
+
+  EXPECT_TRUE(StubInjector::parse_injection("", injection));
+  EXPECT_FALSE(StubInjector::parse_injection("delay_us", injection));
+  EXPECT_FALSE(StubInjector::parse_injection("delay_us=", injection));
+  EXPECT_FALSE(StubInjector::parse_injection("delay_us=-1", injection));
+  EXPECT_FALSE(StubInjector::parse_injection("delay_us=1ms", injection));
+  EXPECT_FALSE(StubInjector::parse_injection("drop=1.5", injection));
+  EXPECT_FALSE(StubInjector::parse_injection("distribution=pareto", injection));
+  EXPECT_FALSE(StubInjector::parse_injection("speed=1", injection));
+}
+
+TEST_F(TestInjector, topics_get_their_injection) {
+  StubInjection * delayed = StubInjector::instance().get_injection("/delayed");
+  ASSERT_NE(nullptr, delayed);
+  for (auto delay : draw(*delayed, 100)) {
+    EXPECT_GE(delay, std::chrono::microseconds(400));
+    EXPECT_LE(delay, std::chrono::microseconds(600));
+  }
+
+  StubInjection * lost = StubInjector::instance().get_injection("/lost");
+  ASSERT_NE(nullptr, lost);
+  std::chrono::nanoseconds delay(0);
+  EXPECT_FALSE(lost->get_delay(delay));
+
+  // Each of the other topics gets its own injection from the "*" template
+  StubInjection * other = StubInjector::instance().get_injection("/other");
+  ASSERT_NE(nullptr, other);
+  EXPECT_NE(other, StubInjector::instance().get_injection("/another"));
+  EXPECT_EQ(other, StubInjector::instance().get_injection("/other"));
+  EXPECT_EQ(
+    std::vector<std::chrono::nanoseconds>(3, std::chrono::milliseconds(2)), draw(*other, 3));
+}
+
+TEST_F(TestInjector, seeds_make_runs_reproducible) {
+  StubInjection first;
+  StubInjection second;
+  for (StubInjection * injection : {&first, &second}) {
+    StubInjector::parse_injection(
+      "delay_us=1000,jitter_us=500,distribution=exponential,drop=0.2", *injection);
+    injection->seed(7);
+  }
+
+  std::vector<bool> first_lost;
+  std::vector<bool> second_lost;
+  std::vector<std::chrono::nanoseconds> first_delays;
+  std::vector<std::chrono::nanoseconds> second_delays;
+  for (int i = 0; i < 100; i++) {
+    std::chrono::nanoseconds delay(0);
+    first_lost.push_back(!first.get_delay(delay));
+    first_delays.push_back(delay);
+    second_lost.push_back(!second.get_delay(delay));
+    second_delays.push_back(delay);
+  }
+  EXPECT_EQ(first_lost, second_lost);
+  EXPECT_EQ(first_delays, second_delays);
+
+  first.drop = 0;
+  second.drop = 0;
+  second.seed(8);
+  EXPECT_NE(draw(first, 10), draw(second, 10));
+}
+
+TEST_F(TestInjector, delays_are_never_negative) {
+  StubInjection injection;
+  ASSERT_TRUE(StubInjector::parse_injection("jitter_us=100", injection));
+  bool zero = false;
+  for (auto delay : draw(injection, 1000)) {
+    EXPECT_GE(delay.count(), 0);
+    EXPECT_LE(delay, std::chrono::microseconds(100));
+    zero = zero || delay.count() == 0;
+  }
+  EXPECT_TRUE(zero);
+}
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "rmw_stub_cpp/stub_mailbox.hpp"
+#include "rmw_stub_cpp/stub_memory_account.hpp"
+#include "rmw_stub_cpp/stub_sample.hpp"
+
+namespace
+{
+
+std::shared_ptr<const StubSample> make_sample(int64_t sequence_number)
+{
+  static auto memory_account = std::make_shared<StubMemoryAccount>();
+  return std::make_shared<StubSample>(8, 0, sequence_number, 0, memory_account);
+}
+
+}  // namespace
+
+TEST(TestMailbox, empty) {
+  StubLatestValueMailbox mailbox;
+  EXPECT_EQ(nullptr, mailbox.take());
+}
+
+TEST(TestMailbox, takes_each_sample_once) {
+  StubLatestValueMailbox mailbox;
+
+  mailbox.write(make_sample(1));
+  auto sample = mailbox.take();
+  ASSERT_NE(nullptr, sample);
+  EXPECT_EQ(1, sample->get_sequence_number());
+  EXPECT_EQ(nullptr, mailbox.take());
+}
+
+TEST(TestMailbox, write_reports_new_sample_to_read) {
+  StubLatestValueMailbox mailbox;
+
+  EXPECT_TRUE(mailbox.write(make_sample(1)));
+  // Overwriting an unread sample
+  EXPECT_FALSE(mailbox.write(make_sample(2)));
+  ASSERT_NE(nullptr, mailbox.take());
+  EXPECT_TRUE(mailbox.write(make_sample(3)));
+}
+
+TEST(TestMailbox, keeps_latest_sample) {
+  StubLatestValueMailbox mailbox;
+
+  for (int64_t i = 1; i <= 5; i++) {
+    mailbox.write(make_sample(i));
+  }
+  auto sample = mailbox.take();
+  ASSERT_NE(nullptr, sample);
+  EXPECT_EQ(5, sample->get_sequence_number());
+  EXPECT_EQ(nullptr, mailbox.take());
+
+  mailbox.write(make_sample(6));
+  sample = mailbox.take();
+  ASSERT_NE(nullptr, sample);
+  EXPECT_EQ(6, sample->get_sequence_number());
+}
+
+TEST(TestMailbox, releases_dropped_samples) {
+  StubLatestValueMailbox mailbox;
+
+  auto first = make_sample(1);
+  std::weak_ptr<const StubSample> weak_first = first;
+  mailbox.write(std::move(first));
+  // The buffers cycle: the overwritten sample is released once its buffer is reused
+  for (int64_t i = 2; i <= 4; i++) {
+    mailbox.write(make_sample(i));
+  }
+  EXPECT_TRUE(weak_first.expired());
+}
+
+// A single writer and a single reader: the reader never sees a sample older
+// than one it already took
+TEST(TestMailbox, concurrent_reader_sees_increasing_samples) {
+  StubLatestValueMailbox mailbox;
+  constexpr int64_t kSamples = 100000;
+  std::atomic<bool> done{false};
+
+  std::thread writer([&]() {
+      for (int64_t i = 1; i <= kSamples; i++) {
+        mailbox.write(make_sample(i));
+      }
+      done = true;
+    });
+
+  int64_t last = 0;
+  while (true) {
+    bool writer_done = done;
+    auto sample = mailbox.take();
+    if (sample) {
+      ASSERT_GT(sample->get_sequence_number(), last);
+      last = sample->get_sequence_number();
+    } else if (writer_done) {
+      break;
+    }
+  }
+  writer.join();
+  EXPECT_EQ(kSamples, last);
+}
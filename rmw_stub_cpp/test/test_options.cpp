@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "rmw/types.h"
+
+#include "rmw_stub_cpp/stub_options.hpp"
+#include "rmw_stub_cpp/stub_publisher.hpp"
+#include "rmw_stub_cpp/stub_subscription.hpp"
+
+class TestOptions : public ::testing::Test
+{
+protected:
+  // Before the options are read: a configuration file, some of whose
+  // settings the environment overrides
+  static void SetUpTestCase()
+  {
+    char path[] = "/tmp/test_options_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    close(fd);
+    config_path_ = path;
+
+    std::ofstream config(config_path_);
+    config <<
+      "# Comments and blank lines are skipped\n"
+      "\n"
+      "; Settings before the first section are global\n"
+      "keep_all_max_samples = 50\n"
+      "[global]\n"
+      "  publish_timeout_ms=250  \n"
+      "udp_queue_size = -1\n"
+      "async_queue_size = 99999999999999999999999\n"
+      "serialization_threads = +2\n"
+      "inject = *:drop=0.5\n"
+      "inject\n"
+      "virtual_time = yes\n"
+      "unknown_key = 1\n"
+      "cpu_affinity = 0,2-3\n"
+      "udp_peers = 127.0.0.1:7401, 127.0.0.1:7402\n"
+      "[topic /camera/*]\n"
+      "keep_all_max_bytes = 1000000\n"
+      "queue = ring\n"
+      "record = 0\n"
+      "async_publish = maybe\n"
+      "[topic /camera/depth]\n"
+      "keep_all_max_samples = 5\n"
+      "transport = intra\n"
+      "keep_all_max_bytes\n"
+      "[services]\n"
+      "keep_all_max_samples = 7\n"
+      "[topic /state]\n"
+      "queue = mailbox\n"
+      "inject = delay_us=100\n";
+    config.close();
+
+    setenv("RMW_STUB_CONFIG", config_path_.c_str(), 1);
+    setenv("RMW_STUB_PUBLISH_TIMEOUT_MS", "20", 1);
+    setenv("RMW_STUB_ASYNC_PUBLISH", "true", 1);
+    setenv("RMW_STUB_RECORD_SEGMENT_SIZE", "-4096", 1);
+  }
+
+  static void TearDownTestCase()
+  {
+    unlink(config_path_.c_str());
+  }
+
+  static std::string config_path_;
+};
+
+std::string TestOptions::config_path_;
+
+TEST_F(TestOptions, reads_global_settings) {
+  const StubOptions & options = StubOptions::get();
+  EXPECT_EQ(50u, options.keep_all_max_samples);
+  EXPECT_EQ(std::vector<int>({0, 2, 3}), options.cpu_affinity);
+  EXPECT_EQ(
+    std::vector<std::string>({"127.0.0.1:7401", "127.0.0.1:7402"}), options.udp_peers);
+}
+
+TEST_F(TestOptions, environment_overrides_the_file) {
+  const StubOptions & options = StubOptions::get();
+  EXPECT_EQ(std::chrono::milliseconds(20), options.publish_timeout);
+  EXPECT_TRUE(options.async_publish);
+}
+
+TEST_F(TestOptions, ignores_invalid_settings) {
+  const StubOptions & options = StubOptions::get();
+  // Negative, out of range and signed numbers
+  EXPECT_EQ(1024u, options.udp_queue_size);
+  EXPECT_EQ(1024u, options.async_queue_size);
+  EXPECT_EQ(3u, options.serialization_threads);
+  EXPECT_EQ(64u * 1024 * 1024, options.record_segment_size);
+  // A key without a value doesn't clear it
+  EXPECT_EQ("*:drop=0.5", options.inject);
+  EXPECT_FALSE(options.virtual_time);
+}
+
+TEST_F(TestOptions, topic_sections_apply_in_order) {
+  const StubOptions & options = StubOptions::get();
+
+  StubTopicOptions depth = options.get_topic_options("/camera/depth");
+  EXPECT_EQ(5u, depth.keep_all_max_samples);
+  EXPECT_EQ(1000000u, depth.keep_all_max_bytes);
+  EXPECT_EQ(StubTopicOptions::Queue::RING, depth.queue);
+  EXPECT_EQ(StubTopicOptions::Transport::INTRA, depth.transport);
+  EXPECT_FALSE(depth.record);
+  EXPECT_TRUE(depth.async_publish);
+
+  StubTopicOptions color = options.get_topic_options("/camera/color");
+  EXPECT_EQ(50u, color.keep_all_max_samples);
+  EXPECT_EQ(1000000u, color.keep_all_max_bytes);
+  EXPECT_EQ(StubTopicOptions::Transport::AUTO, color.transport);
+
+  StubTopicOptions state = options.get_topic_options("/state");
+  EXPECT_EQ(StubTopicOptions::Queue::MAILBOX, state.queue);
+  EXPECT_EQ("delay_us=100", state.inject);
+
+  // Unknown sections are skipped
+  StubTopicOptions other = options.get_topic_options("/other");
+  EXPECT_EQ(50u, other.keep_all_max_samples);
+  EXPECT_EQ(std::numeric_limits<size_t>::max(), other.keep_all_max_bytes);
+  EXPECT_EQ(StubTopicOptions::Queue::AUTO, other.queue);
+  EXPECT_TRUE(other.record);
+  EXPECT_TRUE(other.inject.empty());
+}
+
+// Only the endpoints of transport = auto topics go over UDP
+TEST_F(TestOptions, selects_the_transport) {
+  rmw_qos_profile_t qos = rmw_qos_profile_t{};
+  qos.depth = 1;
+
+  EXPECT_FALSE(StubPublisher(&qos, "/camera/depth").is_udp());
+  EXPECT_FALSE(StubSubscription(&qos, "/camera/depth").is_udp());
+  EXPECT_TRUE(StubPublisher(&qos, "/camera/color").is_udp());
+  EXPECT_TRUE(StubSubscription(&qos, "/camera/color").is_udp());
+}
@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rmw/types.h"
+
+#include "rmw_stub_cpp/stub_mapped_file.hpp"
+#include "rmw_stub_cpp/stub_record_format.hpp"
+#include "rmw_stub_cpp/stub_recorder.hpp"
+#include "rmw_stub_cpp/stub_replayer.hpp"
+#include "rmw_stub_cpp/stub_sample.hpp"
+#include "rmw_stub_cpp/stub_subscription.hpp"
+#include "rmw_stub_cpp/stub_topic.hpp"
+
+namespace
+{
+
+const int64_t kSamples = 60;
+// Timestamps of consecutive samples
+const int64_t kPeriodNs = 1000000;
+
+// Samples alternate between two topics, with sizes spanning several segments
+size_t get_sample_size(int64_t sequence_number)
+{
+  return static_cast<size_t>(1 + sequence_number * 97 % 3000);
+}
+
+uint8_t get_byte(int64_t sequence_number, size_t offset)
+{
+  return static_cast<uint8_t>(sequence_number * 31 + offset);
+}
+
+}  // namespace
+
+// The recorder is per process: it records to a directory named by
+// RMW_STUB_RECORD_DIR, set before its options are first read
+class TestRecorder : public ::testing::Test
+{
+protected:
+  static void SetUpTestCase()
+  {
+    char path[] = "/tmp/test_recorder_XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(path));
+    directory_ = std::string(path) + "/recording";
+    setenv("RMW_STUB_RECORD_DIR", directory_.c_str(), 1);
+    setenv("RMW_STUB_RECORD_SEGMENT_SIZE", "16384", 1);
+
+    auto & recorder = StubRecorder::instance();
+    const int32_t topic_ids[] = {
+      recorder.get_topic_id("/recorded_a", "std_msgs/msg/String"),
+      recorder.get_topic_id("/recorded_b", "std_msgs/msg/String")};
+    ASSERT_EQ(0, topic_ids[0]);
+    ASSERT_EQ(1, topic_ids[1]);
+
+    auto memory_account = std::make_shared<StubMemoryAccount>();
+    for (int64_t i = 0; i < kSamples; i++) {
+      StubSample sample(get_sample_size(i), 7, i, i * kPeriodNs, memory_account);
+      for (size_t offset = 0; offset < sample.size(); offset++) {
+        sample.data()[offset] = get_byte(i, offset);
+      }
+      recorder.record(topic_ids[i % 2], sample);
+    }
+  }
+
+  void TearDown() override
+  {
+    for (size_t i = 0; i < subscriptions_.size(); i++) {
+      topics_[i]->remove_subscription(subscriptions_[i].get());
+    }
+  }
+
+  StubSubscription * subscribe(const std::string & topic_name)
+  {
+    qos_.emplace_back(new rmw_qos_profile_t());
+    qos_.back()->history = RMW_QOS_POLICY_HISTORY_KEEP_LAST;
+    qos_.back()->depth = kSamples;
+    qos_.back()->reliability = RMW_QOS_POLICY_RELIABILITY_RELIABLE;
+    topics_.push_back(StubTopicRegistry::instance().get_topic(topic_name));
+    subscriptions_.emplace_back(new StubSubscription(qos_.back().get(), topic_name.c_str()));
+    topics_.back()->add_subscription(subscriptions_.back().get());
+    return subscriptions_.back().get();
+  }
+
+  // Check the samples replayed on a topic, every `step` sample from `first`
+  void expect_replayed(
+    const std::string & topic_name, StubSubscription * subscription, int64_t first, int64_t step)
+  {
+    auto topic = StubTopicRegistry::instance().get_topic(topic_name);
+    for (int64_t i = first; i < kSamples; i += step) {
+      auto sample = topic->take(subscription);
+      ASSERT_NE(nullptr, sample);
+      EXPECT_EQ(i, sample->get_sequence_number());
+      EXPECT_EQ(7u, sample->get_publisher_id());
+      EXPECT_EQ(i * kPeriodNs, sample->get_source_timestamp());
+      ASSERT_EQ(get_sample_size(i), sample->size());
+      for (size_t offset = 0; offset < sample->size(); offset++) {
+        ASSERT_EQ(get_byte(i, offset), sample->data()[offset]);
+      }
+    }
+    EXPECT_EQ(nullptr, topic->take(subscription));
+  }
+
+  static std::string directory_;
+  std::vector<std::unique_ptr<rmw_qos_profile_t>> qos_;
+  std::vector<std::shared_ptr<StubTopic>> topics_;
+  std::vector<std::unique_ptr<StubSubscription>> subscriptions_;
+};
+
+std::string TestRecorder::directory_;
+
+TEST_F(TestRecorder, replays_every_topic) {
+  auto a = subscribe("/recorded_a");
+  auto b = subscribe("/recorded_b");
+
+  StubReplayer replayer(directory_, 0, {});
+  ASSERT_TRUE(replayer.is_valid());
+  EXPECT_EQ(static_cast<size_t>(kSamples), replayer.replay());
+  expect_replayed("/recorded_a", a, 0, 2);
+  expect_replayed("/recorded_b", b, 1, 2);
+}
+
+TEST_F(TestRecorder, replays_selected_topics) {
+  auto a = subscribe("/recorded_a");
+  auto b = subscribe("/recorded_b");
+
+  StubReplayer replayer(directory_, 0, {"/recorded_b"});
+  EXPECT_EQ(static_cast<size_t>(kSamples / 2), replayer.replay());
+  EXPECT_EQ(nullptr, StubTopicRegistry::instance().get_topic("/recorded_a")->take(a));
+  expect_replayed("/recorded_b", b, 1, 2);
+
+  EXPECT_FALSE(StubReplayer(directory_, 0, {"/not_recorded"}).is_valid());
+}
+
+TEST_F(TestRecorder, replays_at_recorded_timing) {
+  subscribe("/recorded_a");
+
+  // Twice as fast as recorded
+  auto start = std::chrono::steady_clock::now();
+  StubReplayer(directory_, 2.0, {"/recorded_a"}).replay();
+  EXPECT_GE(
+    std::chrono::steady_clock::now() - start,
+    std::chrono::nanoseconds((kSamples - 2) * kPeriodNs / 2));
+}
+
+TEST_F(TestRecorder, keeps_existing_recordings) {
+  StubMappedFile segment;
+  EXPECT_FALSE(segment.create(get_segment_path(directory_, 0), 4096));
+  EXPECT_EQ(EEXIST, errno);
+}
@@ -0,0 +1,253 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rmw_stub_cpp/service_dispatch.hpp"
+#include "rmw_stub_cpp/stub_client.hpp"
+#include "rmw_stub_cpp/stub_service.hpp"
+#include "rmw_stub_cpp/stub_service_message.hpp"
+#include "rmw_stub_cpp/stub_service_registry.hpp"
+
+using rmw_stub_cpp::ServiceDispatch;
+
+class TestServiceRegistry : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    service_name_ = std::string("/") +
+      ::testing::UnitTest::GetInstance()->current_test_info()->name();
+  }
+
+  void TearDown() override
+  {
+    for (auto & service : services_) {
+      registry_.remove_service(service.get());
+    }
+    for (auto & client : clients_) {
+      registry_.remove_client(client.get());
+    }
+  }
+
+  StubService * add_service()
+  {
+    services_.emplace_back(new StubService(service_name_.c_str(), nullptr, "rmw_stub_cpp"));
+    registry_.add_service(services_.back().get());
+    return services_.back().get();
+  }
+
+  StubClient * add_client()
+  {
+    clients_.emplace_back(new StubClient(service_name_.c_str(), nullptr));
+    registry_.add_client(clients_.back().get());
+    return clients_.back().get();
+  }
+
+  bool send_request(StubClient * client)
+  {
+    StubServiceMessage request;
+    request.request_id = client->create_request_id();
+    request.source_timestamp = 0;
+    return registry_.send_request(service_name_, request);
+  }
+
+  // Answer the request with the given sequence number
+  bool send_response(StubClient * client, int64_t sequence_number)
+  {
+    StubServiceMessage response;
+    response.request_id = client->create_request_id();
+    response.request_id.sequence_number = sequence_number;
+    response.source_timestamp = 0;
+    return registry_.send_response(response);
+  }
+
+  StubServiceRegistry & registry_{StubServiceRegistry::instance()};
+  std::string service_name_;
+  std::vector<std::unique_ptr<StubService>> services_;
+  std::vector<std::unique_ptr<StubClient>> clients_;
+};
+
+TEST_F(TestServiceRegistry, services_are_indexed_with_their_first_client) {
+  add_service();
+  add_service();
+  EXPECT_EQ(0u, registry_.get_server_count(service_name_));
+
+  add_client();
+  EXPECT_EQ(2u, registry_.get_server_count(service_name_));
+
+  // Later services of the name are indexed right away
+  add_service();
+  EXPECT_EQ(3u, registry_.get_server_count(service_name_));
+
+  registry_.remove_service(services_.back().get());
+  services_.pop_back();
+  EXPECT_EQ(2u, registry_.get_server_count(service_name_));
+}
+
+TEST_F(TestServiceRegistry, no_server) {
+  StubClient * client = add_client();
+  EXPECT_FALSE(send_request(client));
+}
+
+TEST_F(TestServiceRegistry, broadcast_by_default) {
+  StubService * first = add_service();
+  StubService * second = add_service();
+  StubClient * client = add_client();
+  EXPECT_EQ(ServiceDispatch::BROADCAST, registry_.get_dispatch(service_name_));
+
+  ASSERT_TRUE(send_request(client));
+  EXPECT_EQ(1u, first->get_queued_requests());
+  EXPECT_EQ(1u, second->get_queued_requests());
+
+  StubServiceMessage first_request, second_request;
+  ASSERT_TRUE(first->take_request(first_request));
+  ASSERT_TRUE(second->take_request(second_request));
+  EXPECT_EQ(first_request.request_id.sequence_number, second_request.request_id.sequence_number);
+  EXPECT_FALSE(first->take_request(first_request));
+}
+
+TEST_F(TestServiceRegistry, round_robin) {
+  // The dispatch can be set before the service exists
+  registry_.set_dispatch(service_name_, ServiceDispatch::ROUND_ROBIN);
+  StubService * first = add_service();
+  StubService * second = add_service();
+  StubClient * client = add_client();
+
+  for (int i = 0; i < 6; i++) {
+    ASSERT_TRUE(send_request(client));
+  }
+  EXPECT_EQ(3u, first->get_queued_requests());
+  EXPECT_EQ(3u, second->get_queued_requests());
+
+  // Consecutive requests go to different servers
+  StubServiceMessage first_request, second_request;
+  ASSERT_TRUE(first->take_request(first_request));
+  ASSERT_TRUE(second->take_request(second_request));
+  EXPECT_EQ(
+    1, std::abs(
+      first_request.request_id.sequence_number - second_request.request_id.sequence_number));
+}
+
+TEST_F(TestServiceRegistry, least_queued) {
+  registry_.set_dispatch(service_name_, ServiceDispatch::LEAST_QUEUED);
+  StubService * first = add_service();
+  StubService * second = add_service();
+  StubClient * client = add_client();
+
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(send_request(client));
+  }
+  EXPECT_EQ(2u, first->get_queued_requests());
+  EXPECT_EQ(2u, second->get_queued_requests());
+
+  // Only the first server takes its requests: the next ones go to it
+  StubServiceMessage request;
+  while (first->take_request(request)) {
+  }
+  ASSERT_TRUE(send_request(client));
+  ASSERT_TRUE(send_request(client));
+  EXPECT_EQ(2u, first->get_queued_requests());
+  EXPECT_EQ(2u, second->get_queued_requests());
+}
+
+TEST_F(TestServiceRegistry, responses_go_to_their_client) {
+  add_service();
+  StubClient * client = add_client();
+  StubClient * other_client = add_client();
+
+  ASSERT_TRUE(send_response(client, 1));
+  StubServiceMessage response;
+  EXPECT_FALSE(other_client->take_response(response));
+  ASSERT_TRUE(client->take_response(response));
+  EXPECT_EQ(1, response.request_id.sequence_number);
+
+  // Responses to a destroyed client are dropped
+  StubClient gone_client(service_name_.c_str(), nullptr);
+  EXPECT_FALSE(send_response(&gone_client, 1));
+}
+
+TEST_F(TestServiceRegistry, wait_for_server) {
+  add_client();
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_FALSE(registry_.wait_for_server(service_name_, std::chrono::milliseconds(20)));
+  EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+
+  std::thread server([this]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      add_service();
+    });
+  EXPECT_TRUE(registry_.wait_for_server(service_name_, std::chrono::seconds(10)));
+  server.join();
+}
+
+TEST_F(TestServiceRegistry, request_timeout) {
+  add_service();
+  StubClient * client = add_client();
+
+  ASSERT_TRUE(send_request(client));
+  client->add_pending_request(1);
+  registry_.expire_request(client->get_client_id(), 1);
+
+  // Taken as a response without a message
+  StubServiceMessage response;
+  ASSERT_TRUE(client->take_response(response));
+  EXPECT_EQ(1, response.request_id.sequence_number);
+  EXPECT_TRUE(StubClient::is_timeout(response.request_id));
+  EXPECT_EQ(nullptr, response.message);
+  EXPECT_FALSE(client->take_response(response));
+
+  // The late response is dropped
+  ASSERT_TRUE(send_response(client, 1));
+  EXPECT_FALSE(client->take_response(response));
+}
+
+TEST_F(TestServiceRegistry, response_before_timeout) {
+  add_service();
+  StubClient * client = add_client();
+
+  ASSERT_TRUE(send_request(client));
+  client->add_pending_request(1);
+  ASSERT_TRUE(send_response(client, 1));
+
+  // The deadline of an answered request is ignored
+  registry_.expire_request(client->get_client_id(), 1);
+  StubServiceMessage response;
+  ASSERT_TRUE(client->take_response(response));
+  EXPECT_FALSE(StubClient::is_timeout(response.request_id));
+  EXPECT_FALSE(client->take_response(response));
+
+  // And so is the deadline of a destroyed client
+  StubClient gone_client(service_name_.c_str(), nullptr);
+  registry_.expire_request(gone_client.get_client_id(), 1);
+}
+
+TEST_F(TestServiceRegistry, timeouts_wake_the_executor) {
+  add_service();
+  StubClient * client = add_client();
+
+  size_t events = 0;
+  client->set_callback(
+    [](const void * user_data, size_t count) {
+      *static_cast<size_t *>(const_cast<void *>(user_data)) += count;
+    }, &events);
+
+  client->add_pending_request(1);
+  client->add_pending_request(2);
+  registry_.expire_request(client->get_client_id(), 1);
+  ASSERT_TRUE(send_response(client, 2));
+  EXPECT_EQ(2u, events);
+  client->set_callback(nullptr, nullptr);
+
+  // One response to take for each event
+  StubServiceMessage response;
+  ASSERT_TRUE(client->take_response(response));
+  EXPECT_TRUE(StubClient::is_timeout(response.request_id));
+  ASSERT_TRUE(client->take_response(response));
+  EXPECT_FALSE(StubClient::is_timeout(response.request_id));
+  EXPECT_FALSE(client->take_response(response));
+}
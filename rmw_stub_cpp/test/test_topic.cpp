@@ -0,0 +1,249 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rmw/types.h"
+
+#include "rmw_stub_cpp/stub_sample.hpp"
+#include "rmw_stub_cpp/stub_subscription.hpp"
+#include "rmw_stub_cpp/stub_topic.hpp"
+
+// Run with RMW_STUB_KEEP_ALL_MAX_SAMPLES=10, RMW_STUB_KEEP_ALL_MAX_BYTES=10000,
+// RMW_STUB_PUBLISH_TIMEOUT_MS=10, RMW_STUB_MAX_PROCESS_SAMPLES=2000 and
+// RMW_STUB_MAX_PROCESS_BYTES=100000
+class TestTopic : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    topic_name_ = std::string("/") +
+      ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    topic_ = StubTopicRegistry::instance().get_topic(topic_name_);
+  }
+
+  void TearDown() override
+  {
+    for (auto & subscription : subscriptions_) {
+      topic_->remove_subscription(subscription.get());
+    }
+  }
+
+  StubSubscription * subscribe(
+    rmw_qos_history_policy_t history, size_t depth, rmw_qos_reliability_policy_t reliability)
+  {
+    qos_.emplace_back(new rmw_qos_profile_t());
+    qos_.back()->history = history;
+    qos_.back()->depth = depth;
+    qos_.back()->reliability = reliability;
+    subscriptions_.emplace_back(new StubSubscription(qos_.back().get(), topic_name_.c_str()));
+    topic_->add_subscription(subscriptions_.back().get());
+    return subscriptions_.back().get();
+  }
+
+  rmw_ret_t publish(int64_t sequence_number, size_t size = 100, bool reliable = false)
+  {
+    return topic_->publish(
+      std::make_shared<StubSample>(
+        size, 0, sequence_number, 0, topic_->get_memory_account()), reliable);
+  }
+
+  std::vector<int64_t> take_all(StubSubscription * subscription)
+  {
+    std::vector<int64_t> sequence_numbers;
+    while (auto sample = topic_->take(subscription)) {
+      sequence_numbers.push_back(sample->get_sequence_number());
+    }
+    return sequence_numbers;
+  }
+
+  std::string topic_name_;
+  std::shared_ptr<StubTopic> topic_;
+  std::vector<std::unique_ptr<rmw_qos_profile_t>> qos_;
+  std::vector<std::unique_ptr<StubSubscription>> subscriptions_;
+};
+
+TEST_F(TestTopic, keep_last_keeps_newest) {
+  auto subscription = subscribe(
+    RMW_QOS_POLICY_HISTORY_KEEP_LAST, 5, RMW_QOS_POLICY_RELIABILITY_RELIABLE);
+
+  for (int64_t i = 0; i < 12; i++) {
+    ASSERT_EQ(RMW_RET_OK, publish(i));
+  }
+  EXPECT_EQ((std::vector<int64_t>{7, 8, 9, 10, 11}), take_all(subscription));
+}
+
+TEST_F(TestTopic, depth_one_takes_latest) {
+  auto subscription = subscribe(
+    RMW_QOS_POLICY_HISTORY_KEEP_LAST, 1, RMW_QOS_POLICY_RELIABILITY_BEST_EFFORT);
+  ASSERT_NE(nullptr, subscription->get_mailbox());
+
+  size_t events = 0;
+  subscription->set_callback(
+    [](const void * user_data, size_t count) {
+      *static_cast<size_t *>(const_cast<void *>(user_data)) += count;
+    }, &events);
+
+  for (int64_t i = 0; i < 3; i++) {
+    ASSERT_EQ(RMW_RET_OK, publish(i));
+  }
+  // Overwrites don't notify again: there's still a single sample to take
+  EXPECT_EQ(1u, events);
+  EXPECT_EQ((std::vector<int64_t>{2}), take_all(subscription));
+
+  ASSERT_EQ(RMW_RET_OK, publish(3));
+  EXPECT_EQ(2u, events);
+  subscription->set_callback(nullptr, nullptr);
+}
+
+TEST_F(TestTopic, every_subscription_takes_every_sample) {
+  auto first = subscribe(
+    RMW_QOS_POLICY_HISTORY_KEEP_LAST, 10, RMW_QOS_POLICY_RELIABILITY_RELIABLE);
+  auto second = subscribe(
+    RMW_QOS_POLICY_HISTORY_KEEP_LAST, 3, RMW_QOS_POLICY_RELIABILITY_RELIABLE);
+
+  for (int64_t i = 0; i < 4; i++) {
+    ASSERT_EQ(RMW_RET_OK, publish(i));
+  }
+  EXPECT_EQ((std::vector<int64_t>{0, 1, 2, 3}), take_all(first));
+  EXPECT_EQ((std::vector<int64_t>{1, 2, 3}), take_all(second));
+
+  // Volatile durability: a late subscription only gets samples published after it
+  auto late = subscribe(
+    RMW_QOS_POLICY_HISTORY_KEEP_LAST, 10, RMW_QOS_POLICY_RELIABILITY_RELIABLE);
+  ASSERT_EQ(RMW_RET_OK, publish(4));
+  EXPECT_EQ((std::vector<int64_t>{4}), take_all(first));
+  EXPECT_EQ((std::vector<int64_t>{4}), take_all(late));
+}
+
+TEST_F(TestTopic, ring_grows_past_a_segment) {
+  auto subscription = subscribe(
+    RMW_QOS_POLICY_HISTORY_KEEP_LAST, 1000, RMW_QOS_POLICY_RELIABILITY_RELIABLE);
+
+  std::vector<int64_t> expected;
+  for (int64_t round = 0; round < 3; round++) {
+    for (int64_t i = 0; i < 1000; i++) {
+      ASSERT_EQ(RMW_RET_OK, publish(round * 1000 + i, 8));
+    }
+  }
+  for (int64_t i = 2000; i < 3000; i++) {
+    expected.push_back(i);
+  }
+  EXPECT_EQ(expected, take_all(subscription));
+}
+
+TEST_F(TestTopic, ring_shrinks_when_a_reader_leaves) {
+  auto deep = subscribe(
+    RMW_QOS_POLICY_HISTORY_KEEP_LAST, 8, RMW_QOS_POLICY_RELIABILITY_RELIABLE);
+  auto shallow = subscribe(
+    RMW_QOS_POLICY_HISTORY_KEEP_LAST, 2, RMW_QOS_POLICY_RELIABILITY_RELIABLE);
+
+  for (int64_t i = 0; i < 8; i++) {
+    ASSERT_EQ(RMW_RET_OK, publish(i));
+  }
+  EXPECT_EQ(8u, topic_->get_memory_account()->get_samples());
+
+  // Only the samples the remaining reader may still take are kept
+  topic_->remove_subscription(deep);
+  subscriptions_.erase(subscriptions_.begin());
+  ASSERT_EQ(RMW_RET_OK, publish(8));
+  EXPECT_EQ(2u, topic_->get_memory_account()->get_samples());
+  EXPECT_EQ((std::vector<int64_t>{7, 8}), take_all(shallow));
+}
+
+TEST_F(TestTopic, released_samples_are_refunded) {
+  auto subscription = subscribe(
+    RMW_QOS_POLICY_HISTORY_KEEP_LAST, 4, RMW_QOS_POLICY_RELIABILITY_RELIABLE);
+
+  for (int64_t i = 0; i < 10; i++) {
+    ASSERT_EQ(RMW_RET_OK, publish(i));
+  }
+  EXPECT_LE(topic_->get_memory_account()->get_samples(), 4u);
+  take_all(subscription);
+  EXPECT_EQ(0u, topic_->get_memory_account()->get_samples());
+  EXPECT_EQ(0u, topic_->get_memory_account()->get_bytes());
+}
+
+TEST_F(TestTopic, keep_all_sample_limit) {
+  auto subscription = subscribe(
+    RMW_QOS_POLICY_HISTORY_KEEP_ALL, 0, RMW_QOS_POLICY_RELIABILITY_BEST_EFFORT);
+  EXPECT_EQ(10u, subscription->get_depth());
+
+  for (int64_t i = 0; i < 25; i++) {
+    ASSERT_EQ(RMW_RET_OK, publish(i));
+  }
+  std::vector<int64_t> expected;
+  for (int64_t i = 15; i < 25; i++) {
+    expected.push_back(i);
+  }
+  EXPECT_EQ(expected, take_all(subscription));
+}
+
+TEST_F(TestTopic, keep_all_byte_limit) {
+  auto subscription = subscribe(
+    RMW_QOS_POLICY_HISTORY_KEEP_ALL, 0, RMW_QOS_POLICY_RELIABILITY_BEST_EFFORT);
+
+  for (int64_t i = 0; i < 100; i++) {
+    ASSERT_EQ(RMW_RET_OK, publish(i, 2500));
+  }
+  // Older samples are evicted as they are pushed, not only when taken
+  EXPECT_LE(topic_->get_memory_account()->get_bytes(), 10000u);
+  EXPECT_EQ((std::vector<int64_t>{96, 97, 98, 99}), take_all(subscription));
+
+  // A sample over the limit still goes through an empty queue
+  ASSERT_EQ(RMW_RET_OK, publish(100, 50000));
+  auto sample = topic_->take(subscription);
+  ASSERT_NE(nullptr, sample);
+  EXPECT_EQ(50000u, sample->size());
+}
+
+TEST_F(TestTopic, reliable_keep_all_blocks_publishers) {
+  auto subscription = subscribe(
+    RMW_QOS_POLICY_HISTORY_KEEP_ALL, 0, RMW_QOS_POLICY_RELIABILITY_RELIABLE);
+  ASSERT_TRUE(subscription->blocks_publishers());
+
+  for (int64_t i = 0; i < 10; i++) {
+    ASSERT_EQ(RMW_RET_OK, publish(i, 100, true));
+  }
+  // Full: reliable publishers time out rather than dropping unread samples
+  EXPECT_EQ(RMW_RET_TIMEOUT, publish(10, 100, true));
+
+  ASSERT_NE(nullptr, topic_->take(subscription));
+  EXPECT_EQ(RMW_RET_OK, publish(11, 100, true));
+
+  EXPECT_EQ((std::vector<int64_t>{1, 2, 3, 4, 5, 6, 7, 8, 9, 11}), take_all(subscription));
+}
+
+TEST_F(TestTopic, reliable_keep_all_byte_limit) {
+  auto subscription = subscribe(
+    RMW_QOS_POLICY_HISTORY_KEEP_ALL, 0, RMW_QOS_POLICY_RELIABILITY_RELIABLE);
+
+  ASSERT_EQ(RMW_RET_OK, publish(0, 6000, true));
+  EXPECT_EQ(RMW_RET_TIMEOUT, publish(1, 6000, true));
+  ASSERT_EQ(RMW_RET_OK, publish(2, 4000, true));
+  EXPECT_EQ((std::vector<int64_t>{0, 2}), take_all(subscription));
+}
+
+// Publishes go through as long as the samples may be allocated
+TEST_F(TestTopic, process_sample_budget) {
+  subscribe(RMW_QOS_POLICY_HISTORY_KEEP_LAST, 3000, RMW_QOS_POLICY_RELIABILITY_RELIABLE);
+
+  int64_t published = 0;
+  while (!StubTopic::exceeds_memory_budget(8)) {
+    ASSERT_EQ(RMW_RET_OK, publish(published++, 8));
+  }
+  EXPECT_EQ(2000, published);
+  EXPECT_EQ(RMW_RET_ERROR, publish(published, 8));
+}
+
+TEST_F(TestTopic, process_byte_budget) {
+  subscribe(RMW_QOS_POLICY_HISTORY_KEEP_LAST, 3000, RMW_QOS_POLICY_RELIABILITY_RELIABLE);
+
+  int64_t published = 0;
+  while (!StubTopic::exceeds_memory_budget(1000)) {
+    ASSERT_EQ(RMW_RET_OK, publish(published++, 1000));
+  }
+  EXPECT_EQ(100, published);
+  EXPECT_EQ(RMW_RET_ERROR, publish(published, 1000));
+}
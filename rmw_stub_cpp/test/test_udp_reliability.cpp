@@ -0,0 +1,193 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+
+#include "rmw_stub_cpp/stub_memory_account.hpp"
+#include "rmw_stub_cpp/stub_sample.hpp"
+#include "rmw_stub_cpp/stub_udp_reliability.hpp"
+
+namespace
+{
+
+std::shared_ptr<const StubSample> make_sample(int64_t sequence_number)
+{
+  static auto memory_account = std::make_shared<StubMemoryAccount>();
+  return std::make_shared<StubSample>(8, 0, sequence_number, 0, memory_account);
+}
+
+bool is_nacked(const StubUdpNack & nack, int64_t sequence_number)
+{
+  int64_t bit = sequence_number - nack.base_sequence_number;
+  return bit >= 0 && bit < StubUdpNack::kBitmapSize &&
+         (nack.bitmap[bit / 64] & (1ull << (bit % 64)));
+}
+
+}  // namespace
+
+TEST(TestReaderWindow, drops_duplicates) {
+  StubReaderWindow window(10);
+
+  EXPECT_TRUE(window.receive(10));
+  EXPECT_FALSE(window.receive(10));
+  EXPECT_FALSE(window.receive(9));
+  EXPECT_TRUE(window.receive(12));
+  EXPECT_FALSE(window.receive(12));
+  EXPECT_EQ(11, window.get_base());
+
+  EXPECT_TRUE(window.receive(11));
+  EXPECT_EQ(13, window.get_base());
+}
+
+TEST(TestReaderWindow, moves_past_samples_too_far_ahead) {
+  StubReaderWindow window(0);
+
+  const int64_t far = StubReaderWindow::kWindowSize + 100;
+  EXPECT_TRUE(window.receive(far));
+  EXPECT_EQ(101, window.get_base());
+  EXPECT_TRUE(window.has_received(100));
+  EXPECT_FALSE(window.has_received(101));
+  EXPECT_TRUE(window.has_received(far));
+}
+
+TEST(TestReaderWindow, heartbeat_gives_up_on_samples_gone) {
+  StubReaderWindow window(0);
+  window.receive(5);
+
+  window.on_heartbeat(3);
+  EXPECT_EQ(3, window.get_base());
+  window.receive(3);
+  window.receive(4);
+  EXPECT_EQ(6, window.get_base());
+}
+
+TEST(TestReaderWindow, first_heartbeat_moves_back) {
+  // Created by sample 5: 3 and 4 were lost
+  StubReaderWindow window(5);
+  window.receive(5);
+  window.receive(7);
+
+  window.on_heartbeat(3);
+  EXPECT_EQ(3, window.get_base());
+  EXPECT_FALSE(window.has_received(3));
+  EXPECT_FALSE(window.has_received(4));
+  EXPECT_TRUE(window.has_received(5));
+  EXPECT_FALSE(window.has_received(6));
+  EXPECT_TRUE(window.has_received(7));
+  EXPECT_FALSE(window.receive(5));
+  EXPECT_TRUE(window.receive(3));
+
+  // Only the first heartbeat moves it back
+  window.on_heartbeat(1);
+  EXPECT_EQ(4, window.get_base());
+}
+
+TEST(TestReaderWindow, first_heartbeat_keeps_samples_received) {
+  StubReaderWindow window(1000);
+  const int64_t far = 1000 + StubReaderWindow::kWindowSize - 10;
+  window.receive(1000);
+  window.receive(far);
+
+  // The window can't cover both the samples received and all of the heartbeat
+  window.on_heartbeat(0);
+  EXPECT_EQ(far - StubReaderWindow::kWindowSize + 1, window.get_base());
+  EXPECT_FALSE(window.has_received(999));
+  EXPECT_TRUE(window.has_received(1000));
+  EXPECT_FALSE(window.has_received(1001));
+  EXPECT_TRUE(window.has_received(far));
+}
+
+TEST(TestReaderWindow, missing) {
+  StubReaderWindow window(0);
+  for (int64_t i : {0, 1, 3, 6}) {
+    window.receive(i);
+  }
+
+  StubUdpNack nack;
+  ASSERT_TRUE(window.get_missing(window.get_base(), 7, nack));
+  EXPECT_EQ(2, nack.base_sequence_number);
+  for (int64_t i = 0; i < 10; i++) {
+    EXPECT_EQ(i == 2 || i == 4 || i == 5 || i == 7, is_nacked(nack, i)) << i;
+  }
+
+  window.receive(2);
+  window.receive(4);
+  window.receive(5);
+  window.receive(7);
+  EXPECT_FALSE(window.get_missing(window.get_base(), 7, nack));
+}
+
+TEST(TestReaderWindow, nacks_once_per_period) {
+  StubReaderWindow window(0);
+  window.receive(0);
+  window.receive(2);
+
+  // Heartbeat up to 2: 1 is missing
+  EXPECT_EQ(1, window.begin_nack(1, 2));
+  // Another heartbeat in the same period: 1 was NACKed already
+  EXPECT_EQ(3, window.begin_nack(1, 2));
+  // New samples missing are NACKed right away
+  window.receive(4);
+  EXPECT_EQ(3, window.begin_nack(1, 4));
+  EXPECT_EQ(5, window.begin_nack(1, 4));
+  // Everything missing again in the next period
+  EXPECT_EQ(1, window.begin_nack(2, 4));
+  EXPECT_EQ(5, window.begin_nack(2, 4));
+}
+
+TEST(TestReaderWindow, expires_when_idle) {
+  StubReaderWindow window(0);
+
+  EXPECT_FALSE(window.is_expired(2));
+  EXPECT_FALSE(window.is_expired(2));
+  window.mark_active();
+  EXPECT_FALSE(window.is_expired(2));
+  EXPECT_FALSE(window.is_expired(2));
+  EXPECT_TRUE(window.is_expired(2));
+}
+
+TEST(TestWriterHistory, keeps_depth) {
+  StubWriterHistory history(3);
+  EXPECT_TRUE(history.empty());
+
+  for (int64_t i = 1; i <= 5; i++) {
+    history.add(make_sample(i), std::chrono::steady_clock::now());
+  }
+  EXPECT_EQ(3, history.get_first_sequence_number());
+  EXPECT_EQ(5, history.get_last_sequence_number());
+  EXPECT_EQ(nullptr, history.resend(2, 1));
+  EXPECT_EQ(nullptr, history.resend(6, 1));
+  auto sample = history.resend(4, 1);
+  ASSERT_NE(nullptr, sample);
+  EXPECT_EQ(4, sample->get_sequence_number());
+
+  // A gap in the sequence numbers restarts the history
+  history.add(make_sample(10), std::chrono::steady_clock::now());
+  EXPECT_EQ(10, history.get_first_sequence_number());
+}
+
+TEST(TestWriterHistory, first_sample_since) {
+  StubWriterHistory history(10);
+  const auto start = std::chrono::steady_clock::now();
+  for (int64_t i = 1; i <= 3; i++) {
+    history.add(make_sample(i), start + std::chrono::seconds(i));
+  }
+
+  EXPECT_EQ(1, history.get_first_sequence_number(start));
+  EXPECT_EQ(2, history.get_first_sequence_number(start + std::chrono::milliseconds(1500)));
+  EXPECT_EQ(3, history.get_first_sequence_number(start + std::chrono::seconds(3)));
+  EXPECT_EQ(4, history.get_first_sequence_number(start + std::chrono::seconds(4)));
+}
+
+TEST(TestWriterHistory, resends_once_per_period) {
+  StubWriterHistory history(10);
+  for (int64_t i = 1; i <= 3; i++) {
+    history.add(make_sample(i), std::chrono::steady_clock::now());
+  }
+
+  EXPECT_NE(nullptr, history.resend(2, 1));
+  EXPECT_EQ(nullptr, history.resend(2, 1));
+  EXPECT_NE(nullptr, history.resend(3, 1));
+  EXPECT_NE(nullptr, history.resend(2, 2));
+  EXPECT_EQ(nullptr, history.resend(2, 2));
+}
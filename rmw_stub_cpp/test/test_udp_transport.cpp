@@ -0,0 +1,307 @@
+#include <gtest/gtest.h>
+
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rmw/types.h"
+
+#include "rmw_stub_cpp/stub_sample.hpp"
+#include "rmw_stub_cpp/stub_shared_buffer.hpp"
+#include "rmw_stub_cpp/stub_subscription.hpp"
+#include "rmw_stub_cpp/stub_topic.hpp"
+#include "rmw_stub_cpp/stub_udp_transport.hpp"
+
+namespace
+{
+
+const char * const kTopicName = "/udp_test";
+const size_t kDatagramSize = 1472;
+const size_t kFragmentSize = kDatagramSize - sizeof(StubUdpHeader);
+const int kReaderTimeoutSeconds = 30;
+
+}  // namespace
+
+// The transport and its options are per process: each test runs a reader
+// and a writer process, exchanging samples over 127.0.0.1
+class TestUdpTransport : public ::testing::Test
+{
+protected:
+  using SizeOf = std::function<size_t(int64_t)>;
+
+  void SetUp() override
+  {
+    // Ports unlikely to be used by another run of the test, nor still be
+    // bound by the processes of the previous test
+    static int test_index = 0;
+    const int port = 20000 + (getpid() % 2500) * 16 + (test_index++ % 8) * 2;
+    reader_port_ = std::to_string(port);
+    writer_port_ = std::to_string(port + 1);
+  }
+
+  // Publish samples 1 to count from the writer, and check the reader gets
+  // each of them once, with its content, taking one every read_delay.
+  // With two_paths, each sample is also sent in a memfd.
+  void exchange(
+    int64_t count, SizeOf size_of, const std::string & drop,
+    size_t keep_all_max_samples = 100000,
+    std::chrono::milliseconds read_delay = std::chrono::milliseconds(0), bool two_paths = false)
+  {
+    pid_t reader = spawn(
+      reader_port_, writer_port_, drop, keep_all_max_samples,
+      [count, size_of, read_delay]() {return read(count, size_of, read_delay);});
+    pid_t writer = spawn(
+      writer_port_, reader_port_, drop, keep_all_max_samples,
+      [count, size_of, two_paths]() {return write(count, size_of, two_paths);});
+
+    int reader_status = 0;
+    ASSERT_EQ(reader, waitpid(reader, &reader_status, 0));
+    // The writer answers NACKs until the reader is done
+    kill(writer, SIGKILL);
+    int writer_status = 0;
+    ASSERT_EQ(writer, waitpid(writer, &writer_status, 0));
+
+    ASSERT_TRUE(WIFEXITED(reader_status));
+    EXPECT_EQ(0, WEXITSTATUS(reader_status));
+    // Killed, unless it failed before
+    EXPECT_FALSE(WIFEXITED(writer_status)) << "writer exited with " << WEXITSTATUS(writer_status);
+  }
+
+  static uint8_t get_byte(int64_t sequence_number, size_t offset)
+  {
+    return static_cast<uint8_t>(offset * 7 + static_cast<size_t>(sequence_number));
+  }
+
+  std::string reader_port_;
+  std::string writer_port_;
+
+  static pid_t spawn(
+    const std::string & port, const std::string & peer_port, std::function<int()> body)
+  {
+    return spawn(port, peer_port, "0", 100000, std::move(body));
+  }
+
+  // Until the peer subscribes to the topic, or not anymore
+  static bool wait_for_subscriber(uint64_t topic_hash, bool subscribed)
+  {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (StubUdpTransport::instance().has_remote_subscribers(topic_hash) != subscribed) {
+      if (std::chrono::steady_clock::now() >= deadline) {
+        return false;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+  }
+
+private:
+  static pid_t spawn(
+    const std::string & port, const std::string & peer_port, const std::string & drop,
+    size_t keep_all_max_samples, std::function<int()> body)
+  {
+    fflush(nullptr);
+    pid_t pid = fork();
+    if (pid == 0) {
+      setenv("RMW_STUB_UDP_PORT", port.c_str(), 1);
+      setenv("RMW_STUB_UDP_PEERS", ("127.0.0.1:" + peer_port).c_str(), 1);
+      setenv("RMW_STUB_UDP_DROP", drop.c_str(), 1);
+      setenv("RMW_STUB_UDP_DATAGRAM_SIZE", std::to_string(kDatagramSize).c_str(), 1);
+      setenv("RMW_STUB_KEEP_ALL_MAX_SAMPLES", std::to_string(keep_all_max_samples).c_str(), 1);
+      _exit(body());
+    }
+    return pid;
+  }
+
+  static int read(int64_t count, SizeOf size_of, std::chrono::milliseconds read_delay)
+  {
+    auto topic = StubTopicRegistry::instance().get_topic(kTopicName);
+    rmw_qos_profile_t qos = {};
+    qos.history = RMW_QOS_POLICY_HISTORY_KEEP_ALL;
+    qos.reliability = RMW_QOS_POLICY_RELIABILITY_RELIABLE;
+    StubSubscription subscription(&qos, kTopicName);
+    topic->add_subscription(&subscription);
+    StubUdpTransport::instance().add_topic(topic);
+
+    std::set<int64_t> received;
+    int errors = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(kReaderTimeoutSeconds);
+    while (static_cast<int64_t>(received.size()) < count &&
+      std::chrono::steady_clock::now() < deadline)
+    {
+      auto sample = topic->take(&subscription);
+      if (!sample) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        continue;
+      }
+      std::this_thread::sleep_for(read_delay);
+      const int64_t sequence_number = sample->get_sequence_number();
+      if (!received.insert(sequence_number).second) {
+        fprintf(stderr, "sample %ld received twice\n", static_cast<long>(sequence_number));
+        errors++;
+        continue;
+      }
+      if (sequence_number < 1 || sequence_number > count ||
+        sample->size() != size_of(sequence_number))
+      {
+        fprintf(
+          stderr, "sample %ld of %zu bytes\n", static_cast<long>(sequence_number), sample->size());
+        errors++;
+        continue;
+      }
+      for (size_t offset = 0; offset < sample->size(); offset++) {
+        if (sample->data()[offset] != get_byte(sequence_number, offset)) {
+          fprintf(stderr, "sample %ld corrupted\n", static_cast<long>(sequence_number));
+          errors++;
+          break;
+        }
+      }
+    }
+    topic->remove_subscription(&subscription);
+    StubUdpTransport::instance().remove_topic(topic);
+
+    if (static_cast<int64_t>(received.size()) != count) {
+      fprintf(stderr, "%zu samples received of %ld\n", received.size(), static_cast<long>(count));
+      return 1;
+    }
+    return errors > 0 ? 2 : 0;
+  }
+
+  static int write(int64_t count, SizeOf size_of, bool two_paths)
+  {
+    auto topic = StubTopicRegistry::instance().get_topic(kTopicName);
+    StubUdpTransport & transport = StubUdpTransport::instance();
+    const uint64_t topic_hash = StubUdpTransport::get_topic_hash(kTopicName);
+
+    if (!wait_for_subscriber(topic_hash, true)) {
+      fprintf(stderr, "the reader didn't subscribe\n");
+      return 1;
+    }
+
+    for (int64_t sequence_number = 1; sequence_number <= count; sequence_number++) {
+      const size_t size = size_of(sequence_number);
+      auto sample = std::make_shared<StubSample>(
+        size, 1, sequence_number, 0, topic->get_memory_account());
+      for (size_t offset = 0; offset < sample->size(); offset++) {
+        sample->data()[offset] = get_byte(sequence_number, offset);
+      }
+      // The same sample in a memfd, sent before or after it
+      std::shared_ptr<StubSample> shared;
+      if (two_paths) {
+        shared = std::make_shared<StubSample>(
+          StubSharedBuffer::create(size), 1, sequence_number, 0, topic->get_memory_account());
+        memcpy(shared->data(), sample->data(), size);
+        if (!shared->get_shared_buffer()->seal()) {
+          fprintf(stderr, "can't seal a memfd\n");
+          return 1;
+        }
+      }
+      if (shared && sequence_number % 2 == 0) {
+        transport.send(topic_hash, shared, false, 0);
+      }
+      transport.send(topic_hash, std::move(sample), true, static_cast<size_t>(count));
+      if (shared && sequence_number % 2 == 1) {
+        transport.send(topic_hash, shared, false, 0);
+      }
+      // Don't overflow the socket buffers all at once
+      if (sequence_number % 100 == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+
+    // Until killed, answering NACKs
+    while (true) {
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+  }
+};
+
+// Samples of one datagram, and fragmented ones of any length
+TEST_F(TestUdpTransport, fragmentation) {
+  const std::vector<size_t> sizes = {
+    0, 1, kFragmentSize - 1, kFragmentSize, kFragmentSize + 1, 3 * kFragmentSize + 7, 200000};
+
+  exchange(
+    700, [sizes](int64_t sequence_number) {
+      return sizes[static_cast<size_t>(sequence_number) % sizes.size()];
+    }, "0");
+}
+
+// Every sample is received once, though a tenth of the datagrams are lost
+TEST_F(TestUdpTransport, reliable_with_drops) {
+  exchange(
+    2000, [](int64_t sequence_number) {
+      return sequence_number % 4 == 0 ? size_t{5000} : size_t{100};
+    }, "0.1");
+}
+
+// A reader slower than the writer holds 10 samples at most: the ones it has
+// no room for are sent again until it takes them, rather than overwriting
+// the ones it has yet to take
+TEST_F(TestUdpTransport, full_reader_gets_samples_again) {
+  exchange(
+    200, [](int64_t) {return size_t{100};}, "0", 10, std::chrono::milliseconds(2));
+}
+
+// Samples received both over UDP and in a memfd are delivered once
+TEST_F(TestUdpTransport, two_paths) {
+  exchange(
+    300, [](int64_t) {return size_t{3000};}, "0", 100000, std::chrono::milliseconds(0), true);
+}
+
+// Peers stop sending a topic to a process once its last subscription is gone
+TEST_F(TestUdpTransport, unsubscribing) {
+  const uint64_t topic_hash = StubUdpTransport::get_topic_hash(kTopicName);
+  pid_t reader = spawn(
+    reader_port_, writer_port_, []() {
+      auto topic = StubTopicRegistry::instance().get_topic(kTopicName);
+      StubUdpTransport & transport = StubUdpTransport::instance();
+      transport.add_topic(topic);
+      transport.add_topic(topic);
+      transport.remove_topic(topic);
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+      // Still subscribed to by the second subscription, until then
+      transport.remove_topic(topic);
+      while (true) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+      }
+      return 0;
+    });
+  pid_t writer = spawn(
+    writer_port_, reader_port_, [topic_hash]() {
+      auto start = std::chrono::steady_clock::now();
+      if (!wait_for_subscriber(topic_hash, true)) {
+        fprintf(stderr, "the reader didn't subscribe\n");
+        return 1;
+      }
+      if (!wait_for_subscriber(topic_hash, false)) {
+        fprintf(stderr, "the reader didn't unsubscribe\n");
+        return 2;
+      }
+      if (std::chrono::steady_clock::now() - start < std::chrono::seconds(1)) {
+        fprintf(stderr, "the reader unsubscribed with a subscription left\n");
+        return 3;
+      }
+      return 0;
+    });
+
+  int writer_status = 0;
+  ASSERT_EQ(writer, waitpid(writer, &writer_status, 0));
+  kill(reader, SIGKILL);
+  int reader_status = 0;
+  ASSERT_EQ(reader, waitpid(reader, &reader_status, 0));
+
+  ASSERT_TRUE(WIFEXITED(writer_status));
+  EXPECT_EQ(0, WEXITSTATUS(writer_status));
+}
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rmw/types.h"
+
+#include "rmw_stub_cpp/stub_publisher.hpp"
+#include "rmw_stub_cpp/stub_scheduler.hpp"
+#include "rmw_stub_cpp/stub_subscription.hpp"
+#include "rmw_stub_cpp/stub_topic.hpp"
+
+// Run with RMW_STUB_VIRTUAL_TIME=1 and a KEEP_ALL limit of 3 samples
+class TestVirtualTime : public ::testing::Test
+{
+protected:
+  struct Endpoints
+  {
+    rmw_qos_profile_t qos;
+    std::shared_ptr<StubTopic> topic;
+    std::unique_ptr<StubPublisher> publisher;
+    std::unique_ptr<StubSubscription> subscription;
+  };
+
+  void TearDown() override
+  {
+    for (auto & endpoints : endpoints_) {
+      endpoints->topic->remove_subscription(endpoints->subscription.get());
+    }
+  }
+
+  // A reliable publisher and a subscription, whose callback logs `name`
+  Endpoints & create(const std::string & name, rmw_qos_history_policy_t history)
+  {
+    std::unique_ptr<Endpoints> endpoints(new Endpoints());
+    const std::string topic_name = "/" + name;
+    endpoints->qos = rmw_qos_profile_t{};
+    endpoints->qos.history = history;
+    endpoints->qos.depth = 10;
+    endpoints->qos.reliability = RMW_QOS_POLICY_RELIABILITY_RELIABLE;
+    endpoints->topic = StubTopicRegistry::instance().get_topic(topic_name.c_str());
+    endpoints->publisher.reset(new StubPublisher(&endpoints->qos, topic_name.c_str()));
+    endpoints->publisher->set_topic(endpoints->topic);
+    endpoints->subscription.reset(new StubSubscription(&endpoints->qos, topic_name.c_str()));
+    endpoints->topic->add_subscription(endpoints->subscription.get());
+    names_.push_back(name);
+    endpoints->subscription->set_callback(&on_sample, &names_.back());
+    endpoints_.push_back(std::move(endpoints));
+    return *endpoints_.back();
+  }
+
+  // The sequence number of the sample scheduled
+  static int64_t schedule(Endpoints & endpoints, std::chrono::milliseconds delay)
+  {
+    auto sample = endpoints.publisher->create_sample(8);
+    const int64_t sequence_number = sample->get_sequence_number();
+    endpoints.publisher->schedule_delivery(std::move(sample), delay);
+    return sequence_number;
+  }
+
+  static std::vector<int64_t> take_all(Endpoints & endpoints)
+  {
+    std::vector<int64_t> sequence_numbers;
+    while (auto sample = endpoints.topic->take(endpoints.subscription.get())) {
+      sequence_numbers.push_back(sample->get_sequence_number());
+    }
+    return sequence_numbers;
+  }
+
+  static std::vector<std::string> callbacks_;
+
+private:
+  static void on_sample(const void * user_data, size_t count)
+  {
+    for (size_t i = 0; i < count; i++) {
+      callbacks_.push_back(*static_cast<const std::string *>(user_data));
+    }
+  }
+
+  std::vector<std::unique_ptr<Endpoints>> endpoints_;
+  // Stable addresses, for the callbacks' user data
+  std::deque<std::string> names_;
+};
+
+std::vector<std::string> TestVirtualTime::callbacks_;
+
+TEST_F(TestVirtualTime, delivers_as_time_is_advanced) {
+  ASSERT_TRUE(StubScheduler::instance().is_virtual());
+  callbacks_.clear();
+  Endpoints & a = create("virtual_a", RMW_QOS_POLICY_HISTORY_KEEP_LAST);
+  Endpoints & b = create("virtual_b", RMW_QOS_POLICY_HISTORY_KEEP_LAST);
+
+  const int64_t a1 = schedule(a, std::chrono::milliseconds(20));
+  const int64_t b1 = schedule(b, std::chrono::milliseconds(10));
+  const int64_t a2 = schedule(a, std::chrono::milliseconds(0));
+  const int64_t a3 = schedule(a, std::chrono::milliseconds(0));
+
+  // Nothing is delivered until time is advanced
+  EXPECT_TRUE(callbacks_.empty());
+  EXPECT_TRUE(take_all(a).empty());
+
+  // Samples due at the same time are delivered in the order they were sent
+  EXPECT_EQ(2u, StubScheduler::instance().advance(std::chrono::milliseconds(5)));
+  EXPECT_EQ((std::vector<std::string>{"virtual_a", "virtual_a"}), callbacks_);
+  EXPECT_EQ((std::vector<int64_t>{a2, a3}), take_all(a));
+
+  EXPECT_EQ(2u, StubScheduler::instance().advance(std::chrono::milliseconds(20)));
+  EXPECT_EQ(
+    (std::vector<std::string>{"virtual_a", "virtual_a", "virtual_b", "virtual_a"}), callbacks_);
+  EXPECT_EQ((std::vector<int64_t>{a1}), take_all(a));
+  EXPECT_EQ((std::vector<int64_t>{b1}), take_all(b));
+}
+
+TEST_F(TestVirtualTime, full_subscription_is_not_overwritten) {
+  callbacks_.clear();
+  Endpoints & full = create("virtual_full", RMW_QOS_POLICY_HISTORY_KEEP_ALL);
+  const size_t sample_size = 8;
+
+  // Scheduled while the subscription still had room
+  std::vector<int64_t> scheduled;
+  for (int i = 0; i < 5; i++) {
+    ASSERT_EQ(
+      RMW_RET_OK, full.publisher->wait_for_room(sample_size, std::chrono::seconds(1)));
+    scheduled.push_back(schedule(full, std::chrono::milliseconds(1)));
+  }
+
+  // The samples delivered once it's full are dropped
+  EXPECT_EQ(5u, StubScheduler::instance().advance(std::chrono::milliseconds(1)));
+  EXPECT_EQ(3u, callbacks_.size());
+
+  // Reliable publishers are told at once, without waiting for the timeout
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_EQ(
+    RMW_RET_TIMEOUT, full.publisher->wait_for_room(sample_size, std::chrono::seconds(1)));
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(500));
+
+  EXPECT_EQ(scheduled[0], full.topic->take(full.subscription.get())->get_sequence_number());
+  EXPECT_EQ(
+    RMW_RET_OK, full.publisher->wait_for_room(sample_size, std::chrono::seconds(1)));
+  EXPECT_EQ((std::vector<int64_t>{scheduled[1], scheduled[2]}), take_all(full));
+}
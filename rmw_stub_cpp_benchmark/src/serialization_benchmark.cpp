@@ -0,0 +1,237 @@
+// Copyright 2020 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Throughput of rmw_serialize, rmw_deserialize and rmw_get_serialized_message_size
+// over a corpus of messages. Each benchmark reports the time per message and,
+// through the bytes processed, the serialized bandwidth.
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "rcutils/allocator.h"
+#include "rmw/rmw.h"
+#include "rmw/serialized_message.h"
+#include "rosidl_typesupport_cpp/message_type_support.hpp"
+
+#include "geometry_msgs/msg/transform_stamped.hpp"
+#include "sensor_msgs/msg/image.hpp"
+#include "sensor_msgs/msg/joint_state.hpp"
+#include "sensor_msgs/msg/point_cloud2.hpp"
+#include "sensor_msgs/msg/point_field.hpp"
+#include "tf2_msgs/msg/tf_message.hpp"
+
+#include "rmw_stub_cpp_benchmark/msg/tree.hpp"
+
+namespace
+{
+
+void fill_header(std_msgs::msg::Header & header, const std::string & frame_id)
+{
+  header.stamp.sec = 1600000000;
+  header.stamp.nanosec = 123456789;
+  header.frame_id = frame_id;
+}
+
+// 1080p RGB camera frame
+sensor_msgs::msg::Image make_image()
+{
+  sensor_msgs::msg::Image image;
+  fill_header(image.header, "camera_optical_frame");
+  image.height = 1080;
+  image.width = 1920;
+  image.encoding = "rgb8";
+  image.step = image.width * 3;
+  image.data.resize(image.step * image.height, 0x5a);
+  return image;
+}
+
+// 100k XYZI points
+sensor_msgs::msg::PointCloud2 make_point_cloud()
+{
+  sensor_msgs::msg::PointCloud2 cloud;
+  fill_header(cloud.header, "lidar");
+  const char * names[] = {"x", "y", "z", "intensity"};
+  for (uint32_t i = 0; i < 4; i++) {
+    sensor_msgs::msg::PointField field;
+    field.name = names[i];
+    field.offset = i * 4;
+    field.datatype = sensor_msgs::msg::PointField::FLOAT32;
+    field.count = 1;
+    cloud.fields.push_back(field);
+  }
+  cloud.height = 1;
+  cloud.width = 100000;
+  cloud.point_step = 16;
+  cloud.row_step = cloud.point_step * cloud.width;
+  cloud.is_dense = true;
+  cloud.data.resize(cloud.row_step, 0x3c);
+  return cloud;
+}
+
+// 30 joints arm and hand
+sensor_msgs::msg::JointState make_joint_state()
+{
+  sensor_msgs::msg::JointState joint_state;
+  fill_header(joint_state.header, "base_link");
+  for (int i = 0; i < 30; i++) {
+    joint_state.name.push_back("joint_" + std::to_string(i));
+    joint_state.position.push_back(0.1 * i);
+    joint_state.velocity.push_back(0.01 * i);
+    joint_state.effort.push_back(1.0 * i);
+  }
+  return joint_state;
+}
+
+// 50 frames tree
+tf2_msgs::msg::TFMessage make_tf()
+{
+  tf2_msgs::msg::TFMessage tf;
+  for (int i = 0; i < 50; i++) {
+    geometry_msgs::msg::TransformStamped transform;
+    fill_header(transform.header, "frame_" + std::to_string(i));
+    transform.child_frame_id = "frame_" + std::to_string(i + 1);
+    transform.transform.translation.x = 0.5 * i;
+    transform.transform.rotation.w = 1.0;
+    tf.transforms.push_back(transform);
+  }
+  return tf;
+}
+
+// 4 levels of nested messages, fixed size
+rmw_stub_cpp_benchmark::msg::Tree make_tree()
+{
+  rmw_stub_cpp_benchmark::msg::Tree tree;
+  tree.score = 0.5f;
+  for (auto & limb : tree.limbs) {
+    limb.stamp = 42;
+    for (auto & branch : limb.branches) {
+      branch.id = 7;
+      for (auto & leaf : branch.leaves) {
+        leaf.pose.position.x = 1.0;
+        leaf.pose.orientation.w = 1.0;
+        leaf.covariance[0] = 0.01;
+        leaf.valid = true;
+      }
+    }
+  }
+  return tree;
+}
+
+class SerializedMessage
+{
+public:
+  SerializedMessage()
+  {
+    message_ = rmw_get_zero_initialized_serialized_message();
+    rcutils_allocator_t allocator = rcutils_get_default_allocator();
+    if (RMW_RET_OK != rmw_serialized_message_init(&message_, 0, &allocator)) {
+      message_.buffer = nullptr;
+    }
+  }
+
+  ~SerializedMessage()
+  {
+    rmw_serialized_message_fini(&message_);
+  }
+
+  rmw_serialized_message_t * get()
+  {
+    return &message_;
+  }
+
+private:
+  rmw_serialized_message_t message_;
+};
+
+template<typename MessageT, MessageT (* make_message)()>
+void serialize(benchmark::State & state)
+{
+  const MessageT message = make_message();
+  auto type_support = rosidl_typesupport_cpp::get_message_type_support_handle<MessageT>();
+  SerializedMessage serialized;
+
+  for (auto _ : state) {
+    if (RMW_RET_OK != rmw_serialize(&message, type_support, serialized.get())) {
+      state.SkipWithError("rmw_serialize failed");
+      break;
+    }
+    benchmark::DoNotOptimize(serialized.get()->buffer);
+    benchmark::ClobberMemory();
+  }
+
+  state.SetBytesProcessed(
+    static_cast<int64_t>(state.iterations() * serialized.get()->buffer_length));
+  state.SetLabel(std::to_string(serialized.get()->buffer_length) + " bytes");
+}
+
+template<typename MessageT, MessageT (* make_message)()>
+void deserialize(benchmark::State & state)
+{
+  const MessageT message = make_message();
+  auto type_support = rosidl_typesupport_cpp::get_message_type_support_handle<MessageT>();
+  SerializedMessage serialized;
+  if (RMW_RET_OK != rmw_serialize(&message, type_support, serialized.get())) {
+    state.SkipWithError("rmw_serialize failed");
+    return;
+  }
+
+  MessageT output;
+  for (auto _ : state) {
+    if (RMW_RET_OK != rmw_deserialize(serialized.get(), type_support, &output)) {
+      state.SkipWithError("rmw_deserialize failed");
+      break;
+    }
+    benchmark::DoNotOptimize(output);
+    benchmark::ClobberMemory();
+  }
+
+  state.SetBytesProcessed(
+    static_cast<int64_t>(state.iterations() * serialized.get()->buffer_length));
+  state.SetLabel(std::to_string(serialized.get()->buffer_length) + " bytes");
+}
+
+// Only fixed size types have a serialized size known without a message
+template<typename MessageT>
+void get_serialized_message_size(benchmark::State & state)
+{
+  auto type_support = rosidl_typesupport_cpp::get_message_type_support_handle<MessageT>();
+  size_t size = 0;
+
+  for (auto _ : state) {
+    if (RMW_RET_OK != rmw_get_serialized_message_size(type_support, nullptr, &size)) {
+      state.SkipWithError("not a fixed size type");
+      break;
+    }
+    benchmark::DoNotOptimize(size);
+  }
+
+  state.SetLabel(std::to_string(size) + " bytes");
+}
+
+}  // namespace
+
+#define BENCHMARK_MESSAGE(MessageT, make_message, name) \
+  BENCHMARK_TEMPLATE(serialize, MessageT, make_message)->Name("serialize/" name); \
+  BENCHMARK_TEMPLATE(deserialize, MessageT, make_message)->Name("deserialize/" name); \
+  BENCHMARK_TEMPLATE(get_serialized_message_size, MessageT)->Name( \
+    "get_serialized_message_size/" name)
+
+BENCHMARK_MESSAGE(sensor_msgs::msg::Image, make_image, "Image");
+BENCHMARK_MESSAGE(sensor_msgs::msg::PointCloud2, make_point_cloud, "PointCloud2");
+BENCHMARK_MESSAGE(sensor_msgs::msg::JointState, make_joint_state, "JointState");
+BENCHMARK_MESSAGE(tf2_msgs::msg::TFMessage, make_tf, "TFMessage");
+BENCHMARK_MESSAGE(rmw_stub_cpp_benchmark::msg::Tree, make_tree, "Tree");
+
+BENCHMARK_MAIN();